@@ -0,0 +1,98 @@
+/*
+bench_loop.cpp: benchmark for "make bench".
+Runs a loop of builtins N times (100000 by default) in two ways and prints the time per iteration:
+  parsed once - the loop is parsed into a tree once and the body runs from the tree
+                (what the shell does since loops exist)
+  re-lexed    - the body text is lexed and parsed again for every iteration
+                (what running the body as a fresh command line every time costs)
+  execute()   - the whole loop given to Shell::execute(), like a program embedding the shell
+The output of the builtins goes to /dev/null, the results are printed on stderr.
+*/
+
+#include "posixshell.h"
+#include "script.h"
+#include "vars.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <iostream>
+#include <iomanip>
+
+using namespace std;
+
+static const string BODY = "x=$i; cd .; echo $x; pwd";
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool parse(const string &text, shared_ptr<Node> &tree)
+{
+    string error;
+    if (parse_script(text, tree, error) != PARSE_OK)
+    {
+        cerr << "bench_loop: cannot parse '" << text << "': " << error << endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    long iterations = (argc > 1) ? atol(argv[1]) : 100000;
+    if (iterations <= 0)
+    {
+        cerr << "Usage: bench_loop [iterations]" << endl;
+        return 1;
+    }
+
+    Shell shell; // the session: home is the current directory, no history is written
+
+    // the builtins print a lot, and the terminal must not be what we measure
+    int devnull = open("/dev/null", O_WRONLY);
+    int savedOut = dup(STDOUT_FILENO);
+    dup2(devnull, STDOUT_FILENO);
+    close(devnull);
+
+    // 1. parsed once: "for i in {1..N}; do BODY; done"
+    shared_ptr<Node> loop;
+    if (!parse("for i in {1.." + to_string(iterations) + "}; do " + BODY + "; done", loop))
+        return 1;
+    double start = now_seconds();
+    run_node(*loop);
+    double parsedOnce = now_seconds() - start;
+
+    // 2. re-lexed: the same iterations, but the body text is parsed every time
+    start = now_seconds();
+    for (long i = 1; i <= iterations; i++)
+    {
+        set_variable("i", to_string(i));
+        shared_ptr<Node> body;
+        if (!parse(BODY, body))
+            return 1;
+        run_node(*body);
+    }
+    double relexed = now_seconds() - start;
+
+    // 3. the public API: parsing and running happen inside execute()
+    string script = "for i in {1.." + to_string(iterations) + "}; do " + BODY + "; done";
+    start = now_seconds();
+    shell.execute(script);
+    double executed = now_seconds() - start;
+
+    cout.flush();
+    dup2(savedOut, STDOUT_FILENO);
+    close(savedOut);
+
+    cerr << "loop body: " << BODY << endl;
+    cerr << fixed << setprecision(3);
+    cerr << "iterations:  " << iterations << endl;
+    cerr << "parsed once: " << parsedOnce << " s (" << parsedOnce * 1e9 / iterations << " ns/iteration)" << endl;
+    cerr << "re-lexed:    " << relexed << " s (" << relexed * 1e9 / iterations << " ns/iteration)" << endl;
+    cerr << "saved:       " << (relexed - parsedOnce) * 100 / relexed << " %" << endl;
+    cerr << "execute():   " << executed << " s (" << executed * 1e9 / iterations << " ns/iteration)" << endl;
+    return 0;
+}
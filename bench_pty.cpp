@@ -0,0 +1,271 @@
+/*
+bench_pty.cpp: end-to-end latency harness for "make latency".
+Starts the built shell under a pseudo-terminal (forkpty), types into it like a user
+and measures how long the shell takes to answer:
+  keystroke       - a typed character until it is echoed back
+  tab completion  - "ech" + TAB until the completed "o " shows up
+  enter -> output - "echo hi" + Enter until "hi" is printed
+  enter -> prompt - a builtin (pwd) and a program (/bin/true) until the prompt is back
+  ctrl-c -> prompt - Ctrl+C during "sleep 10" until the prompt is back
+Each one is repeated N times (200 by default) and printed as p50 / p99 / max in ms.
+The shell runs in a fresh temporary directory, so the user's history is not touched.
+Exits with 1 if the shell did not answer within 5 seconds.
+*/
+
+#include <pty.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ftw.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define ANSWER_TIMEOUT_MS 5000
+
+static int masterFd = -1; // our side of the pseudo-terminal
+static string output;     // everything the shell wrote so far
+static string prompt;     // the prompt, as printed after startup
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Reads what the shell wrote, waiting at most timeoutMs for it. false on timeout or EOF.
+static bool read_output(int timeoutMs)
+{
+    struct pollfd pfd = {masterFd, POLLIN, 0};
+    if (poll(&pfd, 1, timeoutMs) <= 0)
+        return false;
+    char buffer[4096];
+    ssize_t n = read(masterFd, buffer, sizeof(buffer));
+    if (n <= 0)
+        return false;
+    output.append(buffer, n);
+    return true;
+}
+
+static void send(const string &keys)
+{
+    if (write(masterFd, keys.data(), keys.size()) != (ssize_t)keys.size())
+        perror("bench_pty: write");
+}
+
+// Waits until 'text' shows up in the output after position 'from'
+// (at the very end of the output if atEnd). Returns false after ANSWER_TIMEOUT_MS.
+static bool wait_for(const string &text, size_t from, bool atEnd)
+{
+    double deadline = now_ms() + ANSWER_TIMEOUT_MS;
+    while (true)
+    {
+        if (atEnd)
+        {
+            if (output.size() >= from + text.size() &&
+                output.compare(output.size() - text.size(), text.size(), text) == 0)
+                return true;
+        }
+        else if (output.find(text, from) != string::npos)
+            return true;
+
+        int left = (int)(deadline - now_ms());
+        if (left <= 0 || !read_output(left))
+            return false;
+    }
+}
+
+static bool wait_for_prompt(size_t from)
+{
+    return wait_for(prompt, from, true);
+}
+
+// Reads until the shell has been quiet for quietMs
+static void drain(int quietMs)
+{
+    while (read_output(quietMs))
+        ;
+}
+
+// Sends 'keys' and returns the milliseconds until 'answer' appears (-1 on timeout)
+static double measure(const string &keys, const string &answer, bool atEnd)
+{
+    size_t from = output.size();
+    double start = now_ms();
+    send(keys);
+    if (!wait_for(answer, from, atEnd))
+        return -1;
+    return now_ms() - start;
+}
+
+// Clears the line being typed (Ctrl+U) and presses Enter, then waits for the prompt
+static bool reset_line()
+{
+    size_t from = output.size();
+    send("\x15\r");
+    return wait_for_prompt(from);
+}
+
+static void print_stats(const string &name, vector<double> samples)
+{
+    sort(samples.begin(), samples.end());
+    auto at = [&](double fraction)
+    { return samples[min(samples.size() - 1, (size_t)(fraction * samples.size()))]; };
+    cout << "  " << left << setw(18) << name << right << fixed << setprecision(3)
+         << setw(9) << at(0.50) << setw(9) << at(0.99) << setw(9) << samples.back()
+         << setw(7) << samples.size() << endl;
+}
+
+// Runs one scenario 'count' times. step() returns the latency or -1 on timeout.
+static bool run_scenario(const string &name, int count, double (*step)())
+{
+    vector<double> samples;
+    for (int i = 0; i < count; i++)
+    {
+        double ms = step();
+        if (ms < 0)
+        {
+            cerr << "bench_pty: " << name << ": no answer from the shell within "
+                 << ANSWER_TIMEOUT_MS << " ms" << endl;
+            cerr << "last output: ..." << output.substr(output.size() > 200 ? output.size() - 200 : 0) << endl;
+            return false;
+        }
+        samples.push_back(ms);
+    }
+    print_stats(name, samples);
+    return true;
+}
+
+static double keystroke_step()
+{
+    double ms = measure("x", "x", true);
+    if (ms >= 0 && output.size() > 40 && !reset_line()) // don't let the line grow forever
+        return -1;
+    return ms;
+}
+
+static double tab_step()
+{
+    size_t from = output.size();
+    send("ech");
+    if (!wait_for("ech", from, false))
+        return -1;
+    double ms = measure("\t", "o ", false);
+    return (ms >= 0 && reset_line()) ? ms : -1;
+}
+
+static double echo_step()
+{
+    size_t from = output.size();
+    double ms = measure("echo hi\r", "hi \r\n", false); // echo prints a space after each word
+    return (ms >= 0 && wait_for_prompt(from)) ? ms : -1;
+}
+
+static double pwd_step()
+{
+    return measure("pwd\r", prompt, true);
+}
+
+static double true_step()
+{
+    return measure("/bin/true\r", prompt, true);
+}
+
+static double ctrl_c_step()
+{
+    size_t from = output.size();
+    send("sleep 10\r");
+    if (!wait_for("sleep 10\r\n", from, false))
+        return -1;
+    usleep(20000); // let the child get to exec()
+    return measure("\x03", prompt, true);
+}
+
+static int remove_entry(const char *path, const struct stat *, int, struct FTW *)
+{
+    return remove(path);
+}
+
+int main(int argc, char *argv[])
+{
+    string shellPath = (argc > 1) ? argv[1] : "./shell";
+    int iterations = (argc > 2) ? atoi(argv[2]) : 200;
+    if (iterations <= 0 || access(shellPath.c_str(), X_OK) != 0)
+    {
+        cerr << "Usage: bench_pty [path to shell] [iterations]" << endl;
+        return 1;
+    }
+    char resolved[4096];
+    if (realpath(shellPath.c_str(), resolved) == nullptr)
+        return 1;
+
+    // a fresh home directory: the shell keeps its history where it starts
+    char dir[] = "/tmp/bench_pty.XXXXXX";
+    if (mkdtemp(dir) == nullptr)
+    {
+        perror("bench_pty: mkdtemp");
+        return 1;
+    }
+
+    struct winsize size = {40, 120, 0, 0};
+    pid_t pid = forkpty(&masterFd, nullptr, nullptr, &size);
+    if (pid < 0)
+    {
+        perror("bench_pty: forkpty");
+        return 1;
+    }
+    if (pid == 0)
+    {
+        if (chdir(dir) != 0)
+            _exit(1);
+        setenv("HOME", dir, 1);
+        setenv("TERM", "xterm", 1);
+        execl(resolved, "shell", (char *)nullptr);
+        _exit(127);
+    }
+
+    // the prompt is the last line printed once the shell is quiet
+    if (!read_output(ANSWER_TIMEOUT_MS))
+    {
+        cerr << "bench_pty: the shell printed nothing" << endl;
+        return 1;
+    }
+    drain(300);
+    prompt = output.substr(output.rfind('\n') + 1);
+    size_t escape = prompt.rfind("\x1b[?2004h"); // bracketed paste mode, sent before the prompt
+    if (escape != string::npos)
+        prompt = prompt.substr(escape + 8);
+    if (prompt.empty())
+    {
+        cerr << "bench_pty: no prompt found" << endl;
+        return 1;
+    }
+
+    cout << "PTY latency of " << shellPath << " (ms, " << iterations << " runs each)" << endl;
+    cout << "  " << left << setw(18) << "" << right << setw(9) << "p50" << setw(9) << "p99"
+         << setw(9) << "max" << setw(7) << "runs" << endl;
+    bool ok = run_scenario("keystroke", iterations, keystroke_step) &&
+              reset_line() &&
+              run_scenario("tab completion", iterations, tab_step) &&
+              run_scenario("enter -> output", iterations, echo_step) &&
+              run_scenario("enter -> prompt", iterations, pwd_step) &&
+              run_scenario("program -> prompt", iterations, true_step) &&
+              run_scenario("ctrl-c -> prompt", max(5, iterations / 10), ctrl_c_step);
+
+    send("exit\r");
+    drain(200);
+    kill(pid, SIGKILL); // in case "exit" did not get through
+    waitpid(pid, nullptr, 0);
+    nftw(dir, remove_entry, 8, FTW_DEPTH | FTW_PHYS);
+    return ok ? 0 : 1;
+}
@@ -1,5 +1,22 @@
 #include "builtins.h"
 #include "extras.h"
+#include "fileops.h"
+#include "pipes.h"
+#include "jobs.h"
+#include "vars.h"
+#include "launch.h"
+#include "script.h"
+#include "scriptcmds.h"
+#include "eventloop.h"
+#include "policy.h"
+#include "walk.h"
+#include "du.h"
+#include "frecency.h"
+#include "supervise.h"
+#include "metrics.h"
+#include "textscan.h"
+#include "suggest.h"
+#include "watch.h"
 #include <dirent.h>    // for opendir(), readdir(), closedir()
 #include <unistd.h>    // for chdir(), fork(), execvp()
 #include <sys/stat.h>  // for stat()
@@ -11,6 +28,8 @@
 #include <grp.h>      // for getgrgid()
 #include <iomanip>    // for setw() function (used to fix the width of the output)
 #include <sys/wait.h> // for waitpid()
+#include <errno.h>
+#include <stdlib.h>   // for strtol()
 
 using namespace std;
 
@@ -20,16 +39,123 @@ static string prevDir; // static variable to remember previous directory for 'cd
 
 void run_ls(vector<string> args);
 
+// Reads a count like "5" (digits only, no sign). Returns false if it isn't one.
+static bool parse_count(const string &text, int &value)
+{
+    char *end = nullptr;
+    errno = 0;
+    long number = strtol(text.c_str(), &end, 10);
+    if (text.empty() || !isdigit((unsigned char)text[0]) || *end != '\0' || errno == ERANGE || number > INT_MAX)
+        return false;
+    value = (int)number;
+    return true;
+}
+
+// list of all the builtins handled below. We will need to update this if we add/remove builtins.
+static const vector<string> builtinNames = {
+    "cd", "pwd", "echo", "ls", "pinfo", "search", "history", "exit",
+    "cat", "cp", "grep", "wc", "pipesize", "pipestat", "export", "unset", "env", "policy", "du", "z", "timeout", "wait", "kill", "shellstat", "watch",
+    "break", "continue", "return", "test", "[", "printf", "true", "false", ":"
+};
+
+const vector<string> &builtin_names()
+{
+    return builtinNames;
+}
+
+bool is_builtin(const string &name)
+{
+    for (const string &b : builtinNames)
+    {
+        if (b == name)
+            return true;
+    }
+    return false;
+}
+
+// cat, cp, grep and wc only run inside the shell for the options they understand;
+// with any other options the real program is started
+static bool needs_program(const vector<string> &args)
+{
+    if (args[0] == "cat")
+        return !cat_supported(args, STDIN_FILENO);
+    if (args[0] == "cp")
+        return !cp_supported(args);
+    if (args[0] == "grep" || args[0] == "wc")
+        return !scan_supported(args, STDIN_FILENO);
+    return false;
+}
+
 bool handleBuiltinCommands(const vector<string> &args_input)
 {
     vector<string> args = args_input;
     if (args.empty() == true)
         return false;
 
+    // leading NAME=value words are variable assignments
+    size_t assignments = 0;
+    string name, value;
+    while (assignments < args.size() && split_assignment(args[assignments], name, value))
+        assignments++;
+    if (assignments == args.size())
+    {
+        // only assignments ("X=1 Y=2"): they set shell variables
+        for (const string &word : args)
+        {
+            split_assignment(word, name, value);
+            set_variable(name, value);
+        }
+        lastStatus = 0;
+        return true;
+    }
+    if (assignments > 0 && is_builtin(args[assignments]) &&
+        !needs_program(vector<string>(args.begin() + assignments, args.end())))
+    {
+        // "X=1 builtin ...": X is set only while the builtin runs
+        vector<pair<string, string>> saved;
+        vector<string> unsetAfter;
+        for (size_t i = 0; i < assignments; i++)
+        {
+            split_assignment(args[i], name, value);
+            if (variable_is_set(name))
+                saved.push_back({name, get_variable(name)});
+            else
+                unsetAfter.push_back(name);
+            set_variable(name, value);
+        }
+        handleBuiltinCommands(vector<string>(args.begin() + assignments, args.end()));
+        for (auto &old : saved)
+            set_variable(old.first, old.second);
+        for (const string &n : unsetAfter)
+            unset_variable(n);
+        return true;
+    }
+    // "X=1 program ...": the assignments stay in args, exec_command() exports them in the child
+
+    if (is_builtin(args[0]) && !needs_program(args))
+        count_stat(STAT_BUILTINS);
+
+    int previousStatus = lastStatus;
+    lastStatus = 0; // builtins succeed unless they set an error status below
+
     if (args[0] == "exit")
     {
-        cout << "Goodbye!" << endl;
-        exit(0); 
+        // the rest of the command line is skipped, then the session ends (see eventloop.cpp)
+        int status = 0;
+        if (args.size() > 1)
+        {
+            try
+            {
+                status = stoi(args[1]) & 0xff;
+            }
+            catch (...)
+            {
+                cerr << "exit: " << args[1] << ": numeric argument required" << endl;
+                status = 2;
+            }
+        }
+        request_exit(status); // written in script.cpp
+        return true;
     }
     else if (args[0] == "pwd")
     {
@@ -37,6 +163,7 @@ bool handleBuiltinCommands(const vector<string> &args_input)
         if (getcwd(cwd, sizeof(cwd)) == NULL)
         {
             perror("error in getcwd");
+            lastStatus = 1;
             return true; 
         }
         cout << cwd << endl;
@@ -54,12 +181,37 @@ bool handleBuiltinCommands(const vector<string> &args_input)
         run_ls(args);
         return true;
     }
+    else if (args[0] == "z" || (args[0] == "cd" && args.size() > 1 && args[1] == "-z"))
+    {
+        // "z fragments" / "cd -z fragments": go to the best-ranked directory matching them
+        vector<string> fragments(args.begin() + (args[0] == "z" ? 1 : 2), args.end());
+        if (args[0] == "z" && (fragments.empty() || fragments[0] == "-l"))
+        {
+            if (!fragments.empty())
+                fragments.erase(fragments.begin());
+            frecency_list(fragments); // written in frecency.cpp
+            return true;
+        }
+        string target;
+        if (!frecency_best(fragments, target))
+        {
+            cerr << args[0] << ": no directory matches";
+            for (const string &fragment : fragments)
+                cerr << " " << fragment;
+            cerr << endl;
+            lastStatus = 1;
+            return true;
+        }
+        cout << target << endl; // like "cd -", show where we went
+        return handleBuiltinCommands({"cd", target});
+    }
     else if (args[0] == "cd")
     {
                
         if (args.size() > 2)
         {
             cerr << "Invalid arguments" << endl;
+            lastStatus = 1;
             return true;
         }
         
@@ -92,6 +244,7 @@ bool handleBuiltinCommands(const vector<string> &args_input)
             if (prevDir.empty())
             {
                 cerr << "cd: OLDPWD not set" << endl; // Standard error message
+                lastStatus = 1;
                 return true;
             }
             target = prevDir;
@@ -109,6 +262,7 @@ bool handleBuiltinCommands(const vector<string> &args_input)
         
         if (chdir(target.c_str()) != 0) {
             perror("cd");
+            lastStatus = 1;
             
             // If chdir fails, revert prevDir to avoid inconsistent state
             char revertDir[PATH_MAX];
@@ -116,6 +270,13 @@ bool handleBuiltinCommands(const vector<string> &args_input)
                 prevDir = string(revertDir);
             }
         }
+        else
+        {
+            // remember the visit for "z" (written in frecency.cpp)
+            char newDir[PATH_MAX];
+            if (getcwd(newDir, sizeof(newDir)) != NULL)
+                frecency_visit(newDir);
+        }
         return true;
     }
     else if (args[0] == "pinfo")
@@ -128,21 +289,139 @@ bool handleBuiltinCommands(const vector<string> &args_input)
     }
     else if (args[0] == "search")
     {
-        if (args.size() < 2) {
-            cout << "Usage: search <filename>" << endl;
+        WalkBackend backend = WALK_SYNC; // "--backend=uring" batches the directory reads
+        if (take_backend_flag(args, backend) < 0) {
+            lastStatus = 2;
+        } else if (args.size() < 2) {
+            cout << "Usage: search [--backend=sync|uring] <filename>" << endl;
         } else {
-            cout << (searchFile(".", args[1]) ? "True" : "False") << endl;
+            bool found = searchFile(".", args[1], backend);
+            cout << (found ? "True" : "False") << endl;
+            lastStatus = found ? 0 : 1; // so "if search x; then" works
         }
         return true; 
     }
+    else if (args[0] == "shellstat")
+    {
+        lastStatus = shellstat_command(args);
+        return true;
+    }
+    else if (args[0] == "timeout")
+    {
+        lastStatus = timeout_command(args);
+        return true;
+    }
+    else if (args[0] == "watch")
+    {
+        lastStatus = watch_command(args);
+        return true;
+    }
+    else if (args[0] == "wait")
+    {
+        lastStatus = wait_command(args);
+        return true;
+    }
+    else if (args[0] == "kill")
+    {
+        lastStatus = kill_command(args);
+        return true;
+    }
+    else if (args[0] == "du")
+    {
+        lastStatus = du_command(args);
+        return true;
+    }
     else if (args[0] == "history")
     {
-        if (args.size() == 1)
+        bool stats = (args.size() > 1 && args[1] == "--stats");
+        size_t countAt = stats ? 2 : 1; // where the number of entries is given
+        int count = 0;
+        if (args.size() > countAt && !parse_count(args[countAt], count))
+        {
+            cerr << "history: " << args[countAt] << ": invalid number" << endl;
+            cerr << "Usage: history [n] | history --stats [n]" << endl;
+            lastStatus = 2;
+            return true;
+        }
+        if (stats)
+            showHistoryStats(args.size() > 2 ? count : 5); // slowest / frequent / failing commands
+        else if (args.size() == 1)
             showHistory(); // by default, it will show the last 20 commands
         else
-            showHistory(stoi(args[1])); // user specified n
+            showHistory(count); // user specified n
         return true; 
     }
+    else if (args[0] == "cat" && cat_supported(args, STDIN_FILENO))
+    {
+        lastStatus = run_cat(args, STDIN_FILENO, STDOUT_FILENO);
+        return true;
+    }
+    else if ((args[0] == "grep" || args[0] == "wc") && scan_supported(args, STDIN_FILENO))
+    {
+        // fixed-string grep and wc scan the input themselves (written in textscan.cpp)
+        lastStatus = run_scan(args, STDIN_FILENO, STDOUT_FILENO);
+        return true;
+    }
+    else if (args[0] == "cp" && cp_supported(args))
+    {
+        lastStatus = run_cp(args);
+        return true;
+    }
+    else if (args[0] == "pipesize")
+    {
+        pipesize_command(args);
+        return true;
+    }
+    else if (args[0] == "pipestat")
+    {
+        pipestat_command(args);
+        return true;
+    }
+    else if (args[0] == "policy")
+    {
+        lastStatus = policy_command(args);
+        return true;
+    }
+    else if (args[0] == "export")
+    {
+        export_command(args);
+        return true;
+    }
+    else if (args[0] == "unset")
+    {
+        unset_command(args);
+        return true;
+    }
+    else if (args[0] == "env" && args.size() == 1)
+    {
+        env_command(); // "env cmd ..." is left to /usr/bin/env
+        return true;
+    }
+    else if (args[0] == "test" || args[0] == "[")
+    {
+        lastStatus = test_command(args); // written in scriptcmds.cpp
+        return true;
+    }
+    else if (args[0] == "printf")
+    {
+        lastStatus = printf_command(args);
+        return true;
+    }
+    else if (args[0] == "true" || args[0] == ":")
+    {
+        return true; // lastStatus is already 0
+    }
+    else if (args[0] == "false")
+    {
+        lastStatus = 1;
+        return true;
+    }
+    else if (args[0] == "break" || args[0] == "continue" || args[0] == "return")
+    {
+        lastStatus = previousStatus; // "return" without a number keeps the last status
+        flow_command(args);          // written in script.cpp
+        return true;
+    }
     // else pass to system command handler
     else
     {
@@ -172,12 +451,24 @@ void run_system_command(vector<string> args, bool background)
     }
     argv.push_back(NULL); 
 
+    // a typo is found here, with suggestions, without starting a child for it
+    if (report_missing_command(argv.data()))
+    {
+        lastStatus = 127;
+        for (char *arg : argv) {
+            if (arg != nullptr) free(arg);
+        }
+        return;
+    }
+
     // create a child process
+    long long spawned = metrics_now_us();
     pid_t pid = fork();
 
     if (pid < 0) // If fork failed
     {
         perror("fork failed");
+        lastStatus = 1;
         // If the fork() call failed, then clean up allocated memory 
         for (char* arg : argv) {
             if (arg != nullptr) free(arg);
@@ -188,31 +479,24 @@ void run_system_command(vector<string> args, bool background)
     {
         // this is the child process
         // we will replace child with new program specified by the user
-        if (execvp(argv[0], argv.data()) == -1)
-        {
-            perror("execvp() failed");
-            exit(1); // exit child if execvp fails
-        }
+        exec_command(argv.data()); // exits the child if the program can't be started
     }
     else
     {
         // this is the parent process
         if (background == true)
         {
-            
-            cout << "[1] " << pid << endl; 
+            // the job is reaped (and reported as Done) by reap_jobs() before a later prompt
+            int job = add_job(pid, args[0], false);
+            cout << "[" << job << "] " << pid << endl;
         }
         else
         {
-            // Track foreground process for signal handling
-            foregroundPid = pid;
-            
-            // start the foreground process and wait until the child process finishes
-            int status;
-            waitpid(pid, &status, 0);
-            
-            // Reset foreground PID when process finishes
-            foregroundPid = -1;
+            // start the foreground process and wait until the child process finishes.
+            // Ctrl+C reaches it directly from the terminal (it is in our process group),
+            // Ctrl+Z is handled by wait_foreground() (written in eventloop.cpp).
+            lastStatus = wait_foreground(pid, args[0]);
+            record_latency(HIST_SPAWN_TO_EXIT, metrics_now_us() - spawned);
         }
     }
     
@@ -226,6 +510,9 @@ void run_ls(vector<string> args)
 {
     // Flags for "-a" (show hidden files) and "-l" (long listing)
     bool flag_a = false, flag_l = false;
+    WalkBackend backend = WALK_SYNC; // how "-l" gets the file details (walk.h)
+    if (take_backend_flag(args, backend) < 0)
+        return;
     vector<string> paths; // store directories or files to list
 
     // Note: args[0] is "ls", so we start checking from args[1]
@@ -273,27 +560,41 @@ void run_ls(vector<string> args)
         }
 
         // Read entries of the above opened directory (files/folders) one by one
+        vector<string> names;
         struct dirent *directoryEntry;
         while ((directoryEntry = readdir(dir)) != NULL) 
         {
             // Skip hidden files if "-a" is not given
             if ((flag_a == false) && directoryEntry->d_name[0] == '.')
                 continue;
+            names.push_back(directoryEntry->d_name);
+        }
+        closedir(dir); // close directory after reading
+
+        // For "-l", we need detailed information about the files. They are all
+        // stat()ed together, so the io_uring backend can send the calls as one batch.
+        vector<struct stat> stats;
+        vector<int> results;
+        if (flag_l == true)
+        {
+            // Full path = directory path + "/" + filename
+            vector<string> fullpaths;
+            for (const string &name : names)
+                fullpaths.push_back(path + "/" + name);
+            stat_many(fullpaths, stats, results, backend);
+        }
 
+        for (size_t i = 0; i < names.size(); i++)
+        {
             if (flag_l == true)
             {
-                // For "-l", we need detailed information about the file
-                struct stat st;
-
-                // Full path = directory path + "/" + filename
-                string fullpath = path + "/" + directoryEntry->d_name;
-
-                // Get file info using stat()
-                if (stat(fullpath.c_str(), &st) == -1)
+                if (results[i] != 0)
                 {
+                    errno = -results[i];
                     perror("Error in stat() in ls -l");
                     continue;
                 }
+                const struct stat &st = stats[i];
 
                 // Print file details like real `ls -l`
                 // 1. File type and permissions
@@ -327,15 +628,14 @@ void run_ls(vector<string> args)
                 cout << " " << timebuf;
 
                 // 6. File name
-                cout << " " << directoryEntry->d_name << "\n";
+                cout << " " << names[i] << "\n";
             }
             else
             {
                 // If "-l" not used, just print the name
-                cout << directoryEntry->d_name << "\n";
+                cout << names[i] << "\n";
             }
         }
-        closedir(dir); // close directory after reading
         
         // Add blank line between multiple directories
         if (paths.size() > 1) {
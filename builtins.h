@@ -9,6 +9,12 @@
 // Returns true if the command was a built-in command (handled), false otherwise
 bool handleBuiltinCommands(const std::vector<std::string> &args);
 
+// Names of all built-in commands (used for TAB completion and to decide what can run inside the shell)
+const std::vector<std::string> &builtin_names();
+
+// Returns true if 'name' is one of our built-in commands
+bool is_builtin(const std::string &name);
+
 // Executes system commands (non built-in commands) in foreground or background
 // Parameters: 
 //   args - vector of command arguments (args[0] is the command name)
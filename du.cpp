@@ -0,0 +1,311 @@
+/*
+du.cpp: parallel disk usage with hard link deduplication.
+*/
+
+#include "du.h"
+#include "walk.h"      // for walk_tree_parallel()
+#include "eventloop.h" // for take_interrupt()
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <iostream>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+
+using namespace std;
+
+// Disk usage of one directory (later: of everything below it)
+struct DuTotals
+{
+    long long blocks = 0; // 512-byte blocks (st_blocks)
+    long long bytes = 0;  // apparent size (st_size)
+};
+
+// The files with more than one link seen so far: (dev, ino) pairs, checked from all
+// threads. It is split into shards with a lock each, so threads rarely wait for each other.
+#define INODE_SHARDS 64
+
+struct InodeKey
+{
+    dev_t dev;
+    ino_t ino;
+    bool operator==(const InodeKey &other) const { return dev == other.dev && ino == other.ino; }
+};
+
+struct InodeHash
+{
+    size_t operator()(const InodeKey &key) const { return hash<unsigned long long>()(key.ino * 31 + key.dev); }
+};
+
+struct InodeShard
+{
+    mutex lock;
+    unordered_set<InodeKey, InodeHash> seen;
+};
+
+// true the first time this inode is seen
+static bool first_link(InodeShard *shards, dev_t dev, ino_t ino)
+{
+    InodeKey key = {dev, ino};
+    InodeShard &shard = shards[InodeHash()(key) % INODE_SHARDS];
+    lock_guard<mutex> guard(shard.lock);
+    return shard.seen.insert(key).second;
+}
+
+// What every thread collects on its own, merged after the walk
+struct DuThread
+{
+    unordered_map<string, DuTotals> dirs; // directory -> usage of the entries counted there
+    string lastDir;                       // the entries of one directory come one after the other,
+    DuTotals *last = nullptr;             // so the last lookup is remembered
+};
+
+// Length of the path prefix naming the directory 'depth' levels below the root
+// (the root itself for depth 0)
+static size_t ancestor_length(const string &path, size_t rootLength, int depth)
+{
+    size_t end = rootLength;
+    for (int i = 0; i < depth; i++)
+    {
+        end = path.find('/', end + 1);
+        if (end == string::npos)
+            return path.size();
+    }
+    return end;
+}
+
+// Number of levels below the root ("root/a/b" is 2)
+static int depth_of(const string &path, size_t rootLength)
+{
+    return (int)count(path.begin() + rootLength, path.end(), '/');
+}
+
+static string human_size(long long bytes)
+{
+    const char *units = "KMGTPE";
+    double value = bytes;
+    if (value < 1024)
+        return to_string(bytes);
+    int unit = -1;
+    while (value >= 1024 && unit < 5)
+    {
+        value /= 1024;
+        unit++;
+    }
+    char text[32];
+    snprintf(text, sizeof(text), value < 10 ? "%.1f%c" : "%.0f%c", value, units[unit]);
+    return text;
+}
+
+int du_command(const vector<string> &args)
+{
+    int maxDepth = -1; // -1: every directory
+    bool sameFilesystem = false, human = false, apparent = false;
+    int top = 0, threads = 0;
+    vector<string> roots;
+
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        const string &arg = args[i];
+        string value;
+        bool needsValue = (arg == "-d" || arg == "--max-depth" || arg == "--top" || arg == "-j");
+        if (needsValue)
+        {
+            if (i + 1 >= args.size())
+            {
+                cerr << "du: " << arg << " needs a number" << endl;
+                return 2;
+            }
+            value = args[++i];
+        }
+        else if (arg.compare(0, 12, "--max-depth=") == 0 || arg.compare(0, 6, "--top=") == 0)
+            value = arg.substr(arg.find('=') + 1);
+
+        if (arg == "-s")
+            maxDepth = 0;
+        else if (arg == "-x")
+            sameFilesystem = true;
+        else if (arg == "-h")
+            human = true;
+        else if (arg == "--apparent-size")
+            apparent = true;
+        else if (!value.empty() || needsValue)
+        {
+            char *end = nullptr;
+            long number = strtol(value.c_str(), &end, 10);
+            if (value.empty() || *end != '\0' || number < 0)
+            {
+                cerr << "du: invalid number '" << value << "'" << endl;
+                return 2;
+            }
+            if (arg == "--top" || arg.compare(0, 6, "--top=") == 0)
+                top = (int)number;
+            else if (arg == "-j")
+                threads = (int)number;
+            else
+                maxDepth = (int)number;
+        }
+        else if (arg.size() > 1 && arg[0] == '-')
+        {
+            cerr << "du: unknown option '" << arg << "'" << endl;
+            return 2;
+        }
+        else
+            roots.push_back(arg);
+    }
+    if (roots.empty())
+        roots.push_back(".");
+
+    int status = 0;
+    mutex errorLock; // error messages come from several threads
+    vector<pair<string, DuTotals>> report;
+    for (string root : roots)
+    {
+        while (root.size() > 1 && root.back() == '/')
+            root.pop_back();
+        struct stat rootStat;
+        if (stat(root.c_str(), &rootStat) != 0)
+        {
+            cerr << "du: cannot access '" << root << "': " << strerror(errno) << endl;
+            status = 1;
+            continue;
+        }
+        if (!S_ISDIR(rootStat.st_mode))
+        {
+            // "du file" just reports the file, like GNU du
+            DuTotals file;
+            file.blocks = rootStat.st_blocks;
+            file.bytes = rootStat.st_size;
+            report.push_back({root, file});
+            continue;
+        }
+        size_t rootLength = (root == "/") ? 0 : root.size();
+
+        WalkOptions options;
+        options.threads = threads;
+        options.onError = [&](const string &path, int error)
+        {
+            lock_guard<mutex> guard(errorLock);
+            cerr << "du: cannot read directory '" << path << "': " << strerror(error) << endl;
+            status = 1;
+        };
+        int count = (threads > 0) ? threads : default_walk_threads();
+        vector<DuThread> perThread(count);
+        InodeShard *inodes = new InodeShard[INODE_SHARDS];
+        atomic<bool> interrupted{false};
+
+        bool stopped = walk_tree_parallel(root, options, [&](const WalkInfo &info)
+        {
+            bool isDir = S_ISDIR(info.st.st_mode);
+            if (isDir)
+            {
+                if (sameFilesystem && info.st.st_dev != rootStat.st_dev)
+                    return WALK_SKIP; // a mount point: not counted, not entered
+                if (take_interrupt()) // Ctrl+C
+                {
+                    interrupted = true;
+                    return WALK_STOP;
+                }
+            }
+            else if (info.st.st_nlink > 1 && !first_link(inodes, info.st.st_dev, info.st.st_ino))
+                return WALK_CONTINUE; // another name of a file already counted
+
+            // counted in the directory itself (for a directory listed on its own), or in
+            // the deepest listed directory above it
+            int depth = isDir ? info.depth : info.depth - 1;
+            if (maxDepth >= 0 && depth > maxDepth)
+                depth = maxDepth;
+            size_t length = ancestor_length(info.path, rootLength, depth);
+
+            DuThread &mine = perThread[info.thread];
+            if (mine.last == nullptr || mine.lastDir.size() != length || info.path.compare(0, length, mine.lastDir) != 0)
+            {
+                mine.lastDir.assign(info.path, 0, length);
+                mine.last = &mine.dirs[mine.lastDir];
+            }
+            mine.last->blocks += info.st.st_blocks;
+            mine.last->bytes += info.st.st_size;
+            return WALK_CONTINUE;
+        });
+        delete[] inodes;
+        if (stopped && interrupted)
+        {
+            cout << endl;
+            return 130;
+        }
+
+        // merge the threads, then add every directory to its parent: deepest first,
+        // so the sums move up level by level
+        unordered_map<string, DuTotals> dirs;
+        DuTotals &rootTotals = dirs[root];
+        rootTotals.blocks += rootStat.st_blocks;
+        rootTotals.bytes += rootStat.st_size;
+        for (DuThread &mine : perThread)
+        {
+            for (auto &dir : mine.dirs)
+            {
+                DuTotals &totals = dirs[dir.first];
+                totals.blocks += dir.second.blocks;
+                totals.bytes += dir.second.bytes;
+            }
+        }
+        vector<pair<string, DuTotals>> sorted(dirs.begin(), dirs.end());
+        sort(sorted.begin(), sorted.end(), [&](const pair<string, DuTotals> &a, const pair<string, DuTotals> &b)
+             { return depth_of(a.first, rootLength) > depth_of(b.first, rootLength); });
+        unordered_map<string, DuTotals> totals;
+        for (auto &dir : sorted)
+        {
+            DuTotals &sum = totals[dir.first];
+            sum.blocks += dir.second.blocks;
+            sum.bytes += dir.second.bytes;
+            if (dir.first != root)
+            {
+                // a directory's parent is always listed too (its depth is smaller)
+                DuTotals &parent = totals[dir.first.substr(0, dir.first.rfind('/') == 0 ? 1 : dir.first.rfind('/'))];
+                parent.blocks += sum.blocks;
+                parent.bytes += sum.bytes;
+            }
+        }
+        for (auto &dir : totals)
+            report.push_back(dir);
+    }
+
+    auto sizeOf = [&](const DuTotals &t)
+    { return apparent ? t.bytes : t.blocks * 512; };
+    if (top > 0)
+    {
+        // the biggest first
+        sort(report.begin(), report.end(), [&](const pair<string, DuTotals> &a, const pair<string, DuTotals> &b)
+             { return sizeOf(a.second) > sizeOf(b.second); });
+        if ((int)report.size() > top)
+            report.resize(top);
+    }
+    else
+    {
+        // like du: a directory comes after everything inside it. Sorting by the path with
+        // '/' as the smallest character and an end mark bigger than it does that.
+        auto key = [](const string &path)
+        {
+            string k = path;
+            replace(k.begin(), k.end(), '/', '\x01');
+            return k + '\x02';
+        };
+        sort(report.begin(), report.end(), [&](const pair<string, DuTotals> &a, const pair<string, DuTotals> &b)
+             { return key(a.first) < key(b.first); });
+    }
+
+    for (auto &dir : report)
+    {
+        long long bytes = sizeOf(dir.second);
+        if (human)
+            cout << human_size(bytes);
+        else
+            cout << (bytes + 1023) / 1024; // KiB, rounded up
+        cout << "\t" << dir.first << endl;
+    }
+    return status;
+}
@@ -0,0 +1,24 @@
+/*
+   du.h
+   Header file for the du builtin: disk usage of directory trees, walked with
+   several threads (walk_tree_parallel() from walk.h).
+*/
+
+#ifndef DU_H
+#define DU_H
+
+#include <string>
+#include <vector>
+
+// "du [options] [dir...]". Returns the exit status (1 if something could not be read).
+//   -s                 only the total of each dir (same as --max-depth=0)
+//   -d N, --max-depth=N  list directories down to N levels below the dir
+//   -x                 stay on the dir's filesystem (don't go into mount points)
+//   -h                 sizes like 1.5M instead of KiB
+//   --apparent-size    sum the file sizes instead of the disk blocks used
+//   --top N, --top=N   only the N biggest directories, largest first
+//   -j N               number of threads
+// Hard links are counted once, like the real du does.
+int du_command(const std::vector<std::string> &args);
+
+#endif
@@ -0,0 +1,539 @@
+/*
+eventloop.cpp: the interactive loop: epoll over stdin, a signalfd and a timerfd,
+with readline's callback interface reading the keystrokes.
+*/
+
+#include "eventloop.h"
+#include "parser.h"         // for heredoc_delimiters(), set_heredoc_bodies()
+#include "script.h"         // for parse_script()
+#include "io.h"             // for execute_line()
+#include "extras.h"         // for addHistory(), addHistoryMeta()
+#include "readline_shell.h" // for rl_setup_once(), rl_remember()
+#include "jobs.h"           // for collect_job_notices(), open_pidfd()
+#include "vars.h"           // for TMOUT
+#include "launch.h"         // for exit_code()
+#include <readline/readline.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <pthread.h>        // for pthread_atfork()
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>         // for PATH_MAX
+#include <time.h>
+#include <stdlib.h>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+static sigset_t shellSignals;  // the signals read from sigFd
+static sigset_t originalMask;  // the mask the shell started with, given back to children
+static int sigFd = -1;
+static int timerFd = -1;       // TMOUT: auto-logout after some idle time at the prompt
+static int epollFd = -1;
+
+extern pid_t foregroundPid; // the child wait_foreground() is waiting for (shown by pinfo)
+
+static string (*promptFunction)();
+static bool finished = false;  // set by Ctrl+D, "exit" and the auto-logout
+static int finalStatus = 0;    // returned by run_event_loop()
+
+// The command being typed. It may need more lines: here-document bodies, or the rest
+// of an unfinished "while ...; do" / "if ..." / "cmd &&".
+struct PendingInput
+{
+    bool active = false;
+    string text;               // all lines so far, joined with newlines
+    string historyText;        // the same as one line, for the history
+    vector<HeredocSpec> docs;  // here-documents whose bodies are still being read
+    string body;               // the body being read (for docs[0])
+    vector<string> heredocs;   // finished bodies, in order
+};
+
+static PendingInput pending;
+
+static void restore_child_signals()
+{
+    // runs in the child after every fork(): programs expect the normal signal mask
+    sigprocmask(SIG_SETMASK, &originalMask, nullptr);
+}
+
+void init_signals()
+{
+    sigemptyset(&shellSignals);
+    sigaddset(&shellSignals, SIGINT);
+    sigaddset(&shellSignals, SIGTSTP);
+    sigaddset(&shellSignals, SIGCHLD);
+    sigaddset(&shellSignals, SIGWINCH);
+    sigprocmask(SIG_BLOCK, &shellSignals, &originalMask);
+    pthread_atfork(nullptr, nullptr, restore_child_signals);
+
+    sigFd = signalfd(-1, &shellSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sigFd < 0)
+        perror("signalfd");
+}
+
+bool take_interrupt()
+{
+    sigset_t waiting;
+    if (sigpending(&waiting) != 0 || !sigismember(&waiting, SIGINT))
+        return false;
+    sigset_t only;
+    sigemptyset(&only);
+    sigaddset(&only, SIGINT);
+    struct timespec zero = {0, 0};
+    sigtimedwait(&only, nullptr, &zero); // consume it
+    return true;
+}
+
+bool wait_for_input(int fd)
+{
+    if (sigFd < 0)
+        return true; // no signalfd, so Ctrl+C is not blocked either
+    while (true)
+    {
+        struct pollfd fds[2] = {{fd, POLLIN, 0}, {sigFd, POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0 && errno != EINTR)
+            return true;
+        // the other signals queued meanwhile are stale by now, like in "wait"
+        struct signalfd_siginfo info;
+        bool interrupted = false;
+        while ((fds[1].revents & POLLIN) && read(sigFd, &info, sizeof(info)) == sizeof(info))
+        {
+            if (info.ssi_signo == SIGINT)
+                interrupted = true;
+        }
+        if (interrupted)
+            return false;
+        if (fds[0].revents != 0)
+            return true; // data, end of file or an error: read() will tell
+    }
+}
+
+int shell_signal_fd()
+{
+    return sigFd;
+}
+
+static long long now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+int wait_foreground(pid_t pid, const string &command, long long timeoutMs, bool *timedOut)
+{
+    if (timedOut != nullptr)
+        *timedOut = false;
+    foregroundPid = pid;
+    // the pidfd becomes readable when the child exits, and signals sent through it can't
+    // hit another process (the pid is ours until we reap it, but this keeps it that way)
+    int pidFd = open_pidfd(pid);
+    long long deadline = (timeoutMs >= 0) ? now_ms() + timeoutMs : -1;
+    int status = 0;
+    while (true)
+    {
+        bool canSleep = (sigFd >= 0 || pidFd >= 0);
+        pid_t done = waitpid(pid, &status, (canSleep || deadline >= 0 ? WNOHANG : 0) | WUNTRACED);
+        if (done == pid)
+            break;
+        if (done < 0 && errno != EINTR)
+        {
+            foregroundPid = -1;
+            if (pidFd >= 0)
+                close(pidFd);
+            return 1;
+        }
+        if (done < 0)
+            continue;
+
+        int wait = -1; // ms until the deadline, -1 = none
+        if (deadline >= 0)
+        {
+            long long left = deadline - now_ms();
+            if (left <= 0)
+            {
+                // the caller decides what happens to the child now (see timeout)
+                if (timedOut != nullptr)
+                    *timedOut = true;
+                foregroundPid = -1;
+                if (pidFd >= 0)
+                    close(pidFd);
+                return 0;
+            }
+            wait = (int)left;
+        }
+        if (!canSleep)
+            wait = (wait < 0 || wait > 10) ? 10 : wait; // no fd to sleep on: check again soon
+
+        // sleep until the child exits, a signal arrives (SIGCHLD when the child stops,
+        // or a key) or the deadline is reached
+        struct pollfd fds[2];
+        int count = 0;
+        if (pidFd >= 0)
+            fds[count++] = {pidFd, POLLIN, 0};
+        if (sigFd >= 0)
+            fds[count++] = {sigFd, POLLIN, 0};
+        poll(fds, count, wait);
+        struct signalfd_siginfo info;
+        while (sigFd >= 0 && read(sigFd, &info, sizeof(info)) == sizeof(info))
+        {
+            // Ctrl+Z: the terminal's SIGTSTP is discarded for our (orphaned) process
+            // group, so the child is stopped explicitly. Ctrl+C already reached the child.
+            if (info.ssi_signo == SIGTSTP)
+                send_signal(pid, pidFd, SIGSTOP);
+        }
+    }
+    foregroundPid = -1;
+    if (pidFd >= 0)
+        close(pidFd);
+
+    if (WIFSTOPPED(status))
+    {
+        // it becomes a job, reported again when it changes state
+        int job = add_job(pid, command, false);
+        cout << endl << "[" << job << "]+ Stopped\t\t" << command << endl;
+        return 128 + WSTOPSIG(status);
+    }
+    if (WIFSIGNALED(status) && WTERMSIG(status) == SIGINT)
+        cout << endl; // the ^C left the cursor in the middle of a line
+    return exit_code(status);
+}
+
+// Ctrl+C / Ctrl+Z typed while a command ran went to that command (it is in our process
+// group); the copies queued for the shell are stale by now.
+static void drop_stale_signals()
+{
+    sigset_t keys;
+    sigemptyset(&keys);
+    sigaddset(&keys, SIGINT);
+    sigaddset(&keys, SIGTSTP);
+    struct timespec zero = {0, 0};
+    while (sigtimedwait(&keys, nullptr, &zero) > 0)
+        ;
+}
+
+// (Re)starts the TMOUT countdown; TMOUT unset or 0 disables it
+static void arm_idle_timer()
+{
+    if (timerFd < 0)
+        return;
+    struct itimerspec spec = {{0, 0}, {0, 0}};
+    int seconds = atoi(get_variable("TMOUT").c_str());
+    if (seconds > 0)
+        spec.it_value.tv_sec = seconds;
+    timerfd_settime(timerFd, 0, &spec, nullptr);
+}
+
+static void on_line(char *raw);
+
+// Shows the prompt: the normal one, or "> " while a command needs more lines
+static void show_prompt()
+{
+    string prompt = pending.active ? "> " : promptFunction();
+    rl_callback_handler_install(prompt.c_str(), on_line);
+    arm_idle_timer();
+}
+
+// Prints messages (job notices, ...) above the line the user is typing, then redraws it
+static void print_above_prompt(const vector<string> &lines)
+{
+    if (lines.empty())
+        return;
+    rl_clear_visible_line();
+    for (const string &line : lines)
+        cout << line << endl;
+    rl_on_new_line();
+    rl_redisplay();
+}
+
+// For the history, the lines of a multi-line command are joined into one line:
+// with "; " normally, but after "do", "then", "|" etc. a space is enough.
+static bool joins_with_space(const string &text)
+{
+    vector<string> words = lex_script(text);
+    if (words.empty())
+        return true;
+    const string &last = words.back();
+    return last == "do" || last == "then" || last == "else" || last == "{" || last == "\n" ||
+           last == ";" || last == "|" || last == "&&" || last == "||";
+}
+
+// Runs a complete command and empties 'input'. With 'remember' the command is saved in
+// the history (a multi-line command as one line), with its duration and status.
+static void run_command(PendingInput &input, bool remember)
+{
+    if (remember)
+        addHistory(input.historyText);
+    set_heredoc_bodies(input.heredocs); // parse_pipeline() picks them up in order
+    string text = input.text;
+    string historyText = input.historyText;
+    input = PendingInput();
+
+    // run the commands (written in io.cpp), timed for the history metadata
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == nullptr)
+        cwd[0] = '\0';
+    struct timespec wall, started, ended;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    execute_line(text);
+    clock_gettime(CLOCK_MONOTONIC, &ended);
+    long long durationMs = (ended.tv_sec - started.tv_sec) * 1000LL + (ended.tv_nsec - started.tv_nsec) / 1000000;
+    if (remember)
+        addHistoryMeta(historyText, wall.tv_sec * 1000LL + wall.tv_nsec / 1000000, durationMs, lastStatus, cwd);
+
+    // report background jobs which finished while the command ran
+    reap_jobs();
+}
+
+// Runs the finished command with the terminal back in normal mode
+static void run_pending()
+{
+    rl_callback_handler_remove();
+    rl_remember(pending.historyText); // for the arrow keys
+    run_command(pending, true);
+    drop_stale_signals();
+
+    int status;
+    if (take_exit_request(status))
+    {
+        cout << "Goodbye!" << endl;
+        finalStatus = status;
+        finished = true;
+    }
+}
+
+// Takes one line typed by the user (or of a script). Returns true once the command is complete.
+static bool add_line(PendingInput &input, const string &line)
+{
+    if (!input.docs.empty())
+    {
+        // a line of a here-document body
+        string bodyLine = line;
+        if (input.docs[0].stripTabs) // "<<-" removes leading tabs
+        {
+            size_t start = bodyLine.find_first_not_of('\t');
+            bodyLine = (start == string::npos) ? "" : bodyLine.substr(start);
+        }
+        if (bodyLine == input.docs[0].delimiter)
+        {
+            input.heredocs.push_back(input.body);
+            input.body.clear();
+            input.docs.erase(input.docs.begin());
+        }
+        else
+        {
+            input.body += bodyLine + "\n";
+        }
+    }
+    else
+    {
+        if (!input.active)
+        {
+            // if the user enters blank string, then dont do anything, just display the prompt again
+            if (line.find_first_not_of(" \t") == string::npos)
+                return false;
+            input.active = true;
+            input.text = input.historyText = line;
+        }
+        else
+        {
+            input.historyText += joins_with_space(input.text) ? " " + line : "; " + line;
+            input.text += "\n" + line;
+        }
+        // here-documents: their bodies are the lines typed after this line
+        input.docs = heredoc_delimiters(line);
+    }
+    if (!input.docs.empty())
+        return false;
+
+    // "while true; do" and the like continue on the next lines until the construct is closed
+    shared_ptr<Node> tree;
+    string error;
+    set_heredoc_bodies(input.heredocs);
+    return parse_script(input.text, tree, error) != PARSE_INCOMPLETE;
+}
+
+// A here-document still open at the end of the input ends there
+static void close_heredocs(PendingInput &input)
+{
+    if (!input.docs.empty())
+        cerr << "warning: here-document delimited by end-of-file (wanted '"
+             << input.docs[0].delimiter << "')" << endl;
+    while (!input.docs.empty())
+    {
+        input.heredocs.push_back(input.body);
+        input.body.clear();
+        input.docs.erase(input.docs.begin());
+    }
+}
+
+int run_text(const string &text, bool remember)
+{
+    PendingInput input;
+    size_t start = 0;
+    while (start < text.size())
+    {
+        size_t end = text.find('\n', start);
+        if (end == string::npos)
+            end = text.size();
+        bool complete = add_line(input, text.substr(start, end - start));
+        start = end + 1;
+        if (complete)
+        {
+            run_command(input, remember);
+            int status;
+            if (take_exit_request(status))
+                return status;
+        }
+    }
+    if (input.active)
+    {
+        // like Ctrl+D in the middle of a command: run what we have, execute_line() reports it
+        close_heredocs(input);
+        run_command(input, remember);
+        int status;
+        if (take_exit_request(status))
+            return status;
+    }
+    return -1;
+}
+
+// readline calls this with every finished line, or with NULL for Ctrl+D
+static void on_line(char *raw)
+{
+    if (raw == nullptr)
+    {
+        if (pending.active)
+        {
+            // Ctrl+D in the middle of a command: run what we have, execute_line() reports it
+            close_heredocs(pending);
+            run_pending();
+            if (!finished)
+                show_prompt();
+            return;
+        }
+        rl_callback_handler_remove();
+        cout << "Exiting the shell.." << endl;
+        finished = true; // exit the shell loop on Ctrl+D
+        return;
+    }
+    string line(raw);
+    free(raw);
+
+    if (add_line(pending, line))
+        run_pending();
+    if (!finished)
+        show_prompt();
+}
+
+// Reads every queued signal from the signalfd
+static void handle_signals()
+{
+    struct signalfd_siginfo info;
+    vector<string> notices;
+    while (read(sigFd, &info, sizeof(info)) == sizeof(info))
+    {
+        switch (info.ssi_signo)
+        {
+        case SIGINT:
+            // Ctrl+C at the prompt: throw away what was typed and start a new prompt
+            pending = PendingInput();
+            rl_callback_sigcleanup();
+            rl_replace_line("", 0);
+            rl_crlf();
+            rl_callback_handler_remove();
+            show_prompt();
+            break;
+        case SIGTSTP:
+            break; // Ctrl+Z at the prompt: there is nothing to stop
+        case SIGCHLD:
+        {
+            // several children may have exited for one SIGCHLD, collect_job_notices() checks all
+            vector<string> more = collect_job_notices();
+            notices.insert(notices.end(), more.begin(), more.end());
+            break;
+        }
+        case SIGWINCH:
+            rl_resize_terminal();
+            break;
+        }
+    }
+    print_above_prompt(notices);
+}
+
+int run_event_loop(string (*make_prompt)())
+{
+    promptFunction = make_prompt;
+    rl_setup_once();
+    rl_catch_signals = 0; // signals come from the signalfd, readline must not install handlers
+    rl_catch_sigwinch = 0;
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = STDIN_FILENO;
+    // epoll can't watch a regular file ("./shell < script"), but reading one never blocks
+    bool stdinPollable = (epoll_ctl(epollFd, EPOLL_CTL_ADD, STDIN_FILENO, &ev) == 0);
+    ev.data.fd = sigFd;
+    if (sigFd >= 0)
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, sigFd, &ev);
+    ev.data.fd = timerFd;
+    if (timerFd >= 0)
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &ev);
+
+    show_prompt();
+    while (!finished)
+    {
+        if (!stdinPollable)
+        {
+            rl_callback_read_char();
+            if (!finished && sigFd >= 0)
+                handle_signals();
+            continue;
+        }
+
+        struct epoll_event events[4];
+        int n = epoll_wait(epollFd, events, 4, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n && !finished; i++)
+        {
+            int fd = events[i].data.fd;
+            if (fd == STDIN_FILENO)
+            {
+                rl_callback_read_char(); // may call on_line(), which runs the command
+                arm_idle_timer();
+            }
+            else if (fd == sigFd)
+            {
+                handle_signals();
+            }
+            else if (fd == timerFd)
+            {
+                uint64_t expirations;
+                if (read(timerFd, &expirations, sizeof(expirations)) > 0)
+                {
+                    rl_callback_handler_remove();
+                    cout << endl << "timed out waiting for input: auto-logout" << endl;
+                    finished = true;
+                }
+            }
+        }
+    }
+    rl_callback_handler_remove();
+    return finalStatus;
+}
@@ -0,0 +1,48 @@
+/*
+   eventloop.h
+   Header file for the interactive main loop. The shell waits in epoll_wait() for
+   keystrokes (fed to readline's callback interface), for signals (read from a
+   signalfd instead of running signal handlers) and for timers.
+*/
+
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <string>
+#include <sys/types.h> // for pid_t
+
+// Blocks SIGINT, SIGTSTP, SIGCHLD and SIGWINCH so they are only delivered through a
+// signalfd. Every fork()ed child gets the original signal mask back automatically.
+void init_signals();
+
+// Runs the prompt loop until Ctrl+D, "exit" or the TMOUT auto-logout.
+// make_prompt() is called for every new prompt. Returns the status for the shell to exit with.
+int run_event_loop(std::string (*make_prompt)());
+
+// Runs the lines of 'text' like typed lines, without readline: here-document bodies and
+// unfinished if / while / for continue on the next lines, and each complete command is
+// run as soon as it is complete. With 'remember' the commands go into the history file.
+// Returns the status "exit" asked for, or -1 if the text ended without "exit".
+int run_text(const std::string &text, bool remember);
+
+// Waits for a foreground child and returns its exit status for $?. While waiting the
+// shell sleeps on the child's pidfd and the signalfd: Ctrl+Z stops the child, which then
+// becomes a job ("[n]+ Stopped"). 'command' names the job.
+// With timeoutMs >= 0 it gives up after that long: *timedOut is set and the child is
+// left running (and not reaped), so the caller can signal it and wait again.
+int wait_foreground(pid_t pid, const std::string &command, long long timeoutMs = -1, bool *timedOut = nullptr);
+
+// The signalfd the shell's signals arrive on (-1 before init_signals()). Builtins which
+// sleep (e.g. "wait") poll it too, to notice Ctrl+C.
+int shell_signal_fd();
+
+// true if Ctrl+C was pressed while the shell itself was busy (e.g. in a loop of
+// builtins); the signal is consumed, so it is reported only once
+bool take_interrupt();
+
+// Sleeps until fd has something to read (or end of file) or Ctrl+C is pressed.
+// Returns false for Ctrl+C. Builtins which read a pipe or a device inside the shell
+// call it first, because a read() that blocks could not be interrupted otherwise.
+bool wait_for_input(int fd);
+
+#endif
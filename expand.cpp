@@ -0,0 +1,502 @@
+/*
+expand.cpp: word expansion - brace expansion, variables, process substitution, command substitution,
+word splitting, filename generation (globbing) and quote removal.
+*/
+
+#include "expand.h"
+#include "parser.h"   // for skip_group()
+#include "redirect.h" // for parse_redirection()
+#include "io.h"       // for execute_line()
+#include "jobs.h"     // process substitutions are reaped as quiet jobs
+#include "builtins.h" // builtins inside $(...) run without fork()
+#include "vars.h"     // for $VAR
+#include "glob.h"     // for *.txt and {a,b}
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h> // for memfd_create()
+#include <sys/wait.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+// One running process substitution: the shell's end of its pipe and its pid
+struct ProcSub
+{
+    int fd;
+    pid_t pid;
+};
+
+static vector<ProcSub> procsubs; // process substitutions of the current command
+
+// true if the whole word is "<(...)" or ">(...)"
+static bool is_procsub(const string &word)
+{
+    return word.size() >= 3 && (word[0] == '<' || word[0] == '>') && word[1] == '(' &&
+           skip_group(word, 1) == word.size() && word.back() == ')';
+}
+
+// Starts the command of "<(cmd)" or ">(cmd)" connected to a pipe, and returns
+// the /dev/fd/N path through which the outer command can open the other end.
+static string start_procsub(const string &word)
+{
+    bool reading = (word[0] == '<'); // <(cmd): the outer command reads what cmd prints
+    string inner = word.substr(2, word.size() - 3);
+
+    // close-on-exec, so only the command which names /dev/fd/N keeps it (see keep_procsub_fds())
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0)
+    {
+        perror("process substitution: pipe");
+        return word;
+    }
+
+    // flush first, otherwise the child prints our buffered output a second time
+    cout.flush();
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid == 0) // CHILD: runs 'inner' like any other command line, with the pipe as stdout / stdin
+    {
+        dup2(reading ? fds[1] : fds[0], reading ? STDOUT_FILENO : STDIN_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        // the other substitutions' pipes must not be held open by this process
+        for (const ProcSub &p : procsubs)
+            close(p.fd);
+        execute_line(inner);
+        exit(0);
+    }
+
+    close(reading ? fds[1] : fds[0]); // the child's end
+    int keep = reading ? fds[0] : fds[1];
+    if (pid < 0)
+    {
+        perror("process substitution: fork");
+        close(keep);
+        return word;
+    }
+
+    procsubs.push_back({keep, pid});
+    add_job(pid, inner, true);
+    return "/dev/fd/" + to_string(keep);
+}
+
+static const size_t CAPTURE_CHUNK = 64 * 1024; // bytes asked for per read() of $(...) output
+
+// Reads everything from fd into 'out', growing the buffer geometrically
+static void read_all(int fd, string &out)
+{
+    size_t len = out.size();
+    while (true)
+    {
+        if (out.size() < len + CAPTURE_CHUNK)
+            out.resize(max(out.size() * 2, len + CAPTURE_CHUNK));
+        ssize_t n = read(fd, &out[len], CAPTURE_CHUNK);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        len += n;
+    }
+    out.resize(len);
+}
+
+// Runs a command substitution whose command is a single builtin (e.g. $(pwd)) inside
+// the shell: stdout is pointed at a memfd while the builtin runs, so there is no fork().
+// Returns false if the command needs a child process.
+static bool capture_builtin(const string &cmd, string &out)
+{
+    // only one simple command, without pipes, redirections or &
+    if (splitByDelimiter(cmd, ';').size() != 1 || splitByDelimiter(cmd, '|').size() != 1)
+        return false;
+    vector<string> words = tokenize(cmd);
+    if (words.empty() || words[0].find_first_of("$`") != string::npos)
+        return false;
+    for (const string &w : words)
+    {
+        vector<Redirection> redirections;
+        bool usedFollowing;
+        string error;
+        if (w[0] == '<' || w[0] == '>' || w == "&" || parse_redirection(w, nullptr, usedFollowing, redirections, error))
+            return false; // "2>&1", "&> f": the child shell applies them
+    }
+    // Only builtins which just print something run here. Anything that changes the shell
+    // (cd, export, unset, break, kill, policy, ...) must only affect the substitution,
+    // so it runs in a child shell like any other command.
+    static const vector<string> sideEffectFree = {
+        "pwd", "echo", "printf", "test", "[", "true", "false", ":", "history"
+    };
+    string name = expand_words({words[0]})[0];
+    if (find(sideEffectFree.begin(), sideEffectFree.end(), name) == sideEffectFree.end())
+        return false;
+
+    // a memfd (unlike a pipe) never fills up, so the builtin can't block on its own output
+    int fd = memfd_create("cmdsubst", MFD_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    cout.flush(); // whatever the shell printed so far belongs to the terminal
+    fflush(stdout);
+    int saved = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+    dup2(fd, STDOUT_FILENO);
+
+    vector<string> args = expand_words(words);
+    if (!args.empty())
+        handleBuiltinCommands(args);
+
+    cout.flush();
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO); // the shell's own stdout is back
+    close(saved);
+
+    lseek(fd, 0, SEEK_SET);
+    read_all(fd, out);
+    close(fd);
+    return true;
+}
+
+// Runs the command of $(cmd) / `cmd` and returns what it printed,
+// without the trailing newlines
+static string command_output(const string &cmd)
+{
+    string out;
+    if (!capture_builtin(cmd, out))
+    {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) < 0)
+        {
+            perror("command substitution: pipe");
+            return "";
+        }
+        // a bigger pipe means fewer switches between the child writing and us reading
+        fcntl(fds[0], F_SETPIPE_SZ, 1 << 20);
+
+        cout.flush();
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) // CHILD: a copy of the shell runs the command with stdout = pipe
+        {
+            dup2(fds[1], STDOUT_FILENO);
+            close(fds[0]);
+            close(fds[1]);
+            execute_line(cmd);
+            exit(0);
+        }
+        close(fds[1]);
+        if (pid < 0)
+            perror("command substitution: fork");
+        else
+            read_all(fds[0], out);
+        close(fds[0]);
+        if (pid > 0)
+            waitpid(pid, NULL, 0);
+    }
+
+    while (!out.empty() && out.back() == '\n')
+        out.pop_back();
+    return out;
+}
+
+// Builds the fields of one word. 'current' is the field being built and 'open' is true
+// once it exists (even if it is empty, e.g. for ""). 'pattern' is the same text with the
+// quoted glob characters escaped, and 'glob' is true once an unquoted * ? or [ was added.
+struct FieldBuilder
+{
+    vector<string> &fields;
+    bool globbing; // false for X=value, which is never matched against filenames
+    string current;
+    string pattern;
+    bool open = false;
+    bool glob = false;
+
+    FieldBuilder(vector<string> &f, bool g) : fields(f), globbing(g) {}
+
+    void add(const string &text, bool quoted)
+    {
+        current += text;
+        open = true;
+        for (char c : text)
+        {
+            if (quoted && strchr("\\*?[]", c))
+                pattern += '\\';
+            else if (!quoted && (c == '*' || c == '?' || c == '['))
+                glob = globbing;
+            pattern += c;
+        }
+    }
+
+    // unquoted substitution results are split into several fields at whitespace
+    void add_split(const string &text)
+    {
+        for (char c : text)
+        {
+            if (c == ' ' || c == '\t' || c == '\n')
+                finish();
+            else
+                add(string(1, c), false);
+        }
+    }
+
+    // a field with glob characters becomes the matching filenames, or stays as it is
+    // if nothing matches
+    void finish()
+    {
+        vector<string> matches;
+        if (glob && has_glob_chars(pattern))
+            matches = glob_expand(pattern);
+        if (!matches.empty())
+            fields.insert(fields.end(), matches.begin(), matches.end());
+        else if (open)
+            fields.push_back(current);
+        current.clear();
+        pattern.clear();
+        open = false;
+        glob = false;
+    }
+};
+
+// The command inside `...`, in which \` stands for a backquote and \\ for a backslash
+static string backquote_command(const string &word, size_t start, size_t end)
+{
+    string cmd;
+    for (size_t i = start; i < end; i++)
+    {
+        if (word[i] == '\\' && i + 1 < end && (word[i + 1] == '`' || word[i + 1] == '\\'))
+            i++;
+        cmd += word[i];
+    }
+    return cmd;
+}
+
+// Expands a '$' expression starting at word[i]:
+//   $(cmd)           -> output of cmd
+//   $NAME, ${NAME}   -> value of the variable ("" if it is not set)
+//   $$               -> pid of the shell
+//   $?               -> exit status of the last command
+//   $1..$9, $#, $@   -> arguments of the running function, their count, all of them
+// On success 'i' is moved to the last character of the expression.
+// Returns false if this '$' is just a dollar sign (e.g. "costs 5$").
+static bool expand_dollar(const string &word, size_t &i, string &value)
+{
+    if (i + 1 >= word.size())
+        return false;
+    char next = word[i + 1];
+    if (next == '(')
+    {
+        size_t end = skip_group(word, i + 1);
+        value = command_output(word.substr(i + 2, end - i - 3));
+        i = end - 1;
+        return true;
+    }
+    if (next == '{')
+    {
+        size_t end = word.find('}', i + 2);
+        if (end == string::npos || !is_valid_name(word.substr(i + 2, end - i - 2)))
+            return false;
+        value = get_variable(word.substr(i + 2, end - i - 2));
+        i = end;
+        return true;
+    }
+    if (next == '$')
+    {
+        value = to_string(getpid());
+        i++;
+        return true;
+    }
+    if (next == '?')
+    {
+        value = to_string(lastStatus);
+        i++;
+        return true;
+    }
+    const vector<string> &params = positional_args();
+    if (next == '#')
+    {
+        value = to_string(params.size());
+        i++;
+        return true;
+    }
+    if (isdigit((unsigned char)next))
+    {
+        size_t n = next - '0';
+        value = (n == 0) ? "shell" : (n <= params.size() ? params[n - 1] : "");
+        i++;
+        return true;
+    }
+    if (next == '@' || next == '*')
+    {
+        value.clear();
+        for (size_t k = 0; k < params.size(); k++)
+            value += (k > 0 ? " " : "") + params[k];
+        i++;
+        return true;
+    }
+    if (isalpha((unsigned char)next) || next == '_')
+    {
+        size_t end = i + 1;
+        while (end < word.size() && (isalnum((unsigned char)word[end]) || word[end] == '_'))
+            end++;
+        value = get_variable(word.substr(i + 1, end - i - 1));
+        i = end - 1;
+        return true;
+    }
+    return false;
+}
+
+// Expands one word into zero or more fields:
+//   'text'  -> everything literal
+//   "text"  -> literal, except that \" \\ \$ \` stand for the escaped character and
+//              $VAR / $(cmd) / `cmd` are replaced by their value (not split)
+//   $VAR / $(cmd) / `cmd` outside quotes -> their value, split into fields at whitespace
+//                                           (unless split is false, as for X=$VAR)
+//   \c      -> c
+//   *.txt, file?, [ab]*, **/x -> the matching filenames (quoted glob characters are literal)
+static void expand_word(const string &word, vector<string> &fields, bool split)
+{
+    FieldBuilder fb(fields, split);
+    for (size_t i = 0; i < word.size(); i++)
+    {
+        char c = word[i];
+        string value;
+        if (c == '\\' && i + 1 < word.size())
+        {
+            fb.add(string(1, word[++i]), true);
+        }
+        else if (c == '\'')
+        {
+            size_t end = word.find('\'', i + 1);
+            if (end == string::npos)
+                end = word.size();
+            fb.add(word.substr(i + 1, end - i - 1), true);
+            i = end;
+        }
+        else if (c == '"')
+        {
+            string text;
+            for (i++; i < word.size() && word[i] != '"'; i++)
+            {
+                if (word[i] == '$' && expand_dollar(word, i, value))
+                {
+                    text += value;
+                    continue;
+                }
+                if (word[i] == '`')
+                {
+                    size_t end = skip_group(word, i);
+                    text += command_output(backquote_command(word, i + 1, end - 1));
+                    i = end - 1;
+                    continue;
+                }
+                if (word[i] == '\\' && i + 1 < word.size() && strchr("\"\\$`", word[i + 1]))
+                    i++;
+                text += word[i];
+            }
+            fb.add(text, true);
+        }
+        else if (c == '$' && expand_dollar(word, i, value))
+        {
+            if (split)
+                fb.add_split(value);
+            else
+                fb.add(value, true);
+        }
+        else if (c == '`')
+        {
+            size_t end = skip_group(word, i);
+            value = command_output(backquote_command(word, i + 1, end - 1));
+            if (split)
+                fb.add_split(value);
+            else
+                fb.add(value, true);
+            i = end - 1;
+        }
+        else
+        {
+            fb.add(string(1, c), false);
+        }
+    }
+    fb.finish();
+}
+
+string expand_heredoc(const string &body)
+{
+    string text, value;
+    for (size_t i = 0; i < body.size(); i++)
+    {
+        if (body[i] == '$' && expand_dollar(body, i, value))
+        {
+            text += value;
+            continue;
+        }
+        if (body[i] == '`')
+        {
+            size_t end = skip_group(body, i);
+            text += command_output(backquote_command(body, i + 1, end - 1));
+            i = end - 1;
+            continue;
+        }
+        if (body[i] == '\\' && i + 1 < body.size() && strchr("\\$`\n", body[i + 1]) != nullptr)
+        {
+            if (body[++i] == '\n')
+                continue; // the line goes on in the next one
+        }
+        text += body[i];
+    }
+    return text;
+}
+
+// true if the word as typed is "NAME=..." (the name itself not quoted)
+static bool is_assignment_word(const string &word)
+{
+    size_t eq = word.find('=');
+    return eq != string::npos && is_valid_name(word.substr(0, eq));
+}
+
+vector<string> expand_words(const vector<string> &words)
+{
+    vector<string> result;
+    bool prefix = true; // still in the leading NAME=value words of the command
+    for (const string &word : words)
+    {
+        if (prefix && is_assignment_word(word))
+        {
+            expand_word(word, result, false); // X=$(cmd) keeps the whole output in X
+            continue;
+        }
+        prefix = false;
+        if (is_procsub(word))
+            result.push_back(start_procsub(word));
+        else
+        {
+            for (const string &w : brace_expand(word))
+                expand_word(w, result, true);
+        }
+    }
+    return result;
+}
+
+void keep_procsub_fds(char *const argv[])
+{
+    for (int i = 0; argv[i] != nullptr; i++)
+    {
+        if (strncmp(argv[i], "/dev/fd/", 8) != 0)
+            continue;
+        int fd = atoi(argv[i] + 8);
+        for (const ProcSub &p : procsubs)
+        {
+            if (p.fd == fd)
+                fcntl(fd, F_SETFD, 0); // clear FD_CLOEXEC
+        }
+    }
+}
+
+void close_procsubs()
+{
+    for (const ProcSub &p : procsubs)
+        close(p.fd);
+    procsubs.clear();
+}
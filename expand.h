@@ -0,0 +1,39 @@
+/*
+   expand.h
+   Header file for word expansion: turns the words typed by the user into the
+   final arguments of a command (braces, variables, process and command substitution,
+   globbing, quote removal).
+*/
+
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include <string>
+#include <vector>
+
+// Expands the words of one command, as returned by tokenize():
+//   $VAR, ${VAR} -> the value of the variable; outside of double quotes it is
+//                   split into several words at whitespace
+//   <(cmd)  -> /dev/fd/N, a pipe carrying the output of cmd
+//   >(cmd)  -> /dev/fd/N, a pipe feeding the input of cmd
+//   $(cmd), `cmd` -> the output of cmd without trailing newlines; outside of
+//                    double quotes it is split into several words at whitespace
+//   {a,b}, {1..5} -> one word per alternative ("f.{c,h}" -> f.c f.h)
+//   *, ?, [...], ** -> the matching filenames, sorted (the word stays as it is if nothing matches)
+//   'text', "text", \c -> the text without the quotes / backslash
+std::vector<std::string> expand_words(const std::vector<std::string> &words);
+
+// Expands the body of a here-document whose delimiter was not quoted: $VAR, ${VAR},
+// $(cmd) and `cmd` are replaced (not split, no globbing), \$ \` \\ stand for the
+// character, and a backslash before a newline joins the two lines. Quotes stay as they are.
+std::string expand_heredoc(const std::string &body);
+
+// Called in a child right before exec: keeps the process substitution pipes named in argv
+// open across exec. All other process substitution pipes are close-on-exec.
+void keep_procsub_fds(char *const argv[]);
+
+// Called after the command has finished: the shell closes its ends of the
+// process substitution pipes (the processes themselves are reaped by reap_jobs())
+void close_procsubs();
+
+#endif
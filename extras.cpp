@@ -1,4 +1,5 @@
 #include "extras.h"
+#include "metrics.h"   // for counting history writes
 #include <iostream>    // for input/output (cout, cin)
 #include <fstream>     // for file handling (ifstream, ofstream)
 #include <string>      // for using string class
@@ -11,10 +12,15 @@
 #include <cstring>     // for C string functions like strcmp, strcpy
 #include <signal.h>    // for signal handling
 #include <sstream>     // for stringstream
+#include <fcntl.h>     // for open() of the history metadata file
+#include <time.h>      // for localtime_r(), strftime()
+#include <map>         // for counting commands in history --stats
+#include <algorithm>   // for sort()
 using namespace std;
 
 extern pid_t foregroundPid; // global variable to track current foreground process
 extern string shellHome;    // global variable to store shell's home directory
+extern string shellHistoryFile; // set by the embedding program, empty for the default
 
 void pinfo(pid_t pid)
 {
@@ -120,90 +126,21 @@ void pinfo(pid_t pid)
 }
 
 // This function checks if a file/folder exists in current directory or subdirectories.
-bool searchFile(string basePath, string target)
+// The walk (written in walk.cpp) goes level by level, so a match near the top is found first.
+bool searchFile(string basePath, string target, WalkBackend backend)
 {
-    DIR *dir = opendir(basePath.c_str());
-    if (!dir)
-        return false;
-
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL)
-    {
-        string name = entry->d_name;
-
-        // skip "." and ".." entries
-        if (name == "." || name == "..")
-            continue;
-
-        // if the name matches the target, we found it
-        if (name == target)
-        {
-            closedir(dir);
-            return true;
-        }
-
-        // prepare full path of this entry
-        string newPath = basePath + "/" + name;
-
-        // check if this entry is itself a directory
-        struct stat st;
-        if (stat(newPath.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
-        {
-            // recursive call to search inside this folder
-            if (searchFile(newPath, target))
-            {
-                closedir(dir);
-                return true;
-            }
-        }
-    }
-    closedir(dir);
-    return false;
-}
-
-//  send signals to foreground processes when they exist
-
-// Handler for Ctrl+C (SIGINT)
-void handle_sigint(int sig)
-{
-    (void)sig; // silence unused parameter warning
-
-    //  If there's a foreground process, send SIGINT to it
-    if (foregroundPid != -1)
-    {
-        cout << endl; // New line for clean output
-        kill(foregroundPid, SIGINT);
-        cout << "Process " << foregroundPid << " interrupted by SIGINT" << endl;
-    }
-    else
-    {
-        // No foreground process, just show prompt again
-        cout << endl;
-    }
-}
-
-// Handler for Ctrl+Z (SIGTSTP)
-void handle_sigtstp(int sig)
-{
-    (void)sig; // silence unused parameter warning
-
-    // If there's a foreground process, send SIGTSTP to it
-    if (foregroundPid != -1)
-    {
-        cout << endl; // New line for clean output
-        kill(foregroundPid, SIGTSTP);
-        cout << "[1]+ Stopped    (Process " << foregroundPid << ")" << endl;
-    }
-    else
-    {
-        // No foreground process, just show prompt again
-        cout << endl;
-    }
+    return walk_tree(basePath, backend, [&](const WalkEntry &entry)
+                     {
+                         // if the name matches the target, we found it (and stop the walk)
+                         return entry.name != target;
+                     });
 }
 
 // History file path - using environment HOME variable
 string getHistoryFilePath()
 {
+    if (!shellHistoryFile.empty())
+        return shellHistoryFile;
     const char *home = getenv("HOME");
     if (home)
     {
@@ -257,6 +194,7 @@ void addHistory(string cmd)
     hist.push_back(cmd); // add the latest command
 
     saveHistory(hist); // write exactly 20 or lesser commands back to file
+    count_stat(STAT_HISTORY_WRITES);
 }
 
 // Show history (ny default, show only the last 10 commands)
@@ -270,4 +208,194 @@ void showHistory(int n)
     {
         cout << hist[i] << endl;
     }
-}
\ No newline at end of file
+}
+
+// History metadata file, next to the history file
+static string getHistoryMetaPath()
+{
+    return getHistoryFilePath() + ".tsv";
+}
+
+// Tabs and newlines would break the TSV line, so they are written as \t and \n
+static string escapeField(const string &text)
+{
+    string out;
+    for (char c : text)
+    {
+        if (c == '\\')
+            out += "\\\\";
+        else if (c == '\t')
+            out += "\\t";
+        else if (c == '\n')
+            out += "\\n";
+        else
+            out += c;
+    }
+    return out;
+}
+
+static string unescapeField(const string &text)
+{
+    string out;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] == '\\' && i + 1 < text.size())
+        {
+            i++;
+            out += (text[i] == 't') ? '\t' : (text[i] == 'n') ? '\n' : text[i];
+        }
+        else
+            out += text[i];
+    }
+    return out;
+}
+
+// Add one line: start (ms since 1970) <TAB> duration (ms) <TAB> exit status <TAB> cwd <TAB> command
+void addHistoryMeta(const string &cmd, long long startMs, long long durationMs, int status, const string &cwd)
+{
+    string line = to_string(startMs) + "\t" + to_string(durationMs) + "\t" + to_string(status) + "\t" +
+                  escapeField(cwd) + "\t" + escapeField(cmd) + "\n";
+
+    // O_APPEND and a single write(): lines from several shells never mix, and the
+    // file is never read or rewritten here, however long it gets
+    int fd = open(getHistoryMetaPath().c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return;
+    if (write(fd, line.data(), line.size()) < 0)
+        perror("history");
+    close(fd);
+}
+
+// One command of the metadata file
+struct HistoryEntry
+{
+    long long startMs;
+    long long durationMs;
+    int status;
+    string cwd;
+    string cmd;
+};
+
+static string formatDuration(long long ms)
+{
+    char text[32];
+    if (ms < 1000)
+        snprintf(text, sizeof(text), "%lldms", ms);
+    else if (ms < 60000)
+        snprintf(text, sizeof(text), "%.2fs", ms / 1000.0);
+    else
+        snprintf(text, sizeof(text), "%lldm%02llds", ms / 60000, (ms / 1000) % 60);
+    return text;
+}
+
+static string formatTime(long long ms)
+{
+    time_t seconds = ms / 1000;
+    struct tm local;
+    localtime_r(&seconds, &local);
+    char text[32];
+    strftime(text, sizeof(text), "%Y-%m-%d %H:%M", &local);
+    return text;
+}
+
+// Show the slowest commands, the most used ones, and the ones which fail most often
+void showHistoryStats(int n)
+{
+    ifstream fin(getHistoryMetaPath());
+    vector<HistoryEntry> entries;
+    string line;
+    while (getline(fin, line))
+    {
+        // split into the 5 fields; a broken line is skipped
+        vector<string> fields;
+        size_t start = 0;
+        for (int k = 0; k < 4; k++)
+        {
+            size_t tab = line.find('\t', start);
+            if (tab == string::npos)
+                break;
+            fields.push_back(line.substr(start, tab - start));
+            start = tab + 1;
+        }
+        if (fields.size() != 4)
+            continue;
+        HistoryEntry entry;
+        entry.startMs = atoll(fields[0].c_str());
+        entry.durationMs = atoll(fields[1].c_str());
+        entry.status = atoi(fields[2].c_str());
+        entry.cwd = unescapeField(fields[3]);
+        entry.cmd = unescapeField(line.substr(start));
+        entries.push_back(entry);
+    }
+    if (entries.empty())
+    {
+        cout << "history: no command statistics yet" << endl;
+        return;
+    }
+
+    cout << entries.size() << " commands since " << formatTime(entries[0].startMs) << endl;
+
+    // slowest single runs
+    vector<const HistoryEntry *> slowest;
+    for (const HistoryEntry &entry : entries)
+        slowest.push_back(&entry);
+    sort(slowest.begin(), slowest.end(), [](const HistoryEntry *a, const HistoryEntry *b)
+         { return a->durationMs > b->durationMs; });
+    cout << endl << "slowest:" << endl;
+    for (int i = 0; i < n && i < (int)slowest.size(); i++)
+    {
+        cout << "  " << formatDuration(slowest[i]->durationMs) << "\t" << slowest[i]->cmd
+             << "  (" << formatTime(slowest[i]->startMs) << ", " << slowest[i]->cwd << ")" << endl;
+    }
+
+    // per command name (the first word): how often it ran and how often it failed
+    struct Counts
+    {
+        int runs = 0;
+        int failures = 0;
+        long long totalMs = 0;
+    };
+    map<string, Counts> perName;
+    for (const HistoryEntry &entry : entries)
+    {
+        stringstream words(entry.cmd);
+        string name;
+        words >> name;
+        Counts &counts = perName[name];
+        counts.runs++;
+        counts.totalMs += entry.durationMs;
+        if (entry.status != 0)
+            counts.failures++;
+    }
+    vector<pair<string, Counts>> names(perName.begin(), perName.end());
+
+    sort(names.begin(), names.end(), [](const pair<string, Counts> &a, const pair<string, Counts> &b)
+         { return a.second.runs > b.second.runs; });
+    cout << endl << "most frequent:" << endl;
+    for (int i = 0; i < n && i < (int)names.size(); i++)
+    {
+        cout << "  " << names[i].second.runs << "\t" << names[i].first
+             << "  (average " << formatDuration(names[i].second.totalMs / names[i].second.runs) << ")" << endl;
+    }
+
+    sort(names.begin(), names.end(), [](const pair<string, Counts> &a, const pair<string, Counts> &b)
+         { return a.second.failures > b.second.failures; });
+    cout << endl << "most failing:" << endl;
+    for (int i = 0; i < n && i < (int)names.size() && names[i].second.failures > 0; i++)
+    {
+        cout << "  " << names[i].second.failures << "/" << names[i].second.runs << " failed\t"
+             << names[i].first << endl;
+    }
+
+    // the last failures, with their exit status and where they ran
+    cout << endl << "recent failures:" << endl;
+    int shown = 0;
+    for (int i = (int)entries.size() - 1; i >= 0 && shown < n; i--)
+    {
+        if (entries[i].status == 0)
+            continue;
+        cout << "  " << formatTime(entries[i].startMs) << "  exit " << entries[i].status << "\t"
+             << entries[i].cmd << "  (" << entries[i].cwd << ")" << endl;
+        shown++;
+    }
+}
@@ -1,6 +1,6 @@
 /*
    extras.h
-   Header file for additional shell functions: pinfo, search, signals, history.
+   Header file for additional shell functions: pinfo, search, history.
 */
 
 #ifndef EXTRAS_H
@@ -9,6 +9,7 @@
 #include <string>
 #include <vector>
 #include <sys/types.h> // for pid_t
+#include "walk.h"      // for WalkBackend
 
 using namespace std;
 
@@ -16,11 +17,7 @@ using namespace std;
 void pinfo(pid_t pid);
 
 // Function for search command - recursively searches for files/directories 
-bool searchFile(std::string basePath, std::string target);
-
-// Signal handler functions for Ctrl+C and Ctrl+Z
-void handle_sigint(int sig);   // Handle SIGINT (Ctrl+C)
-void handle_sigtstp(int sig);  // Handle SIGTSTP (Ctrl+Z) 
+bool searchFile(std::string basePath, std::string target, WalkBackend backend = WALK_SYNC);
 
 // History related functions
 vector<string> loadHistory();          // Load command history from file
@@ -28,4 +25,9 @@ void saveHistory(vector<string> hist); // Save command history to file
 void addHistory(string cmd);           // Add new command to history
 void showHistory(int n = 10);          // Display last n commands (default 10)
 
+// Metadata of every command (start time, duration, exit status, cwd). It is kept in a
+// sidecar file next to the history, ".my_shell_history.tsv", which is only appended to.
+void addHistoryMeta(const string &cmd, long long startMs, long long durationMs, int status, const string &cwd);
+void showHistoryStats(int n = 5);      // history --stats: slowest, most frequent and most failing commands
+
 #endif
\ No newline at end of file
@@ -0,0 +1,426 @@
+/*
+fanout.cpp: "producer | (consumer 1) (consumer 2) ...", one stream to several commands.
+
+The producer writes into one pipe. A pump thread in the shell copies that pipe into
+one pipe per consumer:
+  - while every consumer keeps up, they move on together: tee() duplicates the data
+    into all consumer pipes but the last one and splice() moves it into the last
+    one, so the bytes never come up into user space
+  - a consumer whose pipe stays full for FULL_WAIT_MS gets its share queued in
+    memory instead, so the others keep going; once it falls MAX_LAG bytes behind,
+    the pump stops reading until it has caught up, which blocks the producer
+    (backpressure) and never lets the queue grow without limit
+  - a consumer which exits early ("(head -1)") is dropped, the others go on
+*/
+
+#include "fanout.h"
+#include "parser.h"   // for skip_group()
+#include "io.h"       // for execute_command(), execute_line()
+#include "redirect.h" // to point the producer's stdout at the pump
+#include "launch.h"   // for exit_code()
+#include "vars.h"     // for lastStatus
+#include <unistd.h>
+#include <fcntl.h>     // for pipe2(), tee(), splice()
+#include <sys/ioctl.h> // for FIONREAD
+#include <sys/wait.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h> // for pthread_sigmask()
+#include <errno.h>
+#include <string.h> // for memset()
+#include <time.h>
+#include <stdio.h>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+
+#define MAX_LAG (16 << 20)     // bytes a consumer may fall behind the fastest one
+#define COPY_CHUNK (256 << 10) // the most bytes moved in one step
+#define FULL_WAIT_MS 5         // how long the others wait for a consumer with a full pipe
+#define PIPE_SIZE (1 << 20)    // asked for each consumer pipe (the kernel may give less)
+
+// One consumer as the pump sees it
+struct FanoutTarget
+{
+    int fd;         // write end of the consumer's pipe, -1 once the consumer is gone
+    int capacity;   // size of that pipe in bytes
+    string pending; // bytes which didn't fit into its pipe yet
+};
+
+// Closes a consumer which stopped reading; the others are not affected
+static void drop_target(FanoutTarget &target)
+{
+    close(target.fd);
+    target.fd = -1;
+    target.pending.clear();
+}
+
+// Writes as much of the queued bytes as the consumer's pipe takes right now
+static void flush_target(FanoutTarget &target)
+{
+    while (target.fd != -1 && !target.pending.empty())
+    {
+        ssize_t n = write(target.fd, target.pending.data(), target.pending.size());
+        if (n > 0)
+            target.pending.erase(0, n);
+        else if (n < 0 && errno == EINTR)
+            continue;
+        else
+        {
+            if (errno != EAGAIN)
+                drop_target(target); // EPIPE: it exited
+            return;
+        }
+    }
+}
+
+// Reads exactly 'length' bytes which are known to be in the pipe
+static bool read_exactly(int fd, string &out, size_t length)
+{
+    size_t start = out.size();
+    out.resize(start + length);
+    size_t done = 0;
+    while (done < length)
+    {
+        ssize_t n = read(fd, &out[start + done], length - done);
+        if (n > 0)
+            done += n;
+        else if (n < 0 && errno == EINTR)
+            continue;
+        else
+        {
+            out.resize(start + done);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Bytes which still fit into the consumer's pipe right now
+static size_t room_in(const FanoutTarget &target)
+{
+    int queued = 0;
+    if (ioctl(target.fd, FIONREAD, &queued) < 0 || queued >= target.capacity)
+        return 0;
+    return target.capacity - queued;
+}
+
+// Moves up to 'available' bytes waiting in 'from' to the consumers. The ones which are up
+// to date ('current') get them without a copy: tee() into all of them but the last one
+// and splice() into the last one. tee() stops when a consumer's pipe is full, so they
+// may get different amounts; only those differing bytes come up into user space and
+// are queued for the consumers which missed them. The rest stays in 'from' for later.
+// Consumers which are 'behind' need every byte queued, so then all of it is read.
+static void move_data(int from, vector<FanoutTarget *> &current, vector<FanoutTarget *> &behind, size_t available)
+{
+    // Give everyone the same amount, so they stay level: no more than fits into all pipes
+    if (behind.empty())
+    {
+        for (FanoutTarget *target : current)
+            available = min(available, room_in(*target));
+        if (available == 0)
+            return;
+    }
+
+    // with consumers behind, the data is read anyway, so everyone current gets a tee()
+    size_t teeCount = behind.empty() ? current.size() - 1 : current.size();
+    vector<size_t> got(current.size(), 0); // bytes each current consumer already has
+    size_t least = available, most = 0;
+    for (size_t k = 0; k < teeCount; k++)
+    {
+        ssize_t n = tee(from, current[k]->fd, available, SPLICE_F_NONBLOCK);
+        if (n < 0 && errno == EPIPE)
+        {
+            drop_target(*current[k]);
+            continue; // it needs nothing more
+        }
+        got[k] = (n > 0) ? n : 0;
+        least = min(least, got[k]);
+        most = max(most, got[k]);
+    }
+
+    size_t moved = 0; // bytes taken out of 'from' by splice()
+    if (behind.empty() && least > 0)
+    {
+        FanoutTarget *last = current.back();
+        ssize_t n = splice(from, NULL, last->fd, NULL, least, SPLICE_F_NONBLOCK | SPLICE_F_MOVE);
+        if (n < 0 && errno == EPIPE)
+        {
+            drop_target(*last);
+            n = 0;
+        }
+        moved = (n > 0) ? n : 0;
+        got.back() = moved;
+    }
+    if (!behind.empty())
+        most = available;
+    if (most <= moved)
+        return;
+
+    // bytes some consumers have and others don't have to come up into user space once
+    string data;
+    read_exactly(from, data, most - moved);
+    for (size_t k = 0; k < current.size(); k++)
+    {
+        size_t skip = (got[k] > moved) ? got[k] - moved : 0; // bytes of 'data' it has already
+        if (current[k]->fd != -1 && skip < data.size())
+            current[k]->pending.append(data, skip, string::npos);
+    }
+    for (FanoutTarget *target : behind)
+        target->pending.append(data);
+}
+
+static long long now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+// Waits up to FULL_WAIT_MS until every consumer in 'targets' has room in its pipe
+static void wait_for_room(const vector<FanoutTarget *> &targets)
+{
+    long long deadline = now_ms() + FULL_WAIT_MS;
+    vector<struct pollfd> fds;
+    for (FanoutTarget *target : targets)
+        fds.push_back({target->fd, POLLOUT, 0});
+    while (true)
+    {
+        // only the ones which are still full are waited for
+        vector<struct pollfd> full;
+        for (struct pollfd &pfd : fds)
+        {
+            if (!(pfd.revents & (POLLOUT | POLLERR)))
+                full.push_back({pfd.fd, POLLOUT, 0});
+        }
+        long long left = deadline - now_ms();
+        if (full.empty() || left <= 0)
+            return;
+        if (poll(full.data(), full.size(), (int)left) < 0 && errno != EINTR)
+            return;
+        for (struct pollfd &done : full)
+        {
+            for (struct pollfd &pfd : fds)
+            {
+                if (pfd.fd == done.fd)
+                    pfd.revents = done.revents;
+            }
+        }
+    }
+}
+
+// Body of the pump thread: copies everything from 'from' to every consumer
+static void pump_loop(int from, vector<FanoutTarget> *targets)
+{
+    // If a consumer exits early, writing to it must fail with EPIPE, not kill the shell
+    sigset_t block;
+    sigemptyset(&block);
+    sigaddset(&block, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &block, nullptr);
+
+    fcntl(from, F_SETFL, fcntl(from, F_GETFL) | O_NONBLOCK);
+    for (FanoutTarget &target : *targets)
+        fcntl(target.fd, F_SETFL, fcntl(target.fd, F_GETFL) | O_NONBLOCK);
+
+    bool finished = false; // the producer closed its end and the pipe is empty
+    bool draining = false;  // a consumer fell MAX_LAG behind: wait until it has caught up
+    while (true)
+    {
+        vector<FanoutTarget *> current, behind;
+        size_t lag = 0; // the longest queue
+        for (FanoutTarget &target : *targets)
+        {
+            flush_target(target);
+            if (target.fd == -1)
+                continue;
+            (target.pending.empty() ? current : behind).push_back(&target);
+            lag = max(lag, target.pending.size());
+        }
+        if (current.empty() && behind.empty())
+            break; // every consumer is gone
+        if (finished && behind.empty())
+            break;
+        if (lag >= MAX_LAG)
+            draining = true;
+        else if (behind.empty())
+            draining = false;
+
+        // Read only when a current consumer wants more: if they are all busy, the
+        // data stays in the producer's pipe and the producer waits (backpressure)
+        bool reading = !finished && !current.empty() && !draining;
+        int available = 0;
+        if (reading && ioctl(from, FIONREAD, &available) < 0)
+            available = 0;
+
+        // wait for data (if the pipe is empty), for room in a current consumer's pipe
+        // (if there is data) and for room in the pipes of the ones behind
+        vector<struct pollfd> fds;
+        fds.push_back({(reading && available == 0) ? from : -1, POLLIN, 0});
+        for (FanoutTarget *target : current)
+            fds.push_back({target->fd, (short)((reading && available > 0) ? POLLOUT : 0), 0});
+        for (FanoutTarget *target : behind)
+            fds.push_back({target->fd, POLLOUT, 0});
+        if (poll(fds.data(), fds.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (size_t k = 1; k < fds.size(); k++)
+        {
+            FanoutTarget *target = (k <= current.size()) ? current[k - 1] : behind[k - 1 - current.size()];
+            if (fds[k].revents & POLLERR)
+                drop_target(*target); // its read end was closed
+        }
+        if (!reading)
+            continue;
+        if (available == 0)
+        {
+            if (ioctl(from, FIONREAD, &available) == 0 && available == 0 && (fds[0].revents & (POLLHUP | POLLERR)))
+                finished = true;
+            continue; // new data: next round waits for room for it
+        }
+
+        vector<FanoutTarget *> ready, full; // current consumers with / without room
+        for (FanoutTarget *target : current)
+        {
+            if (target->fd != -1)
+                (room_in(*target) > 0 ? ready : full).push_back(target);
+        }
+        if (ready.empty())
+            continue;
+
+        // A consumer whose pipe is full gets FULL_WAIT_MS to make room, so usually
+        // everyone moves on together without a copy. After that the others go on
+        // without it and its share is queued.
+        if (!full.empty())
+        {
+            wait_for_room(full);
+            for (FanoutTarget *target : full)
+            {
+                if (target->fd != -1 && room_in(*target) > 0)
+                    ready.push_back(target);
+                else if (target->fd != -1)
+                    behind.push_back(target);
+            }
+        }
+        vector<FanoutTarget *> stillBehind;
+        for (FanoutTarget *target : behind)
+        {
+            if (target->fd != -1)
+                stillBehind.push_back(target);
+        }
+        move_data(from, ready, stillBehind, min(available, COPY_CHUNK));
+    }
+
+    close(from); // the producer now gets SIGPIPE if it is still writing
+    for (FanoutTarget &target : *targets)
+    {
+        if (target.fd != -1)
+            close(target.fd); // the consumer now sees end of file
+    }
+}
+
+bool is_fanout_stage(const vector<string> &words)
+{
+    if (words.empty())
+        return false;
+    for (const string &word : words)
+    {
+        // the whole word must be one (...) group: "(a)b" is not
+        if (word.size() < 2 || word[0] != '(' || skip_group(word, 0) != word.size() || word.back() != ')')
+            return false;
+    }
+    return true;
+}
+
+void run_fanout(const vector<vector<string>> &producer, const vector<string> &consumers)
+{
+    // one pipe from the producer to the pump, and one from the pump to every consumer
+    int input[2];
+    if (pipe2(input, O_CLOEXEC) < 0)
+    {
+        perror("fan-out: pipe");
+        lastStatus = 1;
+        return;
+    }
+    vector<int> readEnds;
+    vector<FanoutTarget> targets;
+    for (size_t k = 0; k < consumers.size(); k++)
+    {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) < 0)
+        {
+            perror("fan-out: pipe");
+            break;
+        }
+        // bigger pipes let a consumer get further ahead before the others must wait for it
+        fcntl(fds[1], F_SETPIPE_SZ, PIPE_SIZE);
+        readEnds.push_back(fds[0]);
+        targets.push_back({fds[1], fcntl(fds[1], F_GETPIPE_SZ), ""});
+    }
+
+    // Start the consumers: each one is a copy of the shell running the text inside
+    // the brackets, with its pipe as stdin
+    cout.flush(); // otherwise the children print our buffered output a second time
+    fflush(stdout);
+    vector<pid_t> pids;
+    for (size_t k = 0; k < readEnds.size(); k++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            dup2(readEnds[k], STDIN_FILENO);
+            // none of the other fan-out pipes may be held open by this process, or the
+            // pump / the other consumers would never see end of file
+            close(input[0]);
+            close(input[1]);
+            for (size_t j = 0; j < readEnds.size(); j++)
+            {
+                close(readEnds[j]);
+                close(targets[j].fd);
+            }
+            const string &group = consumers[k];
+            execute_line(group.substr(1, group.size() - 2));
+            exit(lastStatus);
+        }
+        if (pid < 0)
+            perror("fan-out: fork");
+        else
+            pids.push_back(pid);
+    }
+    for (int fd : readEnds)
+        close(fd);
+
+    thread pump(pump_loop, input[0], &targets);
+
+    // The producer runs like any other command, with its stdout pointed at the pump
+    // (so builtins and the in-shell cat still run without a process).
+    // If every consumer exits early ("cat big | (head -1)"), a write in the shell fails
+    // with EPIPE instead of SIGPIPE killing the shell. A handler that does nothing is
+    // used rather than SIG_IGN: exec() resets it, so external producers still get SIGPIPE.
+    struct sigaction ignorePipe, oldPipe;
+    memset(&ignorePipe, 0, sizeof(ignorePipe));
+    ignorePipe.sa_handler = [](int) {};
+    sigemptyset(&ignorePipe.sa_mask);
+    sigaction(SIGPIPE, &ignorePipe, &oldPipe);
+    vector<SavedFd> saved;
+    if (apply_redirections({{REDIRECT_DUPLICATE, STDOUT_FILENO, "", input[1]}}, &saved))
+        execute_command(producer); // an EPIPE just ends it, like the end of its input
+    restore_fds(saved);
+    sigaction(SIGPIPE, &oldPipe, nullptr);
+    close(input[1]); // the pump sees end of file once the producer's processes are gone too
+
+    pump.join();
+
+    // like a pipeline, the status is the one of the last consumer
+    lastStatus = 0;
+    for (size_t k = 0; k < pids.size(); k++)
+    {
+        int status = 0;
+        waitpid(pids[k], &status, 0);
+        if (k + 1 == pids.size())
+            lastStatus = exit_code(status);
+    }
+}
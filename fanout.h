@@ -0,0 +1,25 @@
+/*
+   fanout.h
+   Header file for fan-out pipelines: "producer | (consumer 1) (consumer 2) ..." sends
+   the producer's output to every consumer at once, without temp files. The shell
+   copies the stream with tee() / splice() inside the kernel where it can.
+*/
+
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <string>
+#include <vector>
+
+// true if the words of a pipeline stage are only ( ... ) groups, e.g.
+// (gzip -c > out.gz) (sha256sum) (grep -c error)
+bool is_fanout_stage(const std::vector<std::string> &words);
+
+// Runs 'producer' (the words of the stages before the fan-out) with its output
+// going to each of the 'consumers' groups, which run as command lines of their own
+// (so they may contain pipes, redirections and further fan-outs).
+// $? is the exit status of the last consumer, like for a pipeline.
+void run_fanout(const std::vector<std::vector<std::string>> &producer,
+                const std::vector<std::string> &consumers);
+
+#endif
@@ -0,0 +1,330 @@
+/*
+fileops.cpp: cat and cp builtins which copy data inside the kernel (zero-copy).
+*/
+
+#include "fileops.h"
+#include "eventloop.h" // for take_interrupt(), wait_for_input()
+#include <unistd.h>       // for read(), write(), copy_file_range()
+#include <fcntl.h>        // for open(), splice()
+#include <sys/stat.h>     // for fstat(), stat()
+#include <sys/sendfile.h> // for sendfile()
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <iostream>
+
+using namespace std;
+
+static const size_t COPY_CHUNK = 1 << 20; // ask the kernel for up to 1 MiB per call
+static const size_t RW_BUFSIZE = 128 * 1024; // buffer size for the read()/write() fallback
+
+// These errors mean "this copy method is not possible for this pair of fds",
+// so we should quietly try the next method instead of failing.
+static bool method_unsupported(int err)
+{
+    return err == EINVAL || err == ENOSYS || err == EXDEV ||
+           err == EOPNOTSUPP || err == EBADF;
+}
+
+// Ctrl+C only reaches the shell through its signalfd, so a copy running inside the shell
+// checks for it after every chunk. It then fails with EINTR.
+static long long interrupted_copy()
+{
+    errno = EINTR;
+    return -1;
+}
+
+// Plain read()/write() copy, used when the kernel cannot do the copy for us.
+// With 'waits' the input may have nothing to read for a long time (a pipe, a device).
+static long long copy_read_write(int in_fd, int out_fd, bool waits)
+{
+    static char buf[RW_BUFSIZE];
+    long long total = 0;
+    while (true)
+    {
+        if ((waits && !wait_for_input(in_fd)) || take_interrupt())
+            return interrupted_copy();
+        ssize_t n = read(in_fd, buf, sizeof(buf));
+        if (n == 0)
+            return total; // end of file
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        // write() may write less than asked (e.g. to a pipe), so loop until everything is written
+        ssize_t done = 0;
+        while (done < n)
+        {
+            ssize_t w = write(out_fd, buf + done, n - done);
+            if (w < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return -1;
+            }
+            done += w;
+        }
+        total += n;
+    }
+}
+
+long long copy_fd(int in_fd, int out_fd)
+{
+    struct stat in_st, out_st;
+    if (fstat(in_fd, &in_st) < 0 || fstat(out_fd, &out_st) < 0)
+        return -1;
+
+    // Files in /proc and /sys report a size of 0 even though they have contents,
+    // and copy_file_range()/sendfile() would copy nothing from them. So we only
+    // trust the kernel copy for regular files with a real size.
+    bool in_file = S_ISREG(in_st.st_mode) && in_st.st_size > 0;
+    bool out_file = S_ISREG(out_st.st_mode);
+    bool in_pipe = S_ISFIFO(in_st.st_mode);
+    bool out_pipe = S_ISFIFO(out_st.st_mode);
+    bool in_waits = !S_ISREG(in_st.st_mode); // a read may block (pipe, FIFO, device)
+
+    long long total = 0;
+    ssize_t n;
+
+    // 1. file -> file: copy_file_range() lets the filesystem copy (or even share) the blocks
+    if (in_file && out_file)
+    {
+        while ((n = copy_file_range(in_fd, NULL, out_fd, NULL, COPY_CHUNK, 0)) > 0)
+        {
+            total += n;
+            if (take_interrupt())
+                return interrupted_copy();
+        }
+        if (n == 0)
+            return total;
+        if (!method_unsupported(errno))
+            return -1;
+        // otherwise continue below from the current file offsets
+    }
+
+    // 2. a pipe on either side: splice() moves pages between the pipe and the other fd
+    if ((in_pipe && !out_pipe) || (out_pipe && (in_file || in_pipe)))
+    {
+        while (true)
+        {
+            if ((in_waits && !wait_for_input(in_fd)) || take_interrupt())
+                return interrupted_copy();
+            n = splice(in_fd, NULL, out_fd, NULL, COPY_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (n <= 0)
+                break;
+            total += n;
+        }
+        if (n == 0)
+            return total;
+        if (errno != EINTR && !method_unsupported(errno))
+            return -1;
+    }
+
+    // 3. file -> anything else (terminal, socket, ...): sendfile()
+    if (in_file)
+    {
+        while ((n = sendfile(out_fd, in_fd, NULL, COPY_CHUNK)) > 0)
+        {
+            total += n;
+            if (take_interrupt())
+                return interrupted_copy();
+        }
+        if (n == 0)
+            return total;
+        if (!method_unsupported(errno))
+            return -1;
+    }
+
+    // 4. nothing else worked, copy through user space
+    long long rest = copy_read_write(in_fd, out_fd, in_waits);
+    if (rest < 0)
+        return -1;
+    return total + rest;
+}
+
+bool cat_supported(const vector<string> &args, int in_fd)
+{
+    // Background jobs ("cat file &") and options (-n, -A, ...) are left for /bin/cat
+    if (args.back() == "&")
+        return false;
+    bool reads_input = (args.size() == 1);
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        if (args[i].size() > 1 && args[i][0] == '-')
+            return false;
+        if (args[i] == "-")
+            reads_input = true;
+    }
+    // Reading the terminal inside the shell could not be stopped with Ctrl+C
+    return !(reads_input && isatty(in_fd));
+}
+
+bool cp_supported(const vector<string> &args)
+{
+    if (args.size() < 3 || args.back() == "&")
+        return false;
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        if (args[i][0] == '-')
+            return false; // -r, -p, ... are left for /bin/cp
+    }
+    return true;
+}
+
+int run_cat(const vector<string> &args, int in_fd, int out_fd)
+{
+    // Anything already printed through cout must reach out_fd before our raw writes
+    cout.flush();
+    fflush(stdout);
+
+    vector<string> files(args.begin() + 1, args.end());
+    if (files.empty())
+        files.push_back("-"); // no file given, so read from the input
+
+    // "cat f >> f" would copy the file into itself until the disk is full
+    struct stat out_st;
+    bool out_is_file = (fstat(out_fd, &out_st) == 0 && S_ISREG(out_st.st_mode));
+
+    int status = 0;
+    for (const string &name : files)
+    {
+        int fd = in_fd;
+        if (name != "-")
+        {
+            // O_NONBLOCK: opening a FIFO would otherwise wait for a writer, and Ctrl+C
+            // could not stop that. copy_fd() waits for its data instead.
+            fd = open(name.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+            if (fd < 0)
+            {
+                perror(("cat: " + name).c_str());
+                status = 1;
+                continue;
+            }
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        }
+
+        struct stat in_st;
+        if (out_is_file && fstat(fd, &in_st) == 0 && in_st.st_dev == out_st.st_dev &&
+            in_st.st_ino == out_st.st_ino && lseek(fd, 0, SEEK_CUR) < in_st.st_size)
+        {
+            // like GNU cat (an empty file, e.g. after "> f", is fine)
+            cerr << "cat: " << name << ": input file is output file" << endl;
+            status = 1;
+            if (fd != in_fd)
+                close(fd);
+            continue;
+        }
+
+        if (copy_fd(fd, out_fd) < 0)
+        {
+            // If the reader of our output went away (e.g. "cat big | head"), stop quietly
+            // and stop at Ctrl+C (the newline goes to stderr: stdout may be the file being written)
+            int err = errno;
+            if (err == EPIPE || err == EINTR)
+            {
+                if (fd != in_fd)
+                    close(fd);
+                if (err == EINTR)
+                    cerr << endl;
+                return (err == EINTR) ? 130 : 1;
+            }
+            perror(("cat: " + name).c_str());
+            status = 1;
+        }
+
+        if (fd != in_fd)
+            close(fd);
+    }
+    return status;
+}
+
+// Copies one file to another path, keeping the permission bits of the source
+static int copy_one_file(const string &src, const string &dst)
+{
+    int in_fd = open(src.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0)
+    {
+        perror(("cp: cannot open '" + src + "'").c_str());
+        return 1;
+    }
+
+    struct stat src_st;
+    if (fstat(in_fd, &src_st) < 0 || S_ISDIR(src_st.st_mode))
+    {
+        cerr << "cp: -r not specified; omitting directory '" << src << "'" << endl;
+        close(in_fd);
+        return 1;
+    }
+
+    // copying a file onto itself would truncate it to nothing
+    struct stat dst_st;
+    if (stat(dst.c_str(), &dst_st) == 0 &&
+        dst_st.st_dev == src_st.st_dev && dst_st.st_ino == src_st.st_ino)
+    {
+        cerr << "cp: '" << src << "' and '" << dst << "' are the same file" << endl;
+        close(in_fd);
+        return 1;
+    }
+
+    int out_fd = open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, src_st.st_mode & 07777);
+    if (out_fd < 0)
+    {
+        perror(("cp: cannot create '" + dst + "'").c_str());
+        close(in_fd);
+        return 1;
+    }
+
+    int status = 0;
+    if (copy_fd(in_fd, out_fd) < 0)
+    {
+        if (errno == EINTR)
+            status = 130; // Ctrl+C
+        else
+        {
+            perror(("cp: error copying '" + src + "'").c_str());
+            status = 1;
+        }
+    }
+    close(in_fd);
+    close(out_fd);
+    return status;
+}
+
+int run_cp(const vector<string> &args)
+{
+    string dst = args.back();
+    struct stat st;
+    bool dst_is_dir = (stat(dst.c_str(), &st) == 0 && S_ISDIR(st.st_mode));
+
+    // With more than one source the destination has to be a directory
+    if (args.size() > 3 && !dst_is_dir)
+    {
+        cerr << "cp: target '" << dst << "' is not a directory" << endl;
+        return 1;
+    }
+
+    int status = 0;
+    for (size_t i = 1; i + 1 < args.size(); i++)
+    {
+        string target = dst;
+        if (dst_is_dir)
+        {
+            // "cp dir1/a.txt dir2" creates dir2/a.txt
+            size_t slash = args[i].find_last_of('/');
+            string base = (slash == string::npos) ? args[i] : args[i].substr(slash + 1);
+            target = dst + "/" + base;
+        }
+        int result = copy_one_file(args[i], target);
+        if (result == 130)
+        {
+            cerr << endl;
+            return 130; // Ctrl+C: the other files are not copied
+        }
+        if (result != 0)
+            status = 1;
+    }
+    return status;
+}
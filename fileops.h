@@ -0,0 +1,38 @@
+/*
+   fileops.h
+   Header file for the in-shell file copying builtins: cat and cp.
+   The data is moved by the kernel (copy_file_range, splice, sendfile)
+   instead of being copied through a buffer in our process.
+*/
+
+#ifndef FILEOPS_H
+#define FILEOPS_H
+
+#include <string>
+#include <vector>
+
+// Copies everything readable from in_fd into out_fd, choosing the cheapest method:
+//   file -> file : copy_file_range()
+//   pipe on either side : splice()
+//   file -> anything else : sendfile()
+// and plain read()/write() when none of the above is possible.
+// It stops between chunks when Ctrl+C is pressed, and fails with errno EINTR then.
+// Returns the number of bytes copied, or -1 on error (errno is set).
+long long copy_fd(int in_fd, int out_fd);
+
+// Returns true if our cat builtin can handle these arguments (no options other than "-"),
+// given that its input would come from in_fd
+bool cat_supported(const std::vector<std::string> &args, int in_fd);
+
+// Returns true if our cp builtin understands these arguments (no options at all)
+bool cp_supported(const std::vector<std::string> &args);
+
+// cat builtin: writes the given files (or in_fd when no file / "-" is given) to out_fd
+// Returns the exit status (0 on success, 1 if any file failed, 130 for Ctrl+C)
+int run_cat(const std::vector<std::string> &args, int in_fd, int out_fd);
+
+// cp builtin: "cp src dst" or "cp src1 src2 ... dir"
+// Returns the exit status (0 on success, 1 on failure, 130 for Ctrl+C)
+int run_cp(const std::vector<std::string> &args);
+
+#endif
@@ -0,0 +1,303 @@
+/*
+frecency.cpp: the directory database behind z / cd -z, with a trigram and a prefix index.
+*/
+
+#include "frecency.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <unordered_map>
+
+using namespace std;
+
+extern string shellHome; // the database lives in the shell's home directory
+
+#define MAX_TOTAL_COUNT 9000 // above this, compaction lets all counts age (like z does)
+#define MAX_LISTED 20
+
+// One remembered directory
+struct DirRecord
+{
+    string path;
+    string lower;  // the path in lowercase, which the indexes and matching use
+    double count;  // visits (reduced a little by aging)
+    time_t last;   // time of the last visit
+    bool gone;     // the directory was removed: not offered again, dropped at the next compaction
+};
+
+static vector<DirRecord> records;
+static unordered_map<string, size_t> byPath;             // path -> index in records
+static unordered_map<uint32_t, vector<uint32_t>> trigrams; // 3 characters -> records containing them
+static vector<pair<string, uint32_t>> basenames;          // (lowercase last component, record), sorted
+static bool loaded = false;
+static size_t fileLines = 0; // lines in the file: one per visit since the last compaction
+
+static string database_path()
+{
+    return shellHome + "/.my_shell_dirs";
+}
+
+static string to_lower(const string &text)
+{
+    string lower = text;
+    for (char &c : lower)
+        c = tolower((unsigned char)c);
+    return lower;
+}
+
+static uint32_t trigram_at(const string &text, size_t i)
+{
+    return ((unsigned char)text[i] << 16) | ((unsigned char)text[i + 1] << 8) | (unsigned char)text[i + 2];
+}
+
+// Adds a new directory to the records and the indexes. When many are added at once
+// ('bulk'), the basenames are only appended and the caller sorts them once at the end.
+static size_t add_record(const string &path, bool bulk = false)
+{
+    uint32_t id = records.size();
+    records.push_back({path, to_lower(path), 0, 0, false});
+    byPath[path] = id;
+
+    const string &lower = records[id].lower;
+    for (size_t i = 0; i + 3 <= lower.size(); i++)
+    {
+        vector<uint32_t> &ids = trigrams[trigram_at(lower, i)];
+        if (ids.empty() || ids.back() != id) // a trigram twice in one path is listed once
+            ids.push_back(id);
+    }
+    string base = lower.substr(lower.rfind('/') + 1);
+    if (bulk)
+        basenames.push_back({base, id});
+    else
+        basenames.insert(lower_bound(basenames.begin(), basenames.end(), make_pair(base, id)), {base, id});
+    return id;
+}
+
+// Reads the database: lines of "count <TAB> last visit <TAB> path". A visit is just
+// another line with count 1, so the counts of the same path add up.
+static void load_database()
+{
+    if (loaded)
+        return;
+    loaded = true;
+    ifstream file(database_path());
+    string line;
+    while (getline(file, line))
+    {
+        size_t tab1 = line.find('\t');
+        size_t tab2 = (tab1 == string::npos) ? string::npos : line.find('\t', tab1 + 1);
+        if (tab2 == string::npos)
+            continue;
+        string path = line.substr(tab2 + 1);
+        auto found = byPath.find(path);
+        size_t id = (found != byPath.end()) ? found->second : add_record(path, true);
+        records[id].count += atof(line.substr(0, tab1).c_str());
+        records[id].gone = false;
+        records[id].last = max(records[id].last, (time_t)atoll(line.substr(tab1 + 1, tab2 - tab1 - 1).c_str()));
+        fileLines++;
+    }
+    sort(basenames.begin(), basenames.end());
+}
+
+// Rewrites the file with one line per directory. Written to a temporary file which
+// then replaces the old one, so a crash never leaves half a database.
+static void compact_database()
+{
+    double total = 0;
+    for (const DirRecord &record : records)
+        total += record.count;
+    bool aging = total > MAX_TOTAL_COUNT;
+
+    string path = database_path();
+    string temporary = path + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "we"); // "e": close-on-exec
+    if (file == nullptr)
+        return;
+    vector<DirRecord> kept;
+    for (DirRecord &record : records)
+    {
+        double count = aging ? record.count * 0.99 : record.count;
+        if ((count < 1 && aging) || record.gone)
+            continue; // rarely used and old, or removed: forgotten
+        fprintf(file, "%g\t%lld\t%s\n", count, (long long)record.last, record.path.c_str());
+        kept.push_back({record.path, "", count, record.last, false});
+    }
+    if (fclose(file) != 0 || rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        unlink(temporary.c_str());
+        return;
+    }
+
+    // rebuild the indexes for what is left
+    records.clear();
+    byPath.clear();
+    trigrams.clear();
+    basenames.clear();
+    for (const DirRecord &record : kept)
+    {
+        size_t id = add_record(record.path, true);
+        records[id].count = record.count;
+        records[id].last = record.last;
+    }
+    sort(basenames.begin(), basenames.end());
+    fileLines = records.size();
+}
+
+void frecency_visit(const string &dir)
+{
+    load_database();
+    auto found = byPath.find(dir);
+    size_t id = (found != byPath.end()) ? found->second : add_record(dir);
+    records[id].count += 1;
+    records[id].last = time(nullptr);
+    records[id].gone = false;
+
+    // one line per visit, appended with a single write(): the file is not rewritten
+    char line[PATH_MAX + 64];
+    int length = snprintf(line, sizeof(line), "1\t%lld\t%s\n", (long long)records[id].last, dir.c_str());
+    int fd = open(database_path().c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (fd >= 0)
+    {
+        if (length > 0 && length < (int)sizeof(line) && write(fd, line, length) == length)
+            fileLines++;
+        close(fd);
+    }
+
+    if (fileLines > 2 * records.size() + 100)
+        compact_database();
+}
+
+// count, weighted by how long ago the last visit was (the same steps as z)
+static double score(const DirRecord &record, time_t now)
+{
+    double age = difftime(now, record.last);
+    if (age < 3600)
+        return record.count * 4;
+    if (age < 86400)
+        return record.count * 2;
+    if (age < 604800)
+        return record.count / 2;
+    return record.count / 4;
+}
+
+// true if all fragments appear in the path, in this order
+static bool matches(const string &lower, const vector<string> &fragments)
+{
+    size_t position = 0;
+    for (const string &fragment : fragments)
+    {
+        size_t found = lower.find(fragment, position);
+        if (found == string::npos)
+            return false;
+        position = found + fragment.size();
+    }
+    return true;
+}
+
+// The records which can match, from the indexes, so not every path has to be checked:
+//  - a fragment of 3+ characters: the shortest trigram list of its trigrams
+//  - else the directories whose name starts with the last fragment: for "z d" these are
+//    preferred over paths which just have a 'd' somewhere. Only if there are none,
+//    every path is checked.
+// The candidates are checked with matches() afterwards.
+static vector<uint32_t> candidates(const vector<string> &fragments)
+{
+    const vector<uint32_t> *shortest = nullptr;
+    for (const string &fragment : fragments)
+    {
+        for (size_t i = 0; i + 3 <= fragment.size(); i++)
+        {
+            auto found = trigrams.find(trigram_at(fragment, i));
+            if (found == trigrams.end())
+                return {}; // this trigram is in no path at all
+            if (shortest == nullptr || found->second.size() < shortest->size())
+                shortest = &found->second;
+        }
+    }
+    if (shortest != nullptr)
+        return *shortest;
+
+    vector<uint32_t> all;
+    if (!fragments.empty() && !fragments.back().empty())
+    {
+        const string &prefix = fragments.back();
+        for (auto it = lower_bound(basenames.begin(), basenames.end(), make_pair(prefix, (uint32_t)0));
+             it != basenames.end() && it->first.compare(0, prefix.size(), prefix) == 0; it++)
+            all.push_back(it->second);
+        if (!all.empty())
+            return all;
+    }
+    // only very short fragments which are not a prefix: check everything
+    for (uint32_t id = 0; id < records.size(); id++)
+        all.push_back(id);
+    return all;
+}
+
+// The 'limit' best matching records, best first
+static vector<pair<double, uint32_t>> ranked(const vector<string> &fragments, size_t limit)
+{
+    load_database();
+    vector<string> lowerFragments;
+    for (const string &fragment : fragments)
+        lowerFragments.push_back(to_lower(fragment));
+
+    time_t now = time(nullptr);
+    vector<pair<double, uint32_t>> result;
+    for (uint32_t id : candidates(lowerFragments))
+    {
+        if (!records[id].gone && matches(records[id].lower, lowerFragments))
+            result.push_back({score(records[id], now), id});
+    }
+    // only the best ones are sorted
+    limit = min(limit, result.size());
+    partial_sort(result.begin(), result.begin() + limit, result.end(),
+                 [](const pair<double, uint32_t> &a, const pair<double, uint32_t> &b)
+                 { return a.first > b.first; });
+    result.resize(limit);
+    return result;
+}
+
+bool frecency_best(const vector<string> &fragments, string &dir)
+{
+    char cwd[PATH_MAX];
+    string current = (getcwd(cwd, sizeof(cwd)) != nullptr) ? cwd : "";
+    // the best few are enough, unless all of them were removed: then look further
+    for (size_t limit = 16;; limit *= 16)
+    {
+        vector<pair<double, uint32_t>> best = ranked(fragments, limit);
+        for (auto &match : best)
+        {
+            const string &path = records[match.second].path;
+            struct stat st;
+            // skip where we already are, and directories which were removed since
+            if (path == current)
+                continue;
+            if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+            {
+                dir = path;
+                return true;
+            }
+            records[match.second].gone = true; // so the next lookup doesn't stat() it again
+        }
+        if (best.size() < limit)
+            return false;
+    }
+}
+
+void frecency_list(const vector<string> &fragments)
+{
+    vector<pair<double, uint32_t>> matches = ranked(fragments, MAX_LISTED);
+    for (size_t i = 0; i < matches.size(); i++)
+    {
+        char score[32];
+        snprintf(score, sizeof(score), "%10.2f", matches[i].first);
+        cout << score << "  " << records[matches[i].second].path << endl;
+    }
+}
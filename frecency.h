@@ -0,0 +1,26 @@
+/*
+   frecency.h
+   Header file for z-style directory jumping. Every directory the shell cd's into is
+   remembered with a visit count and the time of the last visit; "z fragments" (or
+   "cd -z fragments") goes to the best match, ranked by count and how recent it is.
+*/
+
+#ifndef FRECENCY_H
+#define FRECENCY_H
+
+#include <string>
+#include <vector>
+
+// Records a visit of 'dir' (an absolute path), after a successful chdir().
+// The visit is appended to ~/.my_shell_dirs; the file is compacted once it has
+// many more lines than directories.
+void frecency_visit(const std::string &dir);
+
+// Finds the best-ranked existing directory whose path contains all fragments in order
+// (case-insensitive), other than the current directory. false if there is none.
+bool frecency_best(const std::vector<std::string> &fragments, std::string &dir);
+
+// "z -l [fragments]": prints the matching directories with their scores, best first
+void frecency_list(const std::vector<std::string> &fragments);
+
+#endif
@@ -0,0 +1,490 @@
+/*
+glob.cpp: brace expansion and glob pattern matching with a compiled (bit-parallel) matcher.
+*/
+
+#include "glob.h"
+#include "parser.h"   // for skip_group()
+#include <dirent.h>
+#include <sys/stat.h>
+#include <fnmatch.h>  // fallback for very long patterns
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+
+using namespace std;
+
+// ------------------- brace expansion -------------------
+
+// Splits the inside of {...} at the commas which are not nested in other braces or quotes
+static vector<string> split_alternatives(const string &body)
+{
+    vector<string> parts;
+    string part;
+    int depth = 0;
+    for (size_t i = 0; i < body.size(); i++)
+    {
+        char c = body[i];
+        if (c == '\\' && i + 1 < body.size())
+        {
+            part += body.substr(i, 2);
+            i++;
+            continue;
+        }
+        if (c == '\'' || c == '"' || c == '`' || c == '(')
+        {
+            size_t end = skip_group(body, i);
+            part += body.substr(i, end - i);
+            i = end - 1;
+            continue;
+        }
+        if (c == '{')
+            depth++;
+        else if (c == '}')
+            depth--;
+        if (c == ',' && depth == 0)
+        {
+            parts.push_back(part);
+            part.clear();
+        }
+        else
+        {
+            part += c;
+        }
+    }
+    parts.push_back(part);
+    return parts;
+}
+
+// {1..5}, {05..10}, {a..e}: returns false if 'body' is not a range
+static bool expand_range(const string &body, vector<string> &items)
+{
+    size_t dots = body.find("..");
+    if (dots == string::npos || dots == 0 || dots + 2 >= body.size())
+        return false;
+    string from = body.substr(0, dots), to = body.substr(dots + 2);
+
+    auto is_number = [](const string &s) {
+        size_t start = (s[0] == '-') ? 1 : 0;
+        return start < s.size() && s.find_first_not_of("0123456789", start) == string::npos;
+    };
+    if (is_number(from) && is_number(to))
+    {
+        long a = stol(from), b = stol(to);
+        // "01..10" keeps the width of the numbers
+        size_t width = (from.size() > 1 && from[0] == '0') || (to.size() > 1 && to[0] == '0')
+                           ? max(from.size(), to.size()) : 0;
+        if (labs(b - a) > 1000000)
+            return false; // refuse to build a huge argument list by accident
+        for (long v = a;; v += (a <= b ? 1 : -1))
+        {
+            string text = to_string(v);
+            if (text.size() < width)
+                text = string(width - text.size(), '0') + text;
+            items.push_back(text);
+            if (v == b)
+                break;
+        }
+        return true;
+    }
+    if (from.size() == 1 && to.size() == 1 && isalpha((unsigned char)from[0]) && isalpha((unsigned char)to[0]))
+    {
+        char a = from[0], b = to[0];
+        for (char c = a;; c += (a <= b ? 1 : -1))
+        {
+            items.push_back(string(1, c));
+            if (c == b)
+                break;
+        }
+        return true;
+    }
+    return false;
+}
+
+vector<string> brace_expand(const string &word)
+{
+    for (size_t i = 0; i < word.size(); i++)
+    {
+        char c = word[i];
+        if (c == '\\')
+        {
+            i++;
+            continue;
+        }
+        if (c == '\'' || c == '"' || c == '`' || c == '(')
+        {
+            i = skip_group(word, i) - 1; // nothing inside quotes or $(...) is expanded here
+            continue;
+        }
+        if (c != '{' || (i > 0 && word[i - 1] == '$'))
+            continue;
+
+        // find the matching '}'
+        int depth = 0;
+        size_t close = string::npos;
+        for (size_t j = i; j < word.size(); j++)
+        {
+            if (word[j] == '\\')
+                j++;
+            else if (word[j] == '\'' || word[j] == '"' || word[j] == '`' || word[j] == '(')
+                j = skip_group(word, j) - 1;
+            else if (word[j] == '{')
+                depth++;
+            else if (word[j] == '}' && --depth == 0)
+            {
+                close = j;
+                break;
+            }
+        }
+        if (close == string::npos)
+            break;
+
+        string body = word.substr(i + 1, close - i - 1);
+        vector<string> items = split_alternatives(body);
+        if (items.size() < 2)
+        {
+            items.clear();
+            if (!expand_range(body, items))
+                continue; // "{}" or "{x}" stay as they are
+        }
+
+        // prefix + each alternative + suffix, and the result may contain more braces
+        vector<string> result;
+        string prefix = word.substr(0, i), suffix = word.substr(close + 1);
+        for (const string &item : items)
+        {
+            for (const string &w : brace_expand(prefix + item + suffix))
+                result.push_back(w);
+        }
+        return result;
+    }
+    return {word};
+}
+
+// ------------------- compiled glob matcher -------------------
+
+// A pattern for one path component like "*.lo[gs]" is compiled into a list of
+// elements (a set of allowed characters, or a star) and matched with a bit-parallel
+// NFA simulation: bit k of the state means "the first k elements have matched".
+// Every character of a name is handled once with a few AND/OR/shift operations,
+// so there is no backtracking however many stars the pattern has.
+class GlobMatcher
+{
+public:
+    explicit GlobMatcher(const string &pattern) : pattern_(pattern)
+    {
+        memset(accept_, 0, sizeof(accept_));
+        compile();
+    }
+
+    bool matches(const char *name) const
+    {
+        // a leading '.' must be matched by a literal '.', so "*" skips hidden files
+        if (name[0] == '.' && !leadingDot_)
+            return false;
+        if (tooLong_)
+            return fnmatch(pattern_.c_str(), name, FNM_PERIOD) == 0;
+
+        uint64_t state = closure(1); // nothing matched yet
+        for (const unsigned char *p = (const unsigned char *)name; *p; p++)
+        {
+            state = closure(((state & accept_[*p]) << 1) | (state & stars_));
+            if (state == 0)
+                return false; // no way to match anymore
+        }
+        return (state >> count_) & 1;
+    }
+
+private:
+    string pattern_;
+    uint64_t accept_[256]; // bit k set: element k accepts this character
+    uint64_t stars_ = 0;   // bit k set: element k is a '*'
+    int count_ = 0;        // number of elements
+    bool leadingDot_ = false;
+    bool tooLong_ = false;
+
+    // a star may also match nothing, so reaching it means also reaching the element after it
+    uint64_t closure(uint64_t state) const
+    {
+        return state | ((state & stars_) << 1);
+    }
+
+    void add_element(const bool chars[256])
+    {
+        if (count_ >= 63)
+        {
+            tooLong_ = true;
+            return;
+        }
+        for (int c = 0; c < 256; c++)
+        {
+            if (chars[c])
+                accept_[c] |= (1ULL << count_);
+        }
+        count_++;
+    }
+
+    void compile()
+    {
+        bool chars[256];
+        size_t i = 0;
+        leadingDot_ = (pattern_[0] == '.' || pattern_.compare(0, 2, "\\.") == 0);
+        while (i < pattern_.size() && !tooLong_)
+        {
+            char c = pattern_[i];
+            memset(chars, 0, sizeof(chars));
+            if (c == '*')
+            {
+                if (count_ == 0 || !(stars_ & (1ULL << (count_ - 1)))) // "**" inside a name is one star
+                {
+                    stars_ |= (1ULL << count_);
+                    add_element(chars); // a star accepts no character by moving forward
+                }
+                i++;
+                continue;
+            }
+            if (c == '?')
+            {
+                memset(chars, 1, sizeof(chars));
+                chars[0] = false;
+                i++;
+            }
+            else if (c == '[' && parse_class(i, chars))
+            {
+                // parse_class() moved i past the ']'
+            }
+            else
+            {
+                if (c == '\\' && i + 1 < pattern_.size())
+                    i++;
+                chars[(unsigned char)pattern_[i]] = true;
+                i++;
+            }
+            add_element(chars);
+        }
+    }
+
+    // [abc], [a-z], [!0-9] or [^0-9]. Returns false if there is no closing ']'
+    // (then '[' is an ordinary character).
+    bool parse_class(size_t &i, bool chars[256])
+    {
+        size_t j = i + 1;
+        bool negate = false;
+        if (j < pattern_.size() && (pattern_[j] == '!' || pattern_[j] == '^'))
+        {
+            negate = true;
+            j++;
+        }
+        bool set[256] = {false};
+        bool first = true;
+        for (; j < pattern_.size(); j++)
+        {
+            unsigned char c = pattern_[j];
+            if (c == ']' && !first)
+                break;
+            first = false;
+            if (c == '\\' && j + 1 < pattern_.size())
+                c = pattern_[++j];
+            if (j + 2 < pattern_.size() && pattern_[j + 1] == '-' && pattern_[j + 2] != ']')
+            {
+                unsigned char last = pattern_[j + 2];
+                for (int k = c; k <= last; k++)
+                    set[k] = true;
+                j += 2;
+            }
+            else
+            {
+                set[c] = true;
+            }
+        }
+        if (j >= pattern_.size())
+            return false;
+
+        for (int k = 1; k < 256; k++)
+            chars[k] = negate ? !set[k] : set[k];
+        chars['/'] = false;
+        i = j + 1;
+        return true;
+    }
+};
+
+// ------------------- directory walking -------------------
+
+struct DirEntry
+{
+    string name;
+    unsigned char type; // d_type from readdir(), DT_UNKNOWN if the filesystem doesn't tell
+};
+
+// A directory as read by readdir(), with its modification time and size at that moment
+struct DirListing
+{
+    struct timespec mtime;
+    off_t size;
+    vector<DirEntry> entries;
+};
+
+// listings of the directories read since the last clear_glob_cache(), by (st_dev, st_ino):
+// a name like "" (the current directory) means another directory after a "cd"
+static map<pair<dev_t, ino_t>, DirListing> dirCache;
+
+void clear_glob_cache()
+{
+    dirCache.clear();
+}
+
+static const vector<DirEntry> &list_dir(const string &dir)
+{
+    // A command earlier in the same line may have added or removed files
+    // ("touch b; echo *"): then the directory's mtime changed and it is read again.
+    // That costs one stat() instead of reading the whole directory.
+    static const vector<DirEntry> none;
+    struct stat st;
+    if (stat(dir.empty() ? "." : dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+        return none;
+    auto it = dirCache.find({st.st_dev, st.st_ino});
+    if (it != dirCache.end() && it->second.mtime.tv_sec == st.st_mtim.tv_sec &&
+        it->second.mtime.tv_nsec == st.st_mtim.tv_nsec && it->second.size == st.st_size)
+        return it->second.entries;
+
+    DirListing &listing = dirCache[{st.st_dev, st.st_ino}];
+    listing.mtime = st.st_mtim;
+    listing.size = st.st_size;
+    vector<DirEntry> &entries = listing.entries;
+    entries.clear();
+    DIR *d = opendir(dir.empty() ? "." : dir.c_str());
+    if (d)
+    {
+        struct dirent *ent;
+        while ((ent = readdir(d)) != NULL)
+        {
+            if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+                continue;
+            entries.push_back({ent->d_name, ent->d_type});
+        }
+        closedir(d);
+    }
+    return entries;
+}
+
+static bool is_directory(const string &path, unsigned char type)
+{
+    if (type != DT_UNKNOWN && type != DT_LNK)
+        return type == DT_DIR;
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool has_glob_chars(const string &pattern)
+{
+    for (size_t i = 0; i < pattern.size(); i++)
+    {
+        if (pattern[i] == '\\')
+            i++;
+        else if (pattern[i] == '*' || pattern[i] == '?')
+            return true;
+        else if (pattern[i] == '[' && pattern.find(']', i + 2) != string::npos)
+            return true; // a '[' without a ']' (like the command "[") is an ordinary character
+    }
+    return false;
+}
+
+// removes the backslashes of a component without glob characters
+static string unescape(const string &text)
+{
+    string out;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] == '\\' && i + 1 < text.size())
+            i++;
+        out += text[i];
+    }
+    return out;
+}
+
+// Matches components[idx...] below 'base' ("" or a path ending with '/')
+static void glob_walk(const string &base, const vector<string> &components, size_t idx,
+                      vector<string> &out)
+{
+    const string &comp = components[idx];
+    bool last = (idx + 1 == components.size());
+    string dir = base.empty() ? "" : base.substr(0, base.size() - 1);
+    if (base == "/")
+        dir = "/";
+
+    if (comp == "**")
+    {
+        // zero directories...
+        glob_walk(base, components, idx + 1, out);
+        // ...or one more directory (hidden ones are skipped, like for '*')
+        for (const DirEntry &e : list_dir(dir))
+        {
+            if (e.name[0] != '.' && e.type != DT_LNK && is_directory(base + e.name, e.type))
+                glob_walk(base + e.name + "/", components, idx, out);
+        }
+        return;
+    }
+
+    if (!has_glob_chars(comp))
+    {
+        string path = base + unescape(comp);
+        if (last)
+        {
+            struct stat st;
+            if (lstat(path.c_str(), &st) == 0)
+                out.push_back(path);
+        }
+        else
+        {
+            glob_walk(path + "/", components, idx + 1, out);
+        }
+        return;
+    }
+
+    GlobMatcher matcher(comp);
+    for (const DirEntry &e : list_dir(dir))
+    {
+        if (!matcher.matches(e.name.c_str()))
+            continue;
+        if (last)
+            out.push_back(base + e.name);
+        else if (is_directory(base + e.name, e.type))
+            glob_walk(base + e.name + "/", components, idx + 1, out);
+    }
+}
+
+vector<string> glob_expand(const string &pattern)
+{
+    vector<string> components;
+    string comp;
+    for (size_t i = 0; i < pattern.size(); i++)
+    {
+        if (pattern[i] == '\\' && i + 1 < pattern.size())
+        {
+            comp += pattern.substr(i, 2);
+            i++;
+        }
+        else if (pattern[i] == '/')
+        {
+            if (!comp.empty())
+                components.push_back(comp);
+            comp.clear();
+        }
+        else
+        {
+            comp += pattern[i];
+        }
+    }
+    if (!comp.empty())
+        components.push_back(comp);
+    if (components.empty())
+        return {};
+    if (components.back() == "**")
+        components.push_back("*"); // a trailing ** means everything below
+
+    vector<string> out;
+    glob_walk(pattern[0] == '/' ? "/" : "", components, 0, out);
+    sort(out.begin(), out.end());
+    out.erase(unique(out.begin(), out.end()), out.end());
+    return out;
+}
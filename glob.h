@@ -0,0 +1,33 @@
+/*
+   glob.h
+   Header file for filename generation: brace expansion ({a,b}, {1..5}) and
+   glob patterns (*, ?, [...], **).
+*/
+
+#ifndef GLOB_H
+#define GLOB_H
+
+#include <string>
+#include <vector>
+
+// Brace expansion of one word as typed by the user:
+//   "file.{c,h}" -> ["file.c", "file.h"],  "v{1..3}" -> ["v1", "v2", "v3"]
+// Braces inside quotes and ${VAR} are left alone. A word without braces is returned as is.
+std::vector<std::string> brace_expand(const std::string &word);
+
+// true if the pattern has a * ? or [...] which is not escaped with a backslash
+bool has_glob_chars(const std::string &pattern);
+
+// Returns the paths matching the pattern, sorted. Empty if nothing matches.
+// A backslash in the pattern makes the next character literal.
+// "**" as a whole path component matches any number of directories.
+std::vector<std::string> glob_expand(const std::string &pattern);
+
+// Forgets the directory listings read by glob_expand(). While the cache is kept, several
+// patterns over the same directory (e.g. "rm *.log *.tmp") read that directory only once.
+// execute_line() calls it once for every command line typed. The listings are kept by
+// the directory's device and inode (after a "cd", "*" names another directory), and one
+// is read again when the directory was changed since (its mtime or size differs).
+void clear_glob_cache();
+
+#endif
@@ -1,50 +1,270 @@
 #include "io.h"
-#include "parser.h" // to use parse_pipeline
+#include "parser.h"  // to use parse_pipeline
+#include "fileops.h" // for the in-shell cat
+#include "pipes.h"   // for pipe capacity and pipestat
+#include "expand.h"  // for expand_words()
+#include "builtins.h"
+#include "launch.h"  // for exec_command()
+#include "metrics.h" // for the shellstat counters
+#include "textscan.h" // grep / wc as the last stage run in the shell
+#include "suggest.h"  // for command_missing(), report_missing_command()
+#include "redirect.h" // for apply_redirections()
+#include "fanout.h"   // for "producer | (consumer) (consumer)"
+#include "script.h"  // for the parsed command tree and shell functions
+#include "vars.h"    // for lastStatus
+#include "eventloop.h" // for wait_foreground()
+#include "jobs.h"    // for add_job()
+#include "glob.h"    // for clear_glob_cache()
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sys/mman.h> // for memfd_create()
 #include <fcntl.h>
+#include <csignal>
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
 
 using namespace std;
 
-void execute_pipeline(vector<vector<char *>> commands,
-                      char *outputFile,
-                      char *inputFile,
-                      bool append);
+// converts an execvp-style argv (ending with NULL) into a vector of strings
+static vector<string> argv_to_strings(const vector<char *> &args)
+{
+    vector<string> result;
+    for (char *arg : args)
+    {
+        if (arg != nullptr)
+            result.push_back(arg);
+    }
+    return result;
+}
+
+// Free memory allocated by strdup() in parser.cpp
+static void free_args(vector<char *> &args)
+{
+    for (auto arg : args)
+    {
+        if (arg != nullptr)
+            free(arg);
+    }
+}
+
+// Replaces the words of an execvp-style argv by their expansions (see expand_words())
+static void expand_argv(vector<char *> &args)
+{
+    vector<string> words = argv_to_strings(args);
+    free_args(args);
+    args.clear();
+    for (const string &word : expand_words(words))
+        args.push_back(strdup(word.c_str()));
+    args.push_back(nullptr);
+}
+
+// Runs "cat ... < in > out" inside the shell: the redirections are applied to the
+// shell's own fds for the time of the copy, and the kernel copies the data straight
+// between the files, so no fork() or exec() is needed.
+// Returns false if this cat has to be run as the external /bin/cat instead.
+static bool run_cat_redirected(vector<char *> &args, const vector<Redirection> &redirections)
+{
+    vector<string> argv = argv_to_strings(args);
+    if (argv.empty() || argv[0] != "cat" || !cat_supported(argv, -1)) // -1: only the options are checked
+        return false;
+    if (opens_fifo(redirections))
+        return false; // opening it may wait for the other end, which /bin/cat can do
+
+    vector<SavedFd> saved;
+    if (!apply_redirections(redirections, &saved)) // written in redirect.cpp
+    {
+        restore_fds(saved);
+        free_args(args);
+        lastStatus = 1;
+        return true;
+    }
+    if (!cat_supported(argv, STDIN_FILENO))
+    {
+        restore_fds(saved); // it would read the terminal, which only /bin/cat can do
+        return false;
+    }
+    lastStatus = run_cat(argv, STDIN_FILENO, STDOUT_FILENO);
+    restore_fds(saved);
+    free_args(args);
+    return true;
+}
 
-// This function has been used in main.cpp.
+// Runs a builtin or shell function with its redirections inside the shell.
+// Every fd the redirections change is saved first (with a close-on-exec copy),
+// the redirections are applied to the shell's own fds while the command runs,
+// and the saved fds are put back afterwards, also if the builtin fails.
+// Returns false if the command is not a builtin / function, then it has to be forked as before.
+static bool run_builtin_redirected(vector<char *> &args, const vector<Redirection> &redirections)
+{
+    vector<string> argv = argv_to_strings(args);
+    size_t first = 0; // the command name comes after any NAME=value words
+    string name, value;
+    while (first < argv.size() && split_assignment(argv[first], name, value))
+        first++;
+    if (!argv.empty() && argv.back() == "&")
+        return false; // a background job needs its own process
+    bool function = first < argv.size() && is_shell_function(argv[first]);
+    if (first < argv.size() && !is_builtin(argv[first]) && !function)
+        return false;
+    if (function && first > 0)
+        return false; // "X=1 f > out": in a child, X never reaches the shell
+    if (first < argv.size() && (argv[first] == "cat" || argv[first] == "cp"))
+        return false; // handled by run_cat_redirected(), or they run /bin/cat, /bin/cp anyway
+    if (first < argv.size() && (argv[first] == "grep" || argv[first] == "wc") && opens_fifo(redirections))
+        return false; // opening the FIFO may wait for the other end, a child can be stopped there
+
+    vector<SavedFd> saved;
+    if (!apply_redirections(redirections, &saved)) // e.g. the file can't be created
+    {
+        restore_fds(saved);
+        free_args(args);
+        lastStatus = 1;
+        return true;
+    }
+    try
+    {
+        if (function)
+            call_function(argv); // written in script.cpp
+        else
+            handleBuiltinCommands(argv); // written in builtins.cpp
+    }
+    catch (...)
+    {
+        restore_fds(saved); // if a builtin throws (e.g. bad_alloc), the shell's stdout must come back
+        free_args(args);
+        throw;
+    }
+    restore_fds(saved);
+    free_args(args);
+    return true;
+}
+
+// Prints "command not found" for a command which will not be started, to its own
+// stderr: "nosuch 2>/dev/null" prints nothing, like in bash. Returns the status for $?.
+static int report_missing_redirected(vector<char *> &args, const vector<Redirection> &redirections)
+{
+    vector<SavedFd> saved;
+    bool applied = apply_redirections(redirections, &saved);
+    if (applied)
+        report_missing_command(args.data()); // written in suggest.cpp
+    restore_fds(saved);
+    return applied ? 127 : 1;
+}
+
+// This function is used by execute_command().
 // It parses the command, and decides :
 // whether to call execute_with_redirection() or execute_pipeline().
 // If the command contains redirection or pipeline, then it executes them accordingly and returns true.
 // If no redirection, pipeline is found in the command, it returns false.
-bool try_redirection_or_pipeline(const string &input_line)
+bool try_redirection_or_pipeline(const vector<vector<string>> &stages)
 {
+    // "producer | (consumer 1) (consumer 2)": the output goes to every consumer (fanout.cpp)
+    if (stages.size() > 1 && is_fanout_stage(stages.back()))
+    {
+        run_fanout(vector<vector<string>>(stages.begin(), stages.end() - 1), stages.back());
+        return true;
+    }
+
     vector<vector<char *>> cmds;
-    char *outFile; // output file if > or >> specified
-    char *inFile;  // input file if < specified
-    bool append;   // it is a flag, it will be true if >> is present in the command, false if > this present
+    vector<vector<Redirection>> redirections; // the redirections of every command, in order
 
-    // Break the command into argv-like chunks and detect <, >, >>
-    parse_pipeline(input_line, cmds, outFile, append, inFile); // in parser.cpp
+    // Detect <, >, >>, 2>, 2>&1, &>, <<, <<<, ... in the words and build argv-like chunks
+    if (!parse_pipeline(stages, cmds, redirections)) // in parser.cpp
+    {
+        lastStatus = 2; // a syntax error, it was printed already
+        return true;
+    }
 
     if (cmds.empty())
         return false;
 
+    if (cmds.size() == 1 && redirections[0].empty())
+    {
+        // this command contains neither redirection not pipes,
+        // so it should be processed normally like a single command through builtins.cpp
+        free_args(cmds[0]);
+        return false;
+    }
+
+    // Expand the words only now that we know we run them here: expansion
+    // may start processes (<(cmd)), so it must happen exactly once.
+    for (auto &cmd : cmds)
+        expand_argv(cmd);
+    for (auto &list : redirections)
+        expand_redirections(list); // written in redirect.cpp
+
     if (cmds.size() > 1) // If it contains multiple commands, then it needs to be executed through pipeline
     {
-        execute_pipeline(cmds, outFile, inFile, append);
-        return true;
+        execute_pipeline(cmds, redirections);
     }
-    else if (outFile != nullptr || inFile != nullptr) // If it contains a single command with Redirection only
+    else // If it contains a single command with Redirection only
     {
-        execute_with_redirection(cmds[0], inFile, outFile, append);
-        return true;
+        // "cat" is copied inside the shell, builtins and functions run inside the shell
+        // with their fds swapped, everything else is forked & exec'd
+        if (!run_cat_redirected(cmds[0], redirections[0]) &&
+            !run_builtin_redirected(cmds[0], redirections[0]))
+            execute_with_redirection(cmds[0], redirections[0]);
     }
-    else // this command contains neither redirection not pipes,
-    {    // so it should be processed normally like a single command through main.cpp->builtins.cpp
-        return false;
+
+    // the here-documents have been read (or inherited by the children)
+    for (auto &list : redirections)
+        close_redirections(list);
+    return true;
+}
+
+void execute_command(const vector<vector<string>> &stages)
+{
+    count_stat(STAT_COMMANDS);
+    if (!try_redirection_or_pipeline(stages)) // the command has no redirection/pipes
+    {
+        vector<string> args = expand_words(stages[0]);
+        if (!args.empty() && is_shell_function(args[0]))
+        {
+            call_function(args); // written in script.cpp
+        }
+        else if (!args.empty())
+        {
+            // a builtin, or a program (a missing one is reported there, see suggest.cpp)
+            handleBuiltinCommands(args); // written in builtins.cpp
+        }
+    }
+
+    // the command is done, so its process substitutions get end of file / SIGPIPE now
+    close_procsubs();
+}
+
+// Runs one line typed by the user. The line is parsed once into a tree (script.cpp),
+// so the commands inside loops and functions are not lexed again on every run.
+// Used by main() and by child shells, e.g. the command of a process substitution.
+void execute_line(const string &line)
+{
+    // The glob cache lives for one command line: lines run inside it (a builtin in
+    // $(...), watch, ...) keep using it
+    static int depth = 0;
+    if (depth == 0)
+        clear_glob_cache();
+
+    shared_ptr<Node> tree;
+    string error;
+    long long parseStart = metrics_now_us();
+    ParseResult result = parse_script(line, tree, error);
+    record_latency(HIST_PARSE, metrics_now_us() - parseStart);
+    if (result == PARSE_INCOMPLETE)
+    {
+        cerr << "syntax error: unexpected end of input" << endl;
+        lastStatus = 2;
+        return;
+    }
+    if (result == PARSE_ERROR)
+    {
+        cerr << "syntax error: " << error << endl;
+        lastStatus = 2;
+        return;
     }
+    depth++;
+    run_node(*tree);
+    depth--;
 }
 
 /*
@@ -65,19 +285,25 @@ Data can then be read from pipefd[0] by another process.
 // Example: "cat file.txt | grep hello > out.txt"
 // Each command runs in its own process, with stdout of one
 // connected to stdin of the next by using pipe structure.
-// It handles optional input redirection on the first command,
-// and output redirection on the last command.
+// Every command can have its own redirections ("make 2>&1 | grep error > log"), which
+// are applied in its child after stdin / stdout were connected to the pipes.
 // Input parameters:
 // -commands: its a (vector of (vector of strings)),
 //            where each vector in it contains the tokens of every command in the given pipelined statement
-// -input file
-// -output file
-// -append flag
+// -redirections: the redirections of each command, in the order they were written
 void execute_pipeline(vector<vector<char *>> commands,
-                      char *outputFile,
-                      char *inputFile,
-                      bool append)
+                      const vector<vector<Redirection>> &redirections)
 {
+    // "pipesize 1M -- cmd1 | cmd2" sets the capacity of this pipeline's pipes only
+    int capacity = take_pipesize_prefix(commands[0]);
+    if (capacity < 0 || commands[0][0] == nullptr)
+    {
+        for (auto &cmd : commands)
+            free_args(cmd);
+        lastStatus = (capacity < 0) ? 1 : 0;
+        return;
+    }
+
     int num_cmds = commands.size(); // total number of commands in pipelined statement
     int in_fd = STDIN_FILENO;       // in this we will store the file descriptor for the current input file
                                     // Here we are setting its initial value = STDIN (i.e. 0)
@@ -86,17 +312,48 @@ void execute_pipeline(vector<vector<char *>> commands,
                                     // Then, we will change the value of this file descriptor to
                                     // the output file of the previous command in the pipeline.
 
-    // If input redirection exists for the first command,
-    // then open file and set as stdin for first command
-    if (inputFile != nullptr)
+    // If the first command is "cat" and it only has "< file" / here-documents, the shell
+    // itself copies the data into the first pipe (with splice()), so that stage needs
+    // neither fork() nor exec(). Its input files are opened here, the last one is read.
+    vector<string> first_args = argv_to_strings(commands[0]);
+    bool cat_in_shell = (!first_args.empty() && first_args[0] == "cat" &&
+                         redirects_only(redirections[0], STDIN_FILENO) && !opens_fifo(redirections[0]) &&
+                         cat_supported(first_args, -1));
+    int cat_in = STDIN_FILENO; // input of the in-shell cat
+    int cat_out = -1;          // write end of the first pipe, used by the in-shell cat
+    for (size_t r = 0; cat_in_shell && r < redirections[0].size(); r++)
     {
-        in_fd = open(inputFile, O_RDONLY);
-        if (in_fd < 0)
+        int fd = open_redirection(redirections[0][r]); // close-on-exec, see redirect.cpp
+        if (cat_in != STDIN_FILENO)
+            close(cat_in);
+        if (fd < 0)
         {
-            perror("Error occurred in opening the input file.");
+            for (auto &cmd : commands)
+                free_args(cmd);
+            lastStatus = 1;
             return;
         }
+        cat_in = fd;
+    }
+    if (cat_in_shell && !cat_supported(first_args, cat_in))
+    {
+        cat_in_shell = false; // it would read the terminal, so /bin/cat does it
+        if (cat_in != STDIN_FILENO)
+            close(cat_in);
+        cat_in = STDIN_FILENO;
     }
+
+    // If the last command is a grep / wc we can run and its only redirections are "> file",
+    // the shell reads the last pipe itself. Not together with the in-shell cat: the shell
+    // can't write the first pipe and read the last one at the same time.
+    vector<string> last_args = argv_to_strings(commands[num_cmds - 1]);
+    bool scan_in_shell = (num_cmds > 1 && !cat_in_shell && redirects_only(redirections.back(), STDOUT_FILENO) &&
+                          !opens_fifo(redirections.back()) && scan_supported(last_args, -1));
+    int scan_in = -1; // read end of the last pipe, used by the in-shell grep / wc
+
+    vector<pid_t> pids; // all forked children, they are waited for after every stage has started
+    int missing_status = -1; // $? if the last command does not exist (127)
+    long long spawned = metrics_now_us();
     int i;
 
     // Iterate over all the commands in pipeline
@@ -105,59 +362,73 @@ void execute_pipeline(vector<vector<char *>> commands,
         int pipefd[2]; // creating an array to store the current pipe's input file descriptor & pipe's output file descriptor
         if (i < num_cmds - 1)
         {
-            if (pipe(pipefd) < 0) // we will create a pipe for all commands except the last command in the pipeline
+            if (open_pipeline_pipe(pipefd, i, capacity) < 0) // we will create a pipe for all commands except the last command in the pipeline
             {
                 perror("error in creating a pipe");
-                return;
+                break;
             }
         }
 
+        if (i == 0 && cat_in_shell)
+        {
+            // don't fork for cat, just remember its output until the other stages are running
+            cat_out = pipefd[1];
+            in_fd = pipefd[0];
+            continue;
+        }
+        if (i == num_cmds - 1 && scan_in_shell)
+        {
+            // don't fork for grep / wc, it runs once every other stage has started
+            scan_in = in_fd;
+            in_fd = STDIN_FILENO;
+            continue;
+        }
+
+        if (command_missing(commands[i].data()))
+        {
+            // no process for this stage: the next one just sees end of file
+            int status = report_missing_redirected(commands[i], redirections[i]);
+            if (i < num_cmds - 1)
+                close(pipefd[1]);
+            if (in_fd != STDIN_FILENO)
+                close(in_fd);
+            if (i < num_cmds - 1)
+                in_fd = pipefd[0];
+            if (i == num_cmds - 1)
+                missing_status = status;
+            continue;
+        }
+
         pid_t pid = fork(); // fork a process for this command
         if (pid == 0)       // CHILD PROCESS
         {
-            // Redirect stdin from previous input (file or pipe) to current input source
+            // The in-shell cat's fds belong to the shell only (if a child kept the write
+            // end open, the next command would never see end of file). The shell opens
+            // them close-on-exec, so exec() closes them in the child.
+
+            // Redirect stdin from previous input (pipe) to current input source
             if (in_fd != STDIN_FILENO)
             {
                 dup2(in_fd, STDIN_FILENO);
                 close(in_fd);
             }
 
-            // Redirect stdout to pipe OR file as given by the user in this command
+            // If it is not the last command, then STDOUT goes to pipe's WRITE end
             if (i < num_cmds - 1)
             {
-                // If it is not the last command, then STDOUT goes to pipe's WRITE end
                 dup2(pipefd[1], STDOUT_FILENO);
                 close(pipefd[0]); // close pipe's input end
                 close(pipefd[1]); // now there are 2 file descriptors pointing to STDOUT, so we close one of them
                 // We can't close STDOUT because all the system functions have been defined to write their output to STDOUT
             }
-            else
-            {
-                // If it is the last command, then output redirection is optional i.e. the user may/may not give it
-                if (outputFile != nullptr) // If there is output redirection
-                {
-                    int fd_out;
-                    if (append)                                                         // if ">>" was given in the command
-                        fd_out = open(outputFile, O_WRONLY | O_CREAT | O_APPEND, 0644); // opening the file with APPEND flag
-                    else                                                                // if ">" was given in the command
-                        fd_out = open(outputFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);  // opening the file without APPEND, so a new file will be created
-                    if (fd_out < 0)
-                    {
-                        perror("error in opening the output file");
-                        exit(1);
-                    }
-                    dup2(fd_out, STDOUT_FILENO); // Now, whatever will be meant to be written to STDOUT, will be written to the pipe's output
-                    close(fd_out);               // as of now, STDOUT has 2 file descriptors so close one of them
-                    // We can't close STDOUT because all the system functions have been defined to write their output to STDOUT
-                }
-            }
 
-            // Execute command
-            if (execvp(commands[i][0], commands[i].data()) < 0)
-            {
-                perror("Error in executing execvp()");
+            // then this command's own redirections, in order: "2>&1" after the pipe
+            // was connected sends stderr into the pipe too
+            if (!apply_redirections(redirections[i], nullptr)) // written in redirect.cpp
                 exit(1);
-            }
+
+            // Execute command (searches $PATH and passes the exported variables, see launch.cpp)
+            exec_command(commands[i].data());
         } // child process end
         else // PARENT PROCESS
         {
@@ -168,10 +439,80 @@ void execute_pipeline(vector<vector<char *>> commands,
             if (i < num_cmds - 1)
                 in_fd = pipefd[0]; // next command will read from pipe
 
-            waitpid(pid, NULL, 0); // wait for child process to finish
+            if (pid > 0)
+                pids.push_back(pid);
+            else
+                perror("fork failed");
+        }
+    }
+    // if the loop stopped early because pipe() failed, the last read end is still open
+    if (i < num_cmds && in_fd != STDIN_FILENO)
+        close(in_fd);
+
+    if (cat_in_shell && cat_out == -1 && cat_in != STDIN_FILENO)
+        close(cat_in); // not even the first pipe could be made
+    if (cat_in_shell && cat_out != -1)
+    {
+        // All readers are running now, so cat can't block forever on a full pipe.
+        // If a reader exits early ("cat big | head"), the write fails with EPIPE
+        // instead of SIGPIPE killing the shell.
+        void (*old_handler)(int) = signal(SIGPIPE, SIG_IGN);
+        if (i == num_cmds)
+            run_cat(first_args, cat_in, cat_out);
+        signal(SIGPIPE, old_handler);
+        close(cat_out); // the next command sees end of file
+        if (cat_in != STDIN_FILENO)
+            close(cat_in);
+    }
+
+    int scan_status = -1;
+    if (scan_in_shell && scan_in != -1)
+    {
+        // "> file" / ">> file" of the last command: the last one opened gets the output
+        int out_fd = STDOUT_FILENO;
+        for (const Redirection &redirection : redirections.back())
+        {
+            if (out_fd != STDOUT_FILENO)
+                close(out_fd);
+            out_fd = open_redirection(redirection);
+            if (out_fd < 0)
+                break;
+        }
+        if (out_fd < 0)
+            scan_status = 1;
+        else
+        {
+            scan_status = run_scan(last_args, scan_in, out_fd); // written in textscan.cpp
+            if (out_fd != STDOUT_FILENO)
+                close(out_fd);
         }
+        close(scan_in); // a writer still running gets SIGPIPE, like with a real grep
     }
 
+    // Wait only after every command has started: waiting for each command before
+    // starting the next one deadlocks as soon as a command writes more than a pipe can hold.
+    // The exit status of a pipeline is the one of its last command.
+    lastStatus = 0;
+    for (size_t k = 0; k < pids.size(); k++)
+    {
+        int status = 0;
+        waitpid(pids[k], &status, 0);
+        if (k + 1 == pids.size())
+            lastStatus = exit_code(status);
+    }
+    if (scan_status != -1)
+        lastStatus = scan_status; // the last command ran in the shell
+    if (missing_status != -1)
+        lastStatus = missing_status;
+    if (!pids.empty())
+        record_latency(HIST_SPAWN_TO_EXIT, metrics_now_us() - spawned);
+
+    // in pipestat mode, print how much data went through each pipe
+    vector<string> names;
+    for (auto &cmd : commands)
+        names.push_back(cmd[0] ? cmd[0] : "");
+    finish_pipeline_pipes(names);
+
     // Free memory allocated by strdup() in parser.cpp
     for (auto &cmd : commands)
     {
@@ -184,67 +525,59 @@ void execute_pipeline(vector<vector<char *>> commands,
 }
 
 // ------------------- execute_with_redirection() -------------------
-// This function executes a single command with optional redirection (<, >, >>).
-// Example: "sort < in.txt > out.txt"
+// This function executes a single command with its redirections.
+// Example: "sort < in.txt > out.txt 2> errors.txt"
 // Steps:
 // 1. Fork a child process.
-// 2. In the child, if < was specified, dup2() the input file to stdin.
-// 3. If > or >> was specified, dup2() the output file to stdout.
-// 4. Call execvp() to execute the command.
-// 5. Parent waits for child to finish.
+// 2. In the child, apply the redirections in the order they were written
+//    (open the files and dup2() them onto the fds, see redirect.cpp).
+// 3. Call execvp() to execute the command.
+// 4. Parent waits for child to finish.
 void execute_with_redirection(vector<char *> args,
-                              char *inputFile,
-                              char *outputFile,
-                              bool append)
+                              const vector<Redirection> &redirections)
 {
+    if (command_missing(args.data()))
+    {
+        // nothing is started, the message goes to the command's stderr
+        lastStatus = report_missing_redirected(args, redirections);
+        free_args(args);
+        return;
+    }
+
+    // "cmd > log 2>&1 &" runs in the background, the "&" is not an argument
+    bool background = false;
+    if (args.size() >= 2 && args[args.size() - 2] != nullptr && strcmp(args[args.size() - 2], "&") == 0)
+    {
+        background = true;
+        free(args[args.size() - 2]);
+        args.erase(args.end() - 2);
+    }
+
+    long long spawned = metrics_now_us();
     pid_t pid = fork(); // create a child process
 
     if (pid == 0) // CHILD PROCESS
     {
-        // If input redirection exists ("< file")
-        if (inputFile != nullptr)
-        {
-            int fd_in = open(inputFile, O_RDONLY); // open file for reading
-            if (fd_in < 0)
-            {
-                perror("open input");
-                exit(1);
-            }
-            dup2(fd_in, STDIN_FILENO); // replace stdin (fd=0) with file
-            close(fd_in);              // close original fd since it's duplicated
-        }
-
-        // If output redirection exists (> or >>)
-        if (outputFile != nullptr)
-        {
-            int fd_out;
-            if (append)                                                         // If ">>" is presnt
-                fd_out = open(outputFile, O_WRONLY | O_CREAT | O_APPEND, 0644); // opening the file in append mode
-            // so the new contents will only get appended to the old contents of thw input file
-            else                                                               // If ">" is presnt
-                fd_out = open(outputFile, O_WRONLY | O_CREAT | O_TRUNC, 0644); // opening the file in append mode,
-            // so all old contents will get odeleted and the file will be created afresh
-            if (fd_out < 0)
-            {
-                perror("error in writing to output file");
-                exit(1);
-            }
-            dup2(fd_out, STDOUT_FILENO); // replace stdout (fd=1) with file
-            close(fd_out);               // now 2 descriptors point to this output file: STDOUT  & fd_out. So we can close fd_out.
-            // We can't close STDOUT because all the system functions have been defined to write their output to STDOUT
-        }
+        // "< in", "> out", "2>&1", "3<> file", "<< EOF", ... (written in redirect.cpp)
+        if (!apply_redirections(redirections, nullptr))
+            exit(1);
 
         // Run the command
-        if (execvp(args[0], args.data()) < 0)
-        {
-            perror("execvp");
-            exit(1);
-        }
+        exec_command(args.data());
+    }
+    else if (background && pid > 0) // PARENT PROCESS, the job is reaped by reap_jobs() later
+    {
+        int job = add_job(pid, args[0] ? args[0] : "", false);
+        cout << "[" << job << "] " << pid << endl;
+        lastStatus = 0;
     }
     else // PARENT PROCESS
     {
 
-        waitpid(pid, NULL, 0); // wait for child to finish
+        // wait for child to finish (Ctrl+Z turns it into a stopped job)
+        lastStatus = (pid > 0) ? wait_foreground(pid, args[0] ? args[0] : "") : 1;
+        if (pid > 0)
+            record_latency(HIST_SPAWN_TO_EXIT, metrics_now_us() - spawned);
     }
 
     // Free memory allocated by strdup() in parser.cpp
@@ -254,3 +587,32 @@ void execute_with_redirection(vector<char *> args,
             free(arg);
     }
 }
+
+// ------------------- open_memfd_input() -------------------
+// Here-documents and here-strings live in an anonymous memory file instead of a
+// temp file: nothing touches the disk and there is no file to clean up.
+// The memfd is sealed so the command can't change it, and it can be lseek()'d
+// (unlike a pipe), so commands that seek in their input also work.
+int open_memfd_input(const string &text)
+{
+    int fd = memfd_create("heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+        return -1;
+
+    size_t done = 0;
+    while (done < text.size())
+    {
+        ssize_t w = write(fd, text.data() + done, text.size() - done);
+        if (w < 0)
+        {
+            close(fd);
+            return -1;
+        }
+        done += w;
+    }
+
+    // no more writes, and the size can't change anymore
+    fcntl(fd, F_ADD_SEALS, F_SEAL_WRITE | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+    lseek(fd, 0, SEEK_SET); // commands start reading at the beginning
+    return fd;
+}
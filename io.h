@@ -3,20 +3,31 @@
 
 #include <vector>
 #include <string>
+#include "redirect.h" // for struct Redirection
 
-// Execute a single command with optional redirection (<, >, >>)
+// Execute a single command with its redirections (2>, 2>&1, <<, ... see redirect.h),
+// applied in the child. The here-document memfds stay open, the caller closes them.
 void execute_with_redirection(std::vector<char *> args,
-                              char *inputFile,
-                              char *outputFile,
-                              bool append);
+                              const std::vector<Redirection> &redirections);
 
-// Execute a pipeline of commands, with optional < input and > / >> output
+// Execute a pipeline of commands; redirections[i] belongs to commands[i] and is applied
+// after its stdin / stdout were connected to the pipes
 void execute_pipeline(std::vector<std::vector<char *>> commands,
-                      char *outputFile,
-                      bool append,
-                      char *inputFile);
+                      const std::vector<std::vector<Redirection>> &redirections);
 
-// function to decide if a command line involves redirection/pipes
-bool try_redirection_or_pipeline(const std::string &input_line);
+// Puts 'text' into an anonymous in-memory file (memfd), seals it against changes and
+// returns an fd positioned at the start, ready to be used as stdin. Returns -1 on error.
+int open_memfd_input(const std::string &text);
+
+// function to decide if a command involves redirection/pipes (and to run it if it does).
+// 'stages' are the words of each pipeline stage as typed.
+bool try_redirection_or_pipeline(const std::vector<std::vector<std::string>> &stages);
+
+// Runs one command or pipeline from its words: with redirections and pipes,
+// or as a shell function, builtin or program. Sets lastStatus.
+void execute_command(const std::vector<std::vector<std::string>> &stages);
+
+// Runs a whole command line, which may contain if / while / for / && / || and functions
+void execute_line(const std::string &line);
 
 #endif
@@ -0,0 +1,207 @@
+/*
+jobs.cpp: keeps track of background jobs and process substitutions, and reaps them.
+*/
+
+#include "jobs.h"
+#include "launch.h"    // for exit_code()
+#include "eventloop.h" // for shell_signal_fd()
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <sys/signalfd.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+struct Job
+{
+    int number;     // the [n] printed to the user
+    pid_t pid;
+    string command;
+    bool quiet;     // no "Done" message for this one
+    int pidfd;      // -1 if the kernel has no pidfds
+};
+
+static vector<Job> jobs; // children that have not been reaped yet
+
+static bool job_number_taken(int number)
+{
+    for (const Job &job : jobs)
+    {
+        if (job.number == number)
+            return true;
+    }
+    return false;
+}
+
+int add_job(pid_t pid, const string &command, bool quiet)
+{
+    // use the smallest free job number, like other shells do
+    int number = 1;
+    while (job_number_taken(number))
+        number++;
+    jobs.push_back({number, pid, command, quiet, open_pidfd(pid)});
+    return number;
+}
+
+static void remove_job(size_t index)
+{
+    if (jobs[index].pidfd >= 0)
+        close(jobs[index].pidfd);
+    jobs.erase(jobs.begin() + index);
+}
+
+static int find_job(pid_t pid)
+{
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        if (jobs[i].pid == pid)
+            return (int)i;
+    }
+    return -1;
+}
+
+vector<string> collect_job_notices()
+{
+    vector<string> notices;
+    for (size_t i = 0; i < jobs.size();)
+    {
+        int status;
+        pid_t done = waitpid(jobs[i].pid, &status, WNOHANG | WUNTRACED | WCONTINUED);
+        string prefix = "[" + to_string(jobs[i].number) + "]+ ";
+        if (done == 0) // still running, nothing new
+        {
+            i++;
+            continue;
+        }
+        if (done > 0 && (WIFSTOPPED(status) || WIFCONTINUED(status)))
+        {
+            // e.g. "kill -STOP pid": the job still exists, only its state changed
+            if (!jobs[i].quiet)
+                notices.push_back(prefix + (WIFSTOPPED(status) ? "Stopped" : "Running") + "\t\t" + jobs[i].command);
+            i++;
+            continue;
+        }
+        // done == pid: it finished; done == -1: someone else already reaped it
+        if (!jobs[i].quiet)
+            notices.push_back(prefix + "Done\t\t" + jobs[i].command);
+        remove_job(i);
+    }
+    return notices;
+}
+
+void reap_jobs()
+{
+    for (const string &notice : collect_job_notices())
+        cout << notice << endl;
+}
+
+int open_pidfd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0); // the kernel sets close-on-exec on pidfds
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
+int send_signal(pid_t pid, int pidfd, int sig)
+{
+#ifdef SYS_pidfd_send_signal
+    if (pidfd >= 0)
+        return (int)syscall(SYS_pidfd_send_signal, pidfd, sig, nullptr, 0);
+#else
+    (void)pidfd;
+#endif
+    return kill(pid, sig);
+}
+
+pid_t job_pid(int number)
+{
+    for (const Job &job : jobs)
+    {
+        if (job.number == number)
+            return job.pid;
+    }
+    return -1;
+}
+
+int signal_child(pid_t pid, int sig)
+{
+    int index = find_job(pid);
+    return send_signal(pid, (index >= 0) ? jobs[index].pidfd : -1, sig);
+}
+
+int wait_jobs(vector<pid_t> pids, bool any)
+{
+    if (pids.empty())
+    {
+        for (const Job &job : jobs)
+        {
+            if (!job.quiet)
+                pids.push_back(job.pid);
+        }
+        if (pids.empty())
+            return any ? 127 : 0; // nothing to wait for
+    }
+
+    int lastStatus = 0;
+    while (!pids.empty())
+    {
+        // reap the ones which have finished
+        bool allHavePidfds = true;
+        vector<struct pollfd> fds;
+        for (size_t i = 0; i < pids.size();)
+        {
+            int index = find_job(pids[i]);
+            int status;
+            if (index < 0)
+            {
+                cerr << "wait: pid " << pids[i] << " is not a child of this shell" << endl;
+                lastStatus = 127;
+                pids.erase(pids.begin() + i);
+                continue;
+            }
+            if (waitpid(pids[i], &status, WNOHANG) == pids[i])
+            {
+                lastStatus = exit_code(status);
+                remove_job(index);
+                pids.erase(pids.begin() + i);
+                if (any)
+                    return lastStatus;
+                continue;
+            }
+            if (jobs[index].pidfd >= 0)
+                fds.push_back({jobs[index].pidfd, POLLIN, 0});
+            else
+                allHavePidfds = false;
+            i++;
+        }
+        if (pids.empty())
+            break;
+
+        // sleep until one of them exits (its pidfd gets readable) or Ctrl+C is pressed
+        int signalFd = shell_signal_fd();
+        if (signalFd >= 0)
+            fds.push_back({signalFd, POLLIN, 0});
+        poll(fds.data(), fds.size(), allHavePidfds ? -1 : 50); // without pidfds: look again soon
+        struct signalfd_siginfo info;
+        bool interrupted = false;
+        while (signalFd >= 0 && read(signalFd, &info, sizeof(info)) == sizeof(info))
+        {
+            if (info.ssi_signo == SIGINT)
+                interrupted = true;
+        }
+        if (interrupted)
+        {
+            cout << endl;
+            return 130;
+        }
+    }
+    return lastStatus;
+}
@@ -0,0 +1,46 @@
+/*
+   jobs.h
+   Header file for the children which the shell does not wait for right away:
+   background jobs (&) and process substitutions (<(cmd), >(cmd)).
+*/
+
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <string>
+#include <vector>
+#include <sys/types.h> // for pid_t
+
+// Remembers a child so it gets reaped later. Returns its job number.
+// quiet = true for helpers like process substitutions, which are reaped without a message.
+int add_job(pid_t pid, const std::string &command, bool quiet);
+
+// Reaps every finished job without blocking and returns the notices for the user:
+// "[n]+ Done" for finished background jobs, "[n]+ Stopped" / "[n]+ Running" when one
+// was stopped or continued. Called when SIGCHLD arrives, also while the user is typing.
+std::vector<std::string> collect_job_notices();
+
+// collect_job_notices() and print the notices
+void reap_jobs();
+
+// A pidfd for the child 'pid' (close-on-exec), or -1 if the kernel has none (before 5.3).
+// Taken right after fork(), before the child is reaped, so it always refers to our child.
+int open_pidfd(pid_t pid);
+
+// Sends a signal through the pidfd if there is one (pidfd_send_signal), else with kill().
+// Returns 0 or -1 with errno set.
+int send_signal(pid_t pid, int pidfd, int sig);
+
+// The pid of job [number], or -1
+pid_t job_pid(int number);
+
+// Sends a signal to a child: through its job's pidfd if it is one of our jobs, which can
+// never hit an unrelated process that got the same pid. Returns 0 or -1 with errno set.
+int signal_child(pid_t pid, int sig);
+
+// Waits for jobs and reaps them. pids empty: all background jobs. any: return as soon as
+// one has finished ("wait -n"). Returns the exit status of the last one reaped, 127 if a
+// pid is not one of our jobs (or there is no job for "wait -n"), 130 on Ctrl+C.
+int wait_jobs(std::vector<pid_t> pids, bool any);
+
+#endif
@@ -0,0 +1,130 @@
+/*
+launch.cpp: runs external programs in child processes with the shell's environment.
+*/
+
+#include "launch.h"
+#include "vars.h"   // for command_environment() and PATH
+#include "expand.h" // for keep_procsub_fds()
+#include "script.h" // shell functions run without exec
+#include "policy.h" // for apply_launch_policy()
+#include "metrics.h" // the counters are shared with the shell
+#include <sys/wait.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <iostream>
+
+using namespace std;
+
+// execve() the program, and if it is a script without a "#!" line, run it with /bin/sh
+static void try_exec(const string &path, char **argv, char **envp)
+{
+    execve(path.c_str(), argv, envp);
+    if (errno == ENOEXEC)
+    {
+        int argc = 0;
+        while (argv[argc] != nullptr)
+            argc++;
+        char **shArgv = new char *[argc + 2];
+        shArgv[0] = (char *)"/bin/sh";
+        shArgv[1] = (char *)path.c_str();
+        for (int i = 1; i <= argc; i++)
+            shArgv[i + 1] = argv[i];
+        execve("/bin/sh", shArgv, envp);
+        errno = ENOEXEC;
+    }
+}
+
+void exec_command(char **argv)
+{
+    // "VAR=x cmd": VAR goes into this child's environment only, the shell is not affected
+    vector<string> assignments;
+    string name, value;
+    while (argv[0] != nullptr && split_assignment(argv[0], name, value))
+        assignments.push_back(*argv++);
+
+    // CPU affinity, nice etc. from the policy defaults and a "run ... --" prefix
+    char **command = apply_launch_policy(argv);
+    if (command != argv)
+    {
+        argv = command;
+        while (argv[0] != nullptr && split_assignment(argv[0], name, value)) // "run -- VAR=x cmd"
+            assignments.push_back(*argv++);
+    }
+    if (argv[0] == nullptr)
+        exit(0); // only assignments, nothing to run
+
+    // PATH=... for this command is searched too
+    string path = get_variable("PATH");
+    for (const string &assignment : assignments)
+    {
+        if (split_assignment(assignment, name, value) && name == "PATH")
+            path = value;
+    }
+
+    if (is_shell_function(argv[0]))
+    {
+        // the function runs right here, so it sees the assignments as variables
+        for (const string &assignment : assignments)
+        {
+            split_assignment(assignment, name, value);
+            set_variable(name, value);
+            export_variable(name);
+        }
+        vector<string> args;
+        for (int i = 0; argv[i] != nullptr; i++)
+            args.push_back(argv[i]);
+        call_function(args);
+        cout.flush();
+        exit(lastStatus);
+    }
+
+    count_stat(STAT_EXECS);
+    keep_procsub_fds(argv);
+    // the shell built the environment block before fork(), only the assignments are added here
+    char **envp = command_environment(assignments);
+
+    // a name with a '/' is a path, otherwise look through the directories in $PATH
+    int err = ENOENT;
+    if (strchr(argv[0], '/') != nullptr)
+    {
+        try_exec(argv[0], argv, envp);
+        err = errno;
+    }
+    else
+    {
+        size_t start = 0;
+        while (start <= path.size())
+        {
+            size_t end = path.find(':', start);
+            if (end == string::npos)
+                end = path.size();
+            string dir = path.substr(start, end - start);
+            if (dir.empty())
+                dir = "."; // empty entry means the current directory
+            try_exec(dir + "/" + argv[0], argv, envp);
+            if (errno == EACCES)
+                err = EACCES; // remember it, but a later directory may still have it
+            else if (errno != ENOENT && errno != ENOTDIR)
+            {
+                err = errno;
+                break;
+            }
+            start = end + 1;
+        }
+    }
+
+    count_stat(STAT_EXEC_FAILURES);
+    if (err == ENOENT)
+        cerr << argv[0] << ": command not found" << endl;
+    else
+        cerr << argv[0] << ": " << strerror(err) << endl;
+    exit(err == ENOENT ? 127 : 126);
+}
+
+int exit_code(int waitStatus)
+{
+    if (WIFSIGNALED(waitStatus))
+        return 128 + WTERMSIG(waitStatus);
+    return WEXITSTATUS(waitStatus);
+}
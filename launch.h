@@ -0,0 +1,26 @@
+/*
+   launch.h
+   Header file for starting external programs. Every fork()ed child which runs
+   a program (simple commands, redirections, pipeline stages) ends up here.
+*/
+
+#ifndef LAUNCH_H
+#define LAUNCH_H
+
+#include <string>
+
+// Replaces the current (child) process with the program named by argv[0].
+// Leading "NAME=value" words are assignments for this command only: they are
+// exported in the child before the program starts.
+// The program is searched in the shell's PATH variable and started with the
+// shell's exported variables. Never returns: on failure the child exits with
+// 127 (not found) or 126 (not executable).
+// A shell function named by argv[0] runs in the child itself (e.g. as a pipeline stage).
+// The launch policy (policy.h) is applied first; a "run [options] --" prefix is removed.
+[[noreturn]] void exec_command(char **argv);
+
+// Turns a status from waitpid() into an exit status for $?:
+// the exit code, or 128 + the signal number if the program was killed
+int exit_code(int waitStatus);
+
+#endif
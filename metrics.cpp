@@ -0,0 +1,227 @@
+/*
+metrics.cpp: counters and latency histograms for the shellstat builtin.
+*/
+
+#include "metrics.h"
+#include <sys/mman.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <atomic>
+#include <new>
+#include <iostream>
+#include <iomanip>
+
+using namespace std;
+
+#define SUB_BUCKET_BITS 4 // 16 buckets for every power of two
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define HIST_BUCKETS ((64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS) // enough for any 64-bit value
+
+struct LatencyHistogram
+{
+    atomic<unsigned long long> buckets[HIST_BUCKETS];
+    atomic<unsigned long long> sum;
+    atomic<unsigned long long> max;
+};
+
+struct ShellMetrics
+{
+    atomic<unsigned long long> counters[STAT_COUNTERS];
+    LatencyHistogram histograms[STAT_HISTOGRAMS];
+};
+
+static const char *counterNames[STAT_COUNTERS] = {
+    "commands", "forks", "execs", "exec_failures", "builtins", "history_writes", "completions"};
+static const char *histogramNames[STAT_HISTOGRAMS] = {"spawn_to_exit", "parse"};
+
+static ShellMetrics localMetrics;             // used until init_metrics() (or if mmap() fails)
+static ShellMetrics *metrics = &localMetrics; // the ones being updated
+static long long startedUs;                   // for the uptime
+
+static void count_fork()
+{
+    count_stat(STAT_FORKS);
+}
+
+void init_metrics()
+{
+    startedUs = metrics_now_us();
+    // MAP_SHARED: a forked child updates the same counters as the shell
+    void *memory = mmap(nullptr, sizeof(ShellMetrics), PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory != MAP_FAILED)
+        metrics = new (memory) ShellMetrics(); // the atomics start at 0
+    pthread_atfork(count_fork, nullptr, nullptr);
+}
+
+void count_stat(StatCounter which)
+{
+    metrics->counters[which].fetch_add(1, memory_order_relaxed);
+}
+
+long long metrics_now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+// 0..15 get a bucket each, after that every power of two is split into 16 buckets
+static int bucket_index(unsigned long long value)
+{
+    if (value < SUB_BUCKETS)
+        return (int)value;
+    int exponent = 63 - __builtin_clzll(value); // >= SUB_BUCKET_BITS
+    int sub = (int)((value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+    return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+// the largest value which lands in bucket 'index'
+static unsigned long long bucket_top(int index)
+{
+    if (index < SUB_BUCKETS)
+        return index;
+    int exponent = index / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    unsigned long long width = 1ULL << (exponent - SUB_BUCKET_BITS);
+    unsigned long long low = (unsigned long long)(SUB_BUCKETS + index % SUB_BUCKETS) << (exponent - SUB_BUCKET_BITS);
+    return low + width - 1;
+}
+
+void record_latency(StatHistogram which, long long micros)
+{
+    unsigned long long value = (micros < 0) ? 0 : micros;
+    LatencyHistogram &h = metrics->histograms[which];
+    h.buckets[bucket_index(value)].fetch_add(1, memory_order_relaxed);
+    h.sum.fetch_add(value, memory_order_relaxed);
+    unsigned long long old = h.max.load(memory_order_relaxed);
+    while (value > old && !h.max.compare_exchange_weak(old, value, memory_order_relaxed))
+        ;
+}
+
+// A copy of one histogram, so the numbers printed fit together
+struct HistogramSummary
+{
+    unsigned long long count = 0, sum = 0, max = 0;
+    unsigned long long p50 = 0, p90 = 0, p99 = 0, p999 = 0;
+};
+
+static HistogramSummary summarize(const LatencyHistogram &h)
+{
+    HistogramSummary s;
+    vector<unsigned long long> buckets(HIST_BUCKETS);
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        buckets[i] = h.buckets[i].load(memory_order_relaxed);
+        s.count += buckets[i];
+    }
+    s.sum = h.sum.load(memory_order_relaxed);
+    s.max = h.max.load(memory_order_relaxed);
+
+    // the value below which 'fraction' of the measurements are, rounded up to the bucket's top
+    auto percentile = [&](double fraction)
+    {
+        unsigned long long rank = (unsigned long long)(fraction * s.count + 0.999999);
+        if (rank == 0)
+            rank = 1;
+        unsigned long long seen = 0;
+        for (int i = 0; i < HIST_BUCKETS; i++)
+        {
+            seen += buckets[i];
+            if (seen >= rank)
+                return min(bucket_top(i), s.max);
+        }
+        return s.max;
+    };
+    if (s.count > 0)
+    {
+        s.p50 = percentile(0.50);
+        s.p90 = percentile(0.90);
+        s.p99 = percentile(0.99);
+        s.p999 = percentile(0.999);
+    }
+    return s;
+}
+
+static void print_json()
+{
+    cout << "{\"pid\":" << getpid() << ",\"uptime_us\":" << metrics_now_us() - startedUs << ",\"counters\":{";
+    for (int i = 0; i < STAT_COUNTERS; i++)
+    {
+        cout << (i ? "," : "") << "\"" << counterNames[i] << "\":"
+             << metrics->counters[i].load(memory_order_relaxed);
+    }
+    cout << "},\"latency_us\":{";
+    for (int i = 0; i < STAT_HISTOGRAMS; i++)
+    {
+        HistogramSummary s = summarize(metrics->histograms[i]);
+        cout << (i ? "," : "") << "\"" << histogramNames[i] << "\":{\"count\":" << s.count
+             << ",\"mean\":" << (s.count ? s.sum / s.count : 0) << ",\"p50\":" << s.p50
+             << ",\"p90\":" << s.p90 << ",\"p99\":" << s.p99 << ",\"p999\":" << s.p999
+             << ",\"max\":" << s.max << "}";
+    }
+    cout << "}}" << endl;
+}
+
+static void print_table()
+{
+    for (int i = 0; i < STAT_COUNTERS; i++)
+    {
+        string name = counterNames[i];
+        for (char &c : name)
+            c = (c == '_') ? ' ' : c;
+        cout << left << setw(16) << name << right << metrics->counters[i].load(memory_order_relaxed) << endl;
+    }
+    cout << endl
+         << left << setw(16) << "latency (us)" << right;
+    for (const char *column : {"count", "mean", "p50", "p90", "p99", "p99.9", "max"})
+        cout << setw(10) << column;
+    cout << endl;
+    for (int i = 0; i < STAT_HISTOGRAMS; i++)
+    {
+        HistogramSummary s = summarize(metrics->histograms[i]);
+        string name = histogramNames[i];
+        for (char &c : name)
+            c = (c == '_') ? '-' : c;
+        cout << left << setw(16) << name << right << setw(10) << s.count
+             << setw(10) << (s.count ? s.sum / s.count : 0) << setw(10) << s.p50
+             << setw(10) << s.p90 << setw(10) << s.p99 << setw(10) << s.p999
+             << setw(10) << s.max << endl;
+    }
+}
+
+int shellstat_command(const vector<string> &args)
+{
+    bool json = false, reset = false;
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        if (args[i] == "--json")
+            json = true;
+        else if (args[i] == "--reset")
+            reset = true;
+        else
+        {
+            cerr << "Usage: shellstat [--json] [--reset]" << endl;
+            return 2;
+        }
+    }
+    if (reset)
+    {
+        for (auto &counter : metrics->counters)
+            counter.store(0, memory_order_relaxed);
+        for (auto &h : metrics->histograms)
+        {
+            for (auto &bucket : h.buckets)
+                bucket.store(0, memory_order_relaxed);
+            h.sum.store(0, memory_order_relaxed);
+            h.max.store(0, memory_order_relaxed);
+        }
+        if (!json)
+            return 0;
+    }
+    if (json)
+        print_json();
+    else
+        print_table();
+    return 0;
+}
@@ -0,0 +1,51 @@
+/*
+   metrics.h
+   Header file for the shell's always-on counters and latency histograms, printed by
+   the "shellstat" builtin. Updating one is a single relaxed atomic add, cheap enough
+   for every command, fork and keystroke completion.
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <vector>
+
+// the things which are counted
+enum StatCounter
+{
+    STAT_COMMANDS,       // simple commands and pipelines run
+    STAT_FORKS,          // fork() calls (counted by a pthread_atfork() handler)
+    STAT_EXECS,          // programs the children tried to start
+    STAT_EXEC_FAILURES,  // of those, the ones which could not be started (126 / 127)
+    STAT_BUILTINS,       // builtins which ran inside the shell
+    STAT_HISTORY_WRITES, // commands saved to the history file
+    STAT_COMPLETIONS,    // TAB completions
+    STAT_COUNTERS        // the number of counters, not a counter
+};
+
+// the latencies which are measured, in microseconds
+enum StatHistogram
+{
+    HIST_SPAWN_TO_EXIT, // fork() of a foreground command or pipeline until it was waited for
+    HIST_PARSE,         // parsing one input line into a tree
+    STAT_HISTOGRAMS     // the number of histograms, not a histogram
+};
+
+// Puts the counters in shared memory, so children (e.g. a failing exec) can count too.
+// Call once at startup, before the first fork().
+void init_metrics();
+
+void count_stat(StatCounter which);
+
+// Adds one measurement to a histogram. The buckets are log-linear like an HDR
+// histogram: 16 buckets per power of two, so every value is kept within ~6%.
+void record_latency(StatHistogram which, long long micros);
+
+// a monotonic clock in microseconds, for the measurements above
+long long metrics_now_us();
+
+// "shellstat [--json] [--reset]". Returns the exit status.
+int shellstat_command(const std::vector<std::string> &args);
+
+#endif
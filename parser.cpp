@@ -1,95 +1,410 @@
 /*
-parser.cpp: breaks the input into separate commands & detects <, >, >>, |.
+parser.cpp: breaks the input into separate commands & detects redirections (<, >, >>,
+2>, 2>&1, &>, ...), here-documents (<<, <<<) and |.
+Quoted text and bracketed groups like <(...) are never split.
 */
 
 #include "parser.h"
-#include <sstream>
+#include "io.h"     // for open_memfd_input()
+#include "expand.h" // for expand_words()
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <deque>
 #include <iostream>
 
 using namespace std;
 
+static deque<string> heredocBodies; // bodies of the here-documents of the current line, in order
+
+// removes the quotes of a delimiter: 'EOF', "EOF", E"OF" or \EOF -> EOF
+static string strip_quotes(const string &word)
+{
+    string text;
+    char quote = 0; // the quote we are inside of
+    for (size_t i = 0; i < word.size(); i++)
+    {
+        char c = word[i];
+        if (quote != 0 && c == quote)
+            quote = 0;
+        else if (quote == 0 && (c == '\'' || c == '"'))
+            quote = c;
+        else if (quote == 0 && c == '\\' && i + 1 < word.size())
+            text += word[++i];
+        else
+            text += c;
+    }
+    return text;
+}
+
+bool heredoc_quoted(const string &word)
+{
+    return word.find_first_of("'\"\\") != string::npos;
+}
+
+vector<HeredocSpec> heredoc_delimiters(const string &line)
+{
+    vector<HeredocSpec> result;
+    vector<string> tokens = lex_script(line); // "cat <<EOF; ls" must give the delimiter EOF, not EOF;
+    for (size_t i = 0; i < tokens.size(); i++)
+    {
+        const string &tok = tokens[i];
+        // "<<<" is a here-string, its text is on the same line
+        if (tok.compare(0, 2, "<<") != 0 || tok.compare(0, 3, "<<<") == 0)
+            continue;
+
+        HeredocSpec spec;
+        spec.stripTabs = (tok.compare(0, 3, "<<-") == 0);
+        string word = tok.substr(spec.stripTabs ? 3 : 2); // "<<EOF" has the delimiter attached
+        if (word.empty() && i + 1 < tokens.size())
+            word = tokens[++i]; // "<< EOF"
+        if (word.empty())
+            continue; // parse_pipeline() reports the missing delimiter
+        spec.quoted = heredoc_quoted(word); // before the quotes are removed
+        spec.delimiter = strip_quotes(word);
+        result.push_back(spec);
+    }
+    return result;
+}
+
+void set_heredoc_bodies(const vector<string> &bodies)
+{
+    heredocBodies.assign(bodies.begin(), bodies.end());
+}
+
+string take_heredoc_body()
+{
+    if (heredocBodies.empty())
+        return "";
+    string body = heredocBodies.front();
+    heredocBodies.pop_front();
+    return body;
+}
+
+// Returns the index just after the quoted text or bracketed group starting at s[i].
+// s[i] is one of  '  "  `  (  and a group may contain further groups and quotes,
+// e.g. the whole of <(sort "my file" | uniq) is one group.
+// An unterminated group runs until the end of the string.
+size_t skip_group(const string &s, size_t i)
+{
+    char open = s[i];
+    if (open == '\'') // nothing is special inside single quotes
+    {
+        size_t j = s.find('\'', i + 1);
+        return (j == string::npos) ? s.size() : j + 1;
+    }
+    if (open == '"' || open == '`')
+    {
+        for (size_t j = i + 1; j < s.size(); j++)
+        {
+            if (s[j] == '\\')
+                j++; // skip the escaped character
+            else if (s[j] == open)
+                return j + 1;
+            else if (open == '"' && s[j] == '(' && j > 0 && s[j - 1] == '$')
+                j = skip_group(s, j) - 1; // "$(...)" inside double quotes
+        }
+        return s.size();
+    }
+
+    // '(' : count nested parentheses, skipping quoted parts as a whole
+    int depth = 0;
+    for (size_t j = i; j < s.size(); j++)
+    {
+        char c = s[j];
+        if (c == '\\')
+            j++;
+        else if (c == '\'' || c == '"' || c == '`')
+            j = skip_group(s, j) - 1;
+        else if (c == '(')
+            depth++;
+        else if (c == ')' && --depth == 0)
+            return j + 1;
+    }
+    return s.size();
+}
+
+// true for the characters which start a quoted text or a bracketed group
+static bool opens_group(char c)
+{
+    return c == '\'' || c == '"' || c == '`' || c == '(';
+}
+
+// Splits the input at every 'delimiter' which is not quoted or inside brackets,
+// so "echo 'a;b'; ls" gives ["echo 'a;b'", " ls"]
 vector<string> splitByDelimiter(const string &input, char delimiter)
 {
     vector<string> result;
-    stringstream ss(input);
     string token;
-    while (getline(ss, token, delimiter))
+    for (size_t i = 0; i < input.size();)
     {
-        if (!token.empty())
-            result.push_back(token);
+        char c = input[i];
+        if (c == delimiter)
+        {
+            if (!token.empty())
+                result.push_back(token);
+            token.clear();
+            i++;
+        }
+        else if (c == '\\' && i + 1 < input.size())
+        {
+            token += input.substr(i, 2); // keep the backslash, tokenize() and expansion need it
+            i += 2;
+        }
+        else if (opens_group(c))
+        {
+            size_t end = skip_group(input, i);
+            token += input.substr(i, end - i);
+            i = end;
+        }
+        else
+        {
+            token += c;
+            i++;
+        }
     }
+    if (!token.empty())
+        result.push_back(token);
     return result;
 }
 
+// Splits a command into words at spaces/tabs which are not quoted or inside brackets.
+// The words are returned as typed (quotes included); expand_words() removes the quotes later.
 vector<string> tokenize(const string &command)
 {
-    stringstream ss(command);
-    string arg;
     vector<string> tokens;
-    while (ss >> arg)
-        tokens.push_back(arg);
+    string word;
+    bool inWord = false;
+    for (size_t i = 0; i < command.size();)
+    {
+        char c = command[i];
+        if (c == ' ' || c == '\t' || c == '\n')
+        {
+            if (inWord)
+                tokens.push_back(word);
+            word.clear();
+            inWord = false;
+            i++;
+            continue;
+        }
+
+        inWord = true;
+        if (c == '\\' && i + 1 < command.size())
+        {
+            word += command.substr(i, 2);
+            i += 2;
+        }
+        else if (opens_group(c))
+        {
+            size_t end = skip_group(command, i);
+            word += command.substr(i, end - i);
+            i = end;
+        }
+        else
+        {
+            word += c;
+            i++;
+        }
+    }
+    if (inWord)
+        tokens.push_back(word);
+    return tokens;
+}
+
+// true for the tokens lex_script() returns as operators
+bool is_operator_token(const string &tok)
+{
+    return tok == ";" || tok == "\n" || tok == "|" || tok == "&&" || tok == "||";
+}
+
+// Like tokenize(), but for whole scripts: ; newline | && || are returned as tokens of
+// their own even without spaces around them, "# ..." comments are dropped and a
+// backslash at the end of a line joins it with the next line.
+vector<string> lex_script(const string &text)
+{
+    vector<string> tokens;
+    string word;
+    bool inWord = false;
+    auto end_word = [&]() {
+        if (inWord)
+            tokens.push_back(word);
+        word.clear();
+        inWord = false;
+    };
+    for (size_t i = 0; i < text.size();)
+    {
+        char c = text[i];
+        if (c == ' ' || c == '\t')
+        {
+            end_word();
+            i++;
+        }
+        else if (c == '#' && !inWord)
+        {
+            while (i < text.size() && text[i] != '\n')
+                i++;
+        }
+        else if (c == '\\' && i + 1 < text.size() && text[i + 1] == '\n')
+        {
+            i += 2; // line continuation
+        }
+        else if (c == '\n' || c == ';')
+        {
+            end_word();
+            tokens.push_back(string(1, c));
+            i++;
+        }
+        else if ((c == '&' || c == '|') && i + 1 < text.size() && text[i + 1] == c)
+        {
+            end_word();
+            tokens.push_back(string(2, c)); // && or ||
+            i += 2;
+        }
+        else if (c == '|')
+        {
+            end_word();
+            tokens.push_back("|");
+            i++;
+        }
+        else if (c == '\\' && i + 1 < text.size())
+        {
+            word += text.substr(i, 2);
+            inWord = true;
+            i += 2;
+        }
+        else if (opens_group(c))
+        {
+            size_t end = skip_group(text, i);
+            word += text.substr(i, end - i);
+            inWord = true;
+            i = end;
+        }
+        else
+        {
+            word += c;
+            inWord = true;
+            i++;
+        }
+    }
+    end_word();
     return tokens;
 }
 
 // This function takes the full command line string and breaks it down into:
 //   - A list of commands (each command is argv-style vector<char*>)
-//   - Input redirection file (if '<' found)
-//   - Output redirection file (if '>' or '>>' found)
-//   - A flag 'appendMode' (which is true if '>>' is found)
+//   - The redirections of every command, in the order they were written:
+//     N<file, N>file, N>>file, N<>file, N>&M, N<&M, N>&-, &>file (see redirect.cpp)
+//     and here-documents / here-strings (<<, <<<), which become a memfd
 //
 // Example:
-//   Input: "cat in.txt | grep IIIT > out.txt"
+//   Input: "cat in.txt | grep IIIT > out.txt 2>&1"
 //   Output:
 //     commands = [ {"cat","in.txt"}, {"grep","IIIT"} ]
-//     inputFile = nullptr
-//     outputFile = "out.txt"
-//     appendMode = false
-void parse_pipeline(const string &command,
+//     redirections = [ {}, {1 > out.txt, 2 >& 1} ]
+//
+// Returns false (after printing the reason) for a bad redirection, e.g. "ls >"
+bool parse_pipeline(const string &command,
                     vector<vector<char *>> &commands,
-                    char *&outputFile,
-                    bool &appendMode,
-                    char *&inputFile)
+                    vector<vector<Redirection>> &redirections)
 {
-    // Step 1: split the command string by '|'
-    vector<string> parts = splitByDelimiter(command, '|');
+    // Step 1: split the command string by '|', and every part into words
+    vector<vector<string>> stages;
+    for (const string &part : splitByDelimiter(command, '|'))
+        stages.push_back(tokenize(part));
+    return parse_pipeline(stages, commands, redirections);
+}
 
-    // Initial values
-    outputFile = nullptr; // this filename's value will be updated if the command contains ">"
-    inputFile = nullptr;  // this filename's value will be updated if the command contains "<"
-    appendMode = false;   // this flag will be updated if the command contains ">>"
+// Undoes a parse_pipeline() which failed half way
+static void discard_pipeline(vector<vector<char *>> &commands, vector<vector<Redirection>> &redirections)
+{
+    for (auto &cmd : commands)
+    {
+        for (char *arg : cmd)
+            free(arg);
+    }
+    commands.clear();
+    for (auto &list : redirections)
+        close_redirections(list);
+    redirections.clear();
+}
 
+// The same for a pipeline which is already split into words (see lex_script()):
+// the commands of scripts and loop bodies are lexed once and run from their words.
+bool parse_pipeline(const vector<vector<string>> &stages,
+                    vector<vector<char *>> &commands,
+                    vector<vector<Redirection>> &redirections)
+{
     // Step 2: process each command present in the pipelined statement
-    for (size_t i = 0; i < parts.size(); i++)
+    for (size_t i = 0; i < stages.size(); i++)
     {
-        stringstream ss(parts[i]);
+        const vector<string> &tokens = stages[i];
+        size_t t = 0;
+        auto next = [&](string &out) // gives the next token of this segment, false at the end
+        {
+            if (t >= tokens.size())
+                return false;
+            out = tokens[t++];
+            return true;
+        };
         string arg;
         vector<char *> args;
+        redirections.push_back({});
+        vector<Redirection> &redirects = redirections.back(); // this command's redirections
+        auto fail = [&](const string &message) // prints the error and frees what was parsed so far
+        {
+            cerr << "Error: " << message << "\n";
+            for (char *a : args)
+                free(a);
+            discard_pipeline(commands, redirections);
+            return false;
+        };
 
         // Step 3: parse tokens inside each segment
-        while (ss >> arg)
+        while (next(arg))
         {
-            if (arg == ">" || arg == ">>") // both are for output redirection case
+            // <, >, >>, 2>, 2>&1, &>, 3<>, ... (they are not added to args for execvp)
+            bool usedFollowing = false;
+            string error;
+            const string *following = (t < tokens.size()) ? &tokens[t] : nullptr;
+            if (parse_redirection(arg, following, usedFollowing, redirects, error))
             {
-                
-                appendMode = (arg == ">>"); // true if the command contains ">>"
-                if (!(ss >> arg))
-                {
-                    cerr << "Error: missing filename after > or >>\n";
-                    return;
-                }
-                outputFile = strdup(arg.c_str()); // store filename
-                continue; // don't add to args for execvp
+                if (!error.empty())
+                    return fail(error);
+                if (usedFollowing)
+                    t++; // "2> err": the file name was the next word
+                continue;
             }
-            if (arg == "<") // this is for input redirection case
+            if (arg.compare(0, 2, "<<") == 0) // here-document (<<EOF) or here-string (<<< text)
             {
-                
-                if (!(ss >> arg))
+                string body;
+                if (arg.compare(0, 3, "<<<") == 0)
                 {
-                    cerr << "Error: missing filename after <\n";
-                    return;
+                    string word = arg.substr(3);
+                    if (word.empty() && !next(word))
+                        return fail("missing text after <<<");
+                    // the text is expanded like a word ($(cmd), quotes), but not split
+                    vector<string> fields = expand_words({word});
+                    for (size_t f = 0; f < fields.size(); f++)
+                        body += (f > 0 ? " " : "") + fields[f];
+                    body += "\n"; // a here-string ends with a newline
                 }
-                inputFile = strdup(arg.c_str()); // store filename
+                else
+                {
+                    string word = arg.substr(arg.compare(0, 3, "<<-") == 0 ? 3 : 2);
+                    if (word.empty() && !next(word))
+                        return fail("missing delimiter after <<");
+                    // the body was read by main() right after the command line. Unless the
+                    // delimiter was quoted, $VAR, $(cmd) and `cmd` are expanded now, when the
+                    // command runs, so in a loop the body sees the current $i.
+                    body = take_heredoc_body();
+                    if (!heredoc_quoted(word))
+                        body = expand_heredoc(body);
+                }
+
+                int memfd = open_memfd_input(body);
+                if (memfd < 0)
+                    return fail(string("could not create here-document: ") + strerror(errno));
+                redirects.push_back({REDIRECT_HEREDOC, STDIN_FILENO, "", memfd});
                 continue; // don't add to args for execvp
             }
             else // some other normal argument, so push it into argv
@@ -103,4 +418,5 @@ void parse_pipeline(const string &command,
         // and add the above args vector to "commands" vector
         commands.push_back(args);
     }
+    return true;
 }
\ No newline at end of file
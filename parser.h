@@ -2,17 +2,55 @@
 #define PARSER_H
 #include <vector>
 #include <string>
+#include "redirect.h" // for struct Redirection
 
 using namespace std;
 
+// Splits at 'delimiter' (e.g. ';' or '|'), but not inside quotes or brackets
 vector<string> splitByDelimiter(const string &input, char delimiter);
 
+// Splits a command into words at whitespace, keeping quotes and groups like <(...) inside one word
 vector<string> tokenize(const string &command);
 
-void parse_pipeline(const std::string &command,
+// Returns the index just after the quoted text / bracketed group that starts at s[i]
+size_t skip_group(const string &s, size_t i);
+
+// Like tokenize() for whole scripts: the operators ; newline | && || become tokens of their own
+vector<string> lex_script(const string &text);
+
+// true for the operator tokens returned by lex_script()
+bool is_operator_token(const string &tok);
+
+// Splits a command line into the argv of every pipeline stage and its redirections
+// (one list per stage). Returns false after printing the reason for a bad redirection.
+bool parse_pipeline(const std::string &command,
+                    std::vector<std::vector<char *>> &commands,
+                    std::vector<std::vector<Redirection>> &redirections);
+
+// parse_pipeline() for a pipeline already split into the words of each stage
+bool parse_pipeline(const std::vector<std::vector<std::string>> &stages,
                     std::vector<std::vector<char *>> &commands,
-                    char *&outputFile,
-                    bool &appendMode,
-                    char *&inputFile);
+                    std::vector<std::vector<Redirection>> &redirections);
+
+// A here-document found in a command line: "<<EOF" (or "<<-EOF", which strips leading tabs)
+struct HeredocSpec
+{
+    string delimiter; // without its quotes
+    bool stripTabs;
+    bool quoted;      // <<'EOF', <<"EOF", <<\EOF: the body is taken literally, else $VAR etc. are expanded
+};
+
+// true if any part of a here-document delimiter as typed is quoted ('EOF', E"OF", \EOF)
+bool heredoc_quoted(const string &word);
+
+// Finds the here-documents of a command line, in order, so their bodies can be read
+// before the line is executed
+vector<HeredocSpec> heredoc_delimiters(const string &line);
+
+// Hands the bodies read for heredoc_delimiters() to parse_pipeline(), which uses them in the same order
+void set_heredoc_bodies(const vector<string> &bodies);
+
+// Takes the next body given to set_heredoc_bodies() ("" if there is none)
+string take_heredoc_body();
 
 #endif
@@ -0,0 +1,271 @@
+/*
+pipes.cpp: pipe capacity tuning and per-pipe throughput statistics for pipelines.
+*/
+
+#include "pipes.h"
+#include <unistd.h>
+#include <fcntl.h>       // for pipe2(), splice(), F_SETPIPE_SZ
+#include <sys/ioctl.h>   // for FIONREAD
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>     // for pthread_sigmask()
+#include <errno.h>
+#include <limits.h>      // for LLONG_MAX
+#include <string.h>
+#include <time.h>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+
+static int defaultPipeSize = 0;  // capacity for new pipes, 0 means the kernel default (64 KiB)
+static bool pipestatOn = false;  // true after "pipestat on"
+static bool warnedPipeSize = false; // F_SETPIPE_SZ errors are reported only once
+
+// One measured pipe: the producer writes into 'from', a relay thread in the shell
+// moves the data with splice() into 'to', and the consumer reads from 'to'.
+struct PipeRelay
+{
+    int index;           // 0 for the pipe between stage 1 and stage 2, ...
+    int from;            // read end of the producer's pipe
+    int to;              // write end of the consumer's pipe
+    int capacity;        // capacity of the producer's pipe
+    long long bytes;     // bytes moved through this pipe
+    long long stall_ns;  // time the producer spent blocked on a full pipe
+    thread worker;
+};
+
+static vector<unique_ptr<PipeRelay>> relays; // relays of the running pipeline
+static string lastReport;                    // printed again by "pipestat" without arguments
+
+static long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+long long parse_size_arg(const string &text)
+{
+    if (text.empty())
+        return -1;
+    char *end = nullptr;
+    errno = 0;
+    long long value = strtoll(text.c_str(), &end, 10);
+    if (errno != 0 || end == text.c_str() || value < 0)
+        return -1;
+
+    string suffix(end);
+    int shift;
+    if (suffix == "" || suffix == "B" || suffix == "b")
+        shift = 0;
+    else if (suffix == "K" || suffix == "k" || suffix == "KiB")
+        shift = 10;
+    else if (suffix == "M" || suffix == "m" || suffix == "MiB")
+        shift = 20;
+    else if (suffix == "G" || suffix == "g" || suffix == "GiB")
+        shift = 30;
+    else
+        return -1;
+    // "99999999999g" would not fit into a long long (and shifting it is undefined)
+    if (value > (LLONG_MAX >> shift))
+        return -1;
+    return value << shift;
+}
+
+int take_pipesize_prefix(vector<char *> &first_cmd)
+{
+    // expected layout: pipesize <size> -- cmd args... NULL
+    if (first_cmd.size() < 5 || first_cmd[0] == nullptr || strcmp(first_cmd[0], "pipesize") != 0)
+        return 0;
+    if (first_cmd[2] == nullptr || strcmp(first_cmd[2], "--") != 0)
+        return 0;
+
+    long long size = parse_size_arg(first_cmd[1]);
+    if (size <= 0 || size > INT32_MAX)
+    {
+        cerr << "pipesize: invalid size '" << first_cmd[1] << "'" << endl;
+        return -1;
+    }
+
+    // the prefix words were strdup()'d by the parser
+    for (int k = 0; k < 3; k++)
+        free(first_cmd[k]);
+    first_cmd.erase(first_cmd.begin(), first_cmd.begin() + 3);
+    return (int)size;
+}
+
+// Applies the capacity to one pipe. The kernel rounds it up to a power of two pages.
+static void set_capacity(int fd, int capacity)
+{
+    if (capacity <= 0)
+        return;
+    if (fcntl(fd, F_SETPIPE_SZ, capacity) < 0 && !warnedPipeSize)
+    {
+        // EPERM: more than /proc/sys/fs/pipe-max-size without CAP_SYS_RESOURCE
+        perror("pipesize: F_SETPIPE_SZ");
+        warnedPipeSize = true;
+    }
+}
+
+// Body of a relay thread: move data from the producer's pipe to the consumer's pipe.
+static void relay_loop(PipeRelay *r)
+{
+    // If the consumer exits early, splice() must fail with EPIPE, not kill the shell
+    sigset_t block;
+    sigemptyset(&block);
+    sigaddset(&block, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &block, nullptr);
+
+    struct pollfd pfd = {r->from, POLLIN, 0};
+    while (true)
+    {
+        // Waiting here means the producer is slow; that is not a stall, so it isn't timed
+        if (poll(&pfd, 1, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        // splice() blocks here only while the consumer's pipe has no room. If the
+        // producer's pipe was full at the start or at the end of that wait, the
+        // producer was blocked in write() too, so the wait counts as a stall.
+        int queued = 0;
+        bool full = (ioctl(r->from, FIONREAD, &queued) == 0 && queued >= r->capacity);
+
+        long long start = now_ns();
+        ssize_t n = splice(r->from, NULL, r->to, NULL, r->capacity, SPLICE_F_MOVE);
+        long long took = now_ns() - start;
+
+        if (!full && ioctl(r->from, FIONREAD, &queued) == 0)
+            full = (queued + (n > 0 ? n : 0) >= r->capacity); // bytes left + bytes just moved
+        if (full && n != 0)
+            r->stall_ns += took; // also counts the wait that ended with EPIPE
+
+        if (n > 0)
+        {
+            r->bytes += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        break; // 0 = producer finished, EPIPE = consumer finished
+    }
+    close(r->from); // producer now gets SIGPIPE if it is still writing
+    close(r->to);   // consumer now sees end of file
+}
+
+int open_pipeline_pipe(int pipefd[2], int index, int capacity)
+{
+    if (capacity <= 0)
+        capacity = defaultPipeSize;
+
+    if (pipe2(pipefd, O_CLOEXEC) < 0)
+        return -1;
+    set_capacity(pipefd[0], capacity);
+
+    if (!pipestatOn)
+        return 0;
+
+    // pipestat: put a second pipe behind the first one and relay between them
+    int consumer[2];
+    if (pipe2(consumer, O_CLOEXEC) < 0)
+    {
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return -1;
+    }
+    set_capacity(consumer[0], capacity);
+
+    unique_ptr<PipeRelay> r(new PipeRelay());
+    r->index = index;
+    r->from = pipefd[0];
+    r->to = consumer[1];
+    r->capacity = fcntl(pipefd[0], F_GETPIPE_SZ);
+    r->bytes = 0;
+    r->stall_ns = 0;
+    r->worker = thread(relay_loop, r.get());
+    relays.push_back(move(r));
+
+    pipefd[0] = consumer[0]; // the next stage reads from the relay's pipe
+    return 0;
+}
+
+void finish_pipeline_pipes(const vector<string> &names)
+{
+    if (relays.empty())
+        return;
+
+    stringstream report;
+    for (auto &r : relays)
+    {
+        r->worker.join();
+        string from = (r->index < (int)names.size()) ? names[r->index] : "?";
+        string to = (r->index + 1 < (int)names.size()) ? names[r->index + 1] : "?";
+        report << "pipe " << r->index + 1 << " (" << from << " | " << to << "): "
+               << r->bytes << " bytes, capacity " << r->capacity
+               << ", producer stalled " << fixed << setprecision(3)
+               << r->stall_ns / 1e6 << " ms" << endl;
+    }
+    relays.clear();
+
+    lastReport = report.str();
+    cerr << lastReport;
+}
+
+void pipesize_command(const vector<string> &args)
+{
+    if (args.size() == 1)
+    {
+        // show the current setting and the largest size we may ask for
+        ifstream maxFile("/proc/sys/fs/pipe-max-size");
+        string maxSize = "unknown";
+        maxFile >> maxSize;
+        cout << "pipesize: " << (defaultPipeSize ? to_string(defaultPipeSize) : "default")
+             << " (max " << maxSize << ")" << endl;
+        return;
+    }
+    if (args.size() > 2)
+    {
+        // "pipesize <size> -- cmd" without any '|' has no pipe to resize
+        cerr << "Usage: pipesize [size|default]  or  pipesize <size> -- cmd1 | cmd2 ..." << endl;
+        return;
+    }
+    if (args[1] == "default")
+    {
+        defaultPipeSize = 0;
+        return;
+    }
+    long long size = parse_size_arg(args[1]);
+    if (size <= 0 || size > INT32_MAX)
+    {
+        cerr << "pipesize: invalid size '" << args[1] << "'" << endl;
+        return;
+    }
+    defaultPipeSize = (int)size;
+    warnedPipeSize = false;
+}
+
+void pipestat_command(const vector<string> &args)
+{
+    if (args.size() == 1)
+    {
+        // show the statistics of the last measured pipeline
+        if (lastReport.empty())
+            cout << "pipestat is " << (pipestatOn ? "on" : "off") << ", no pipeline measured yet" << endl;
+        else
+            cout << lastReport;
+        return;
+    }
+    if (args[1] == "on")
+        pipestatOn = true;
+    else if (args[1] == "off")
+        pipestatOn = false;
+    else
+        cerr << "Usage: pipestat [on|off]" << endl;
+}
@@ -0,0 +1,35 @@
+/*
+   pipes.h
+   Header file for pipe tuning in pipelines: pipe capacity (F_SETPIPE_SZ)
+   and the pipestat mode which measures the traffic through every pipe.
+*/
+
+#ifndef PIPES_H
+#define PIPES_H
+
+#include <string>
+#include <vector>
+
+// Parses sizes like "65536", "64K", "1M", "2G" into bytes. Returns -1 if invalid.
+long long parse_size_arg(const std::string &text);
+
+// Removes a "pipesize <size> --" prefix from the first command of a pipeline.
+// Returns the capacity requested for this pipeline, 0 if there was no prefix, -1 if it was invalid.
+int take_pipesize_prefix(std::vector<char *> &first_cmd);
+
+// Creates the pipe between pipeline stage 'index' and stage 'index + 1'.
+// capacity > 0 overrides the session default set with the pipesize builtin.
+// In pipestat mode the shell relays the data between two pipes to count it,
+// but the caller still just gets one write end (pipefd[1]) and one read end (pipefd[0]).
+// Both fds are close-on-exec, so they never leak into unrelated children.
+int open_pipeline_pipe(int pipefd[2], int index, int capacity);
+
+// Waits for the pipestat relays of the last pipeline and prints their statistics.
+// 'names' are the command names of the stages, used to label the pipes.
+void finish_pipeline_pipes(const std::vector<std::string> &names);
+
+// Builtins: "pipesize [size|default]" and "pipestat [on|off]"
+void pipesize_command(const std::vector<std::string> &args);
+void pipestat_command(const std::vector<std::string> &args);
+
+#endif
@@ -0,0 +1,290 @@
+/*
+policy.cpp: launch policies (CPU affinity, nice, I/O priority, memory limit) for child processes.
+*/
+
+#include "policy.h"
+#include "pipes.h" // for parse_size_arg()
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <iostream>
+
+using namespace std;
+
+// glibc has no wrapper for ioprio_set(), these come from the kernel's linux/ioprio.h
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_RT 1
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+
+// What to change in a child. Every setting is optional; the text is kept for printing.
+struct LaunchPolicy
+{
+    bool hasCpus = false;
+    cpu_set_t cpus;
+    string cpusText;
+
+    bool hasNice = false;
+    int nice = 0;
+
+    bool hasIonice = false;
+    int ioClass = 0;
+    int ioLevel = 0;
+    string ioniceText;
+
+    bool hasMem = false;
+    long long mem = 0;
+    string memText;
+};
+
+static LaunchPolicy sessionPolicy; // the defaults set with the "policy" builtin
+
+// "0-3,6,8-9" -> a CPU set. Returns false if the list is invalid.
+static bool parse_cpu_list(const string &text, cpu_set_t &cpus)
+{
+    CPU_ZERO(&cpus);
+    if (text.empty())
+        return false;
+    size_t start = 0;
+    while (start <= text.size())
+    {
+        size_t end = text.find(',', start);
+        if (end == string::npos)
+            end = text.size();
+        string part = text.substr(start, end - start);
+        size_t dash = part.find('-');
+        string first = part.substr(0, dash);
+        string last = (dash == string::npos) ? first : part.substr(dash + 1);
+        if (first.empty() || last.empty() ||
+            first.find_first_not_of("0123456789") != string::npos ||
+            last.find_first_not_of("0123456789") != string::npos)
+            return false;
+        long low = atol(first.c_str());
+        long high = atol(last.c_str());
+        if (low > high || high >= CPU_SETSIZE)
+            return false;
+        for (long cpu = low; cpu <= high; cpu++)
+            CPU_SET(cpu, &cpus);
+        start = end + 1;
+    }
+    return true;
+}
+
+// "idle", "be", "be:4", "best-effort:4", "rt:0", "realtime" -> class and level
+static bool parse_ionice(const string &text, int &ioClass, int &level)
+{
+    size_t colon = text.find(':');
+    string name = text.substr(0, colon);
+    level = 4; // the kernel's default level inside a class
+    if (colon != string::npos)
+    {
+        string number = text.substr(colon + 1);
+        if (number.size() != 1 || number[0] < '0' || number[0] > '7')
+            return false;
+        level = number[0] - '0';
+    }
+
+    if (name == "idle")
+    {
+        ioClass = IOPRIO_CLASS_IDLE;
+        level = 0; // the idle class has no levels
+        return colon == string::npos;
+    }
+    if (name == "be" || name == "best-effort")
+        ioClass = IOPRIO_CLASS_BE;
+    else if (name == "rt" || name == "realtime")
+        ioClass = IOPRIO_CLASS_RT;
+    else
+        return false;
+    return true;
+}
+
+// Reads one "--option value" into the policy. On failure 'error' says why.
+static bool parse_option(const string &option, const string &value, LaunchPolicy &policy, string &error)
+{
+    if (option == "--cpus")
+    {
+        if (!parse_cpu_list(value, policy.cpus))
+        {
+            error = "invalid CPU list '" + value + "'";
+            return false;
+        }
+        policy.hasCpus = true;
+        policy.cpusText = value;
+    }
+    else if (option == "--nice")
+    {
+        char *end = nullptr;
+        long nice = strtol(value.c_str(), &end, 10);
+        if (value.empty() || *end != '\0' || nice < -20 || nice > 19)
+        {
+            error = "invalid nice value '" + value + "' (-20..19)";
+            return false;
+        }
+        policy.hasNice = true;
+        policy.nice = (int)nice;
+    }
+    else if (option == "--ionice")
+    {
+        if (!parse_ionice(value, policy.ioClass, policy.ioLevel))
+        {
+            error = "invalid I/O class '" + value + "' (idle, be[:0-7] or rt[:0-7])";
+            return false;
+        }
+        policy.hasIonice = true;
+        policy.ioniceText = value;
+    }
+    else if (option == "--mem")
+    {
+        long long size = parse_size_arg(value);
+        if (size <= 0)
+        {
+            error = "invalid memory size '" + value + "'";
+            return false;
+        }
+        policy.hasMem = true;
+        policy.mem = size;
+        policy.memText = value;
+    }
+    else
+    {
+        error = "unknown option '" + option + "'";
+        return false;
+    }
+    return true;
+}
+
+// Changes the calling process. Only called in children, right before exec().
+static bool apply_policy(const LaunchPolicy &policy, string &error)
+{
+    if (policy.hasCpus && sched_setaffinity(0, sizeof(policy.cpus), &policy.cpus) != 0)
+    {
+        error = string("sched_setaffinity: ") + strerror(errno);
+        return false;
+    }
+    if (policy.hasNice && setpriority(PRIO_PROCESS, 0, policy.nice) != 0)
+    {
+        error = string("setpriority: ") + strerror(errno);
+        return false;
+    }
+    if (policy.hasIonice)
+    {
+        int ioprio = (policy.ioClass << IOPRIO_CLASS_SHIFT) | policy.ioLevel;
+        if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioprio) != 0)
+        {
+            error = string("ioprio_set: ") + strerror(errno);
+            return false;
+        }
+    }
+    if (policy.hasMem)
+    {
+        // only the soft limit: it may go up again to the hard limit, never above it
+        struct rlimit limit;
+        getrlimit(RLIMIT_AS, &limit);
+        limit.rlim_cur = (rlim_t)policy.mem;
+        if (setrlimit(RLIMIT_AS, &limit) != 0)
+        {
+            error = string("setrlimit: ") + strerror(errno);
+            return false;
+        }
+    }
+    return true;
+}
+
+char **apply_launch_policy(char **argv)
+{
+    string error;
+    if (!apply_policy(sessionPolicy, error))
+    {
+        cerr << "policy: " << error << endl;
+        exit(125);
+    }
+    if (argv[0] == nullptr || strcmp(argv[0], "run") != 0)
+        return argv;
+
+    // run [--option value]... [--] cmd args...
+    LaunchPolicy policy;
+    int i = 1;
+    while (argv[i] != nullptr && strncmp(argv[i], "--", 2) == 0)
+    {
+        if (strcmp(argv[i], "--") == 0)
+        {
+            i++;
+            break;
+        }
+        if (argv[i + 1] == nullptr)
+        {
+            cerr << "run: " << argv[i] << " needs a value" << endl;
+            exit(125);
+        }
+        if (!parse_option(argv[i], argv[i + 1], policy, error))
+        {
+            cerr << "run: " << error << endl;
+            exit(125);
+        }
+        i += 2;
+    }
+    if (argv[i] == nullptr)
+    {
+        cerr << "Usage: run [--cpus LIST] [--nice N] [--ionice CLASS] [--mem SIZE] -- cmd [args...]" << endl;
+        exit(125);
+    }
+    // applied after the session defaults, so these win
+    if (!apply_policy(policy, error))
+    {
+        cerr << "run: " << error << endl;
+        exit(125);
+    }
+    return argv + i;
+}
+
+int policy_command(const vector<string> &args)
+{
+    if (args.size() == 1)
+    {
+        const LaunchPolicy &p = sessionPolicy;
+        string text;
+        if (p.hasCpus)
+            text += ", cpus " + p.cpusText;
+        if (p.hasNice)
+            text += ", nice " + to_string(p.nice);
+        if (p.hasIonice)
+            text += ", ionice " + p.ioniceText;
+        if (p.hasMem)
+            text += ", mem " + p.memText;
+        if (text.empty())
+            cout << "policy: none (programs start with the shell's own settings)" << endl;
+        else
+            cout << "policy: " << text.substr(2) << endl;
+        return 0;
+    }
+    if (args.size() == 2 && args[1] == "--clear")
+    {
+        sessionPolicy = LaunchPolicy();
+        return 0;
+    }
+
+    // change a copy, so a bad option leaves the defaults as they were
+    LaunchPolicy policy = sessionPolicy;
+    for (size_t i = 1; i < args.size(); i += 2)
+    {
+        if (i + 1 >= args.size())
+        {
+            cerr << "policy: " << args[i] << " needs a value" << endl;
+            return 2;
+        }
+        string error;
+        if (!parse_option(args[i], args[i + 1], policy, error))
+        {
+            cerr << "policy: " << error << endl;
+            return 2;
+        }
+    }
+    sessionPolicy = policy;
+    return 0;
+}
@@ -0,0 +1,30 @@
+/*
+   policy.h
+   Header file for launch policies: CPU affinity, nice value, I/O priority and a
+   memory limit for the programs the shell starts. They are applied in the child
+   after fork() and before exec(), so the shell itself is never affected.
+*/
+
+#ifndef POLICY_H
+#define POLICY_H
+
+#include <string>
+#include <vector>
+
+// Applies the session defaults (set with the "policy" builtin) in the child, then
+// takes a "run [options] [--] cmd args..." prefix from argv and applies its options
+// too. Returns the argv of the real command. Called by exec_command() for every
+// child: simple commands, redirections and each stage of a pipeline.
+// If an option is invalid or can't be applied, the child exits with status 125.
+char **apply_launch_policy(char **argv);
+
+// Builtin: "policy" shows the session defaults, "policy [options]" changes them and
+// "policy --clear" removes them. Options:
+//   --cpus LIST      CPUs the program may run on, e.g. "0-3" or "0,2,4-7"
+//   --nice N         nice value -20..19 (lower than the current one needs root)
+//   --ionice CLASS   idle, be[:0-7] (best-effort) or rt[:0-7] (realtime)
+//   --mem SIZE       address space limit (RLIMIT_AS), e.g. 512M or 2G
+// Returns the exit status.
+int policy_command(const std::vector<std::string> &args);
+
+#endif
@@ -0,0 +1,179 @@
+/*
+posixshell.cpp: the Shell session object of libposixshell.a.
+*/
+
+#include "posixshell.h"
+#include "vars.h"      // for init_variables(), lastStatus
+#include "eventloop.h" // for run_text(), init_signals(), run_event_loop()
+#include "metrics.h"   // for init_metrics()
+#include <sys/mman.h>  // for memfd_create()
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>    // for PATH_MAX
+#include <stdio.h>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+// the engine's globals (the builtins, the history and pinfo use them)
+string shellHome;         // the home directory of the session ("~", a bare "cd")
+string shellHistoryFile;  // the history file, empty for the default one
+pid_t foregroundPid = -1; // the foreground child, marked with '+' by pinfo
+
+static Shell *currentShell = nullptr; // there is only one engine per process
+
+// stdout or stderr pointed at a memfd while execute() runs. A memfd never fills up,
+// so nothing blocks however much is printed, and programs started by the commands
+// write into it too (they inherit the fd).
+struct Capture
+{
+    int target = -1; // STDOUT_FILENO or STDERR_FILENO
+    int file = -1;   // the memfd
+    int saved = -1;  // the original target
+};
+
+static void flush_all()
+{
+    cout.flush();
+    cerr.flush();
+    fflush(stdout);
+    fflush(stderr);
+}
+
+static bool start_capture(int target, Capture &capture)
+{
+    flush_all(); // what was printed before belongs to the original output
+    capture.target = target;
+    capture.file = memfd_create("shell-output", MFD_CLOEXEC);
+    if (capture.file < 0)
+        return false;
+    capture.saved = fcntl(target, F_DUPFD_CLOEXEC, 10);
+    if (capture.saved < 0)
+    {
+        close(capture.file);
+        capture.file = -1;
+        return false;
+    }
+    dup2(capture.file, target);
+    return true;
+}
+
+// Puts the original fd back and returns what was written into the memfd
+static string stop_capture(Capture &capture)
+{
+    if (capture.file < 0)
+        return "";
+    flush_all();
+    dup2(capture.saved, capture.target);
+    close(capture.saved);
+
+    string text;
+    char buffer[65536];
+    off_t offset = 0;
+    ssize_t n;
+    while ((n = pread(capture.file, buffer, sizeof(buffer), offset)) > 0)
+    {
+        text.append(buffer, n);
+        offset += n;
+    }
+    close(capture.file);
+    capture.file = -1;
+    return text;
+}
+
+Shell::Shell(const ShellOptions &options) : opts(options)
+{
+    if (currentShell != nullptr)
+        throw logic_error("only one Shell can exist at a time");
+    currentShell = this;
+
+    if (opts.home.empty())
+    {
+        char cwd[PATH_MAX];
+        opts.home = (getcwd(cwd, sizeof(cwd)) != nullptr) ? cwd : ".";
+    }
+    shellHome = opts.home;
+    shellHistoryFile = opts.historyFile;
+
+    static bool started = false;
+    if (!started)
+    {
+        // counters for shellstat, shared with every child we fork (written in metrics.cpp)
+        init_metrics();
+        started = true;
+    }
+    // shell variables start as a copy of our environment
+    init_variables();
+    lastStatus = 0;
+}
+
+Shell::~Shell()
+{
+    currentShell = nullptr;
+}
+
+ShellResult Shell::execute(string_view script)
+{
+    ShellResult result;
+    if (finished)
+    {
+        result.status = lastStatus;
+        result.exited = true;
+        return result;
+    }
+
+    Capture out, err;
+    if (opts.captureOutput && !start_capture(STDOUT_FILENO, out))
+        perror("shell: cannot capture the output");
+    if (opts.captureErrors && !start_capture(STDERR_FILENO, err))
+        perror("shell: cannot capture the errors");
+
+    int exitStatus;
+    try
+    {
+        exitStatus = run_text(string(script), opts.recordHistory); // written in eventloop.cpp
+    }
+    catch (...)
+    {
+        stop_capture(err);
+        stop_capture(out);
+        throw;
+    }
+    result.errors = stop_capture(err);
+    result.output = stop_capture(out);
+
+    if (exitStatus >= 0)
+    {
+        finished = true; // "exit" ran
+        result.exited = true;
+    }
+    result.status = lastStatus;
+    return result;
+}
+
+int Shell::run_interactive(string (*make_prompt)())
+{
+    // Ctrl+C, Ctrl+Z and finished children arrive through a signalfd, not signal handlers
+    init_signals();
+
+    // wait for keystrokes, signals and timers (written in eventloop.cpp)
+    int status = run_event_loop(make_prompt);
+    finished = true;
+    return status;
+}
+
+int Shell::last_status() const
+{
+    return lastStatus;
+}
+
+bool Shell::exited() const
+{
+    return finished;
+}
+
+const ShellOptions &Shell::options() const
+{
+    return opts;
+}
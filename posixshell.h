@@ -0,0 +1,62 @@
+/*
+   posixshell.h
+   The shell as a library (libposixshell.a). A Shell session runs command lines inside
+   the calling process and can capture what they print; main.cpp is the interactive
+   front end on top of it. Other programs (job runners, benchmarks) link the library
+   to drive the same engine without starting the shell binary.
+
+   The engine keeps its state (variables, functions, jobs, the working directory) in
+   the process, so there can only be one Shell at a time.
+*/
+
+#ifndef POSIXSHELL_H
+#define POSIXSHELL_H
+
+#include <string>
+#include <string_view>
+
+struct ShellOptions
+{
+    std::string home;           // what "~" and a bare "cd" mean; empty: the current directory
+    std::string historyFile;    // empty: .my_shell_history in the home directory
+    bool recordHistory = false; // save every execute()d command in the history
+    bool captureOutput = false; // collect stdout in ShellResult::output (also of the programs started)
+    bool captureErrors = false; // collect stderr in ShellResult::errors
+};
+
+struct ShellResult
+{
+    int status = 0;      // the exit status ($?) of the last command
+    bool exited = false; // "exit" ran: the session is over, execute() does nothing any more
+    std::string output;  // with captureOutput
+    std::string errors;  // with captureErrors
+};
+
+class Shell
+{
+public:
+    // Throws std::logic_error if another Shell exists
+    explicit Shell(const ShellOptions &options = ShellOptions());
+    ~Shell();
+    Shell(const Shell &) = delete;
+    Shell &operator=(const Shell &) = delete;
+
+    // Runs a command line or a whole script (several lines, here-documents, loops ...).
+    // Output goes to the process's stdout / stderr unless it is captured.
+    // Background jobs started while capturing write into a file nobody reads afterwards.
+    ShellResult execute(std::string_view script);
+
+    // The interactive prompt loop on the terminal, until Ctrl+D or "exit".
+    // make_prompt() is called for every prompt. Returns the status to exit with.
+    int run_interactive(std::string (*make_prompt)());
+
+    int last_status() const;
+    bool exited() const;
+    const ShellOptions &options() const;
+
+private:
+    ShellOptions opts;
+    bool finished = false;
+};
+
+#endif
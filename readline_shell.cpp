@@ -1,4 +1,7 @@
 #include "readline_shell.h"
+#include "builtins.h" // for builtin_names()
+#include "vars.h"     // for get_variable()
+#include "metrics.h"  // for counting completions
 
 #include <readline/readline.h>
 #include <readline/history.h>
@@ -15,13 +18,12 @@
 using namespace std;
 
 
-// list of all the functions we built. We will need to update this if we add/remove builtins.
-static vector<string> g_builtins = {
-    "cd", "pwd", "echo", "ls", "pinfo", "search", "history", "exit"
-};
+// list of all the functions we built (kept in builtins.cpp)
+static const vector<string> &g_builtins = builtin_names();
 
 
 static string g_hist_file;   // to store the name of the shell history file 
+extern string shellHistoryFile; // the history file chosen for the session (empty: the default)
 static bool g_inited = false;     // to avoid doing init stuff more than once
 
 // check if file is executable (very basic)
@@ -32,10 +34,9 @@ static bool is_executable(const string &path) {
 
 // this function will add PATH executables that start with "prefix" into "out"
 static void collect_path_commands(const char *prefix, vector<string> &out) {
-    const char *path = getenv("PATH");
-    if (!path) return;
+    string P = get_variable("PATH"); // the shell's PATH, which 'export' may have changed
+    if (P.empty()) return;
 
-    string P(path);
     size_t i = 0;
     size_t preLen = prefix ? strlen(prefix) : 0;
 
@@ -109,6 +110,7 @@ static char *my_cmd_generator(const char *text, int state) {
 // this function decides whether we are completing command names or filenames
 static char **my_completion(const char *text, int start, int end) {
     (void)end; // I am not using 'end' here
+    count_stat(STAT_COMPLETIONS);
 
     // if we are at the first token (start == 0), complete command names
     if (start == 0) {
@@ -120,7 +122,7 @@ static char **my_completion(const char *text, int start, int end) {
 
 // ----------------------- one-time init -----------------------
 
-static void rl_setup_once() {
+void rl_setup_once() {
     if (g_inited) return;
     g_inited = true;
 
@@ -129,7 +131,8 @@ static void rl_setup_once() {
 
     // figure out history file path: $HOME/.my_shell_history
     const char *home = getenv("HOME");
-    if (home && *home) g_hist_file = string(home) + "/.my_shell_history";
+    if (!shellHistoryFile.empty()) g_hist_file = shellHistoryFile;
+    else if (home && *home) g_hist_file = string(home) + "/.my_shell_history";
     else               g_hist_file = ".my_shell_history"; // fallback if HOME missing
 
     // read previous history (ok if file does not exist yet)
@@ -140,7 +143,7 @@ static void rl_setup_once() {
 }
 
 
-bool rl_readline(string &out, const string &prompt) {
+bool rl_readline(string &out, const string &prompt, bool remember) {
     rl_setup_once();
 
     char *raw = ::readline(prompt.c_str());
@@ -154,24 +157,31 @@ bool rl_readline(string &out, const string &prompt) {
     out.assign(raw);
     ::free(raw);
 
+    if (remember) {
+        rl_remember(out);
+    }
+
+    return true;
+}
+
+void rl_remember(const string &line) {
     // don't add empty/whitespace lines to history
     bool only_ws = true;
-    for (size_t i = 0; i < out.size(); ++i) {
-        if (out[i] != ' ' && out[i] != '\t') { only_ws = false; break; }
+    for (size_t i = 0; i < line.size(); ++i) {
+        if (line[i] != ' ' && line[i] != '\t') { only_ws = false; break; }
     }
-
-    if (!only_ws && !out.empty()) {
-        // avoid adding the exact same last line twice in a row
-        if (history_length == 0 || out != history_get(history_length)->line) {
-            add_history(out.c_str());
-            // append to file (if first time fails, write the whole file)
-            if (append_history(1, g_hist_file.c_str()) != 0) {
-                write_history(g_hist_file.c_str());
-            }
-            // also keep the file trimmed to 20 lines, same as memory
-            history_truncate_file(g_hist_file.c_str(), 20);
+    if (only_ws) return;
+
+    // avoid adding the exact same last line twice in a row
+    // (history_get() counts from history_base, which moves up once stifle_history() drops lines)
+    HIST_ENTRY *last = history_get(history_base + history_length - 1);
+    if (last == nullptr || line != last->line) {
+        add_history(line.c_str());
+        // append to file (if first time fails, write the whole file)
+        if (append_history(1, g_hist_file.c_str()) != 0) {
+            write_history(g_hist_file.c_str());
         }
+        // also keep the file trimmed to 20 lines, same as memory
+        history_truncate_file(g_hist_file.c_str(), 20);
     }
-
-    return true;
 }
@@ -7,6 +7,13 @@ using namespace std;
 
 // Returns false on Ctrl+D (EOF at empty prompt) so caller can "logout".
 // On success, 'out' gets the typed line (no trailing newline) and function returns true.
-bool rl_readline(string &out, const string &prompt);
+// remember = false keeps the line out of the history (used for here-document bodies).
+bool rl_readline(string &out, const string &prompt, bool remember = true);
+
+// Completion and history setup; done once, before the first prompt
+void rl_setup_once();
+
+// Adds a line to the readline history (arrow keys) and to the history file
+void rl_remember(const string &line);
 
 #endif
@@ -0,0 +1,306 @@
+/*
+redirect.cpp: parses and applies the redirections of a command (N<, N>, N>>, N<>,
+N>&M, N<&M, N>&-, &>, &>>) in the order they were written.
+*/
+
+#include "redirect.h"
+#include "expand.h" // for expand_words()
+#include <fcntl.h>
+#include <sys/stat.h> // for S_ISFIFO()
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+#define LOWEST_SAVED_FD 10 // the shell's copies of changed fds go at or above this, like in bash
+
+static bool all_digits(const string &text)
+{
+    if (text.empty() || text.size() > 9)
+        return false;
+    for (char c : text)
+    {
+        if (c < '0' || c > '9')
+            return false;
+    }
+    return true;
+}
+
+bool parse_redirection(const string &word, const string *following, bool &usedFollowing,
+                       vector<Redirection> &redirections, string &error)
+{
+    usedFollowing = false;
+    size_t i = 0;
+    while (i < word.size() && word[i] >= '0' && word[i] <= '9')
+        i++;
+    bool both = false; // &> and &>>: stdout and stderr
+    if (i == 0 && word.compare(0, 2, "&>") == 0)
+    {
+        both = true;
+        i = 1;
+    }
+    if (i >= word.size() || (word[i] != '<' && word[i] != '>') || i > 9)
+        return false;
+    int fd = (i > 0 && !both) ? atoi(word.substr(0, i).c_str()) : -1;
+
+    // the operator itself
+    string op;
+    if (word[i] == '<')
+    {
+        if (word.compare(i, 2, "<<") == 0 || word.compare(i, 2, "<(") == 0)
+            return false; // a here-document (see parser.cpp) or a process substitution
+        if (word.compare(i, 2, "<>") == 0)
+            op = "<>";
+        else if (word.compare(i, 2, "<&") == 0)
+            op = "<&";
+        else
+            op = "<";
+    }
+    else
+    {
+        if (word.compare(i, 2, ">(") == 0)
+            return false;
+        if (word.compare(i, 2, ">>") == 0)
+            op = ">>";
+        else if (word.compare(i, 2, ">&") == 0)
+            op = ">&";
+        else if (word.compare(i, 2, ">|") == 0)
+            op = ">|";
+        else
+            op = ">";
+    }
+    if (both && op != ">" && op != ">>")
+        return false;
+
+    // the file name / fd, in this word or the next one
+    string target = word.substr(i + op.size());
+    if (target.empty())
+    {
+        if (following == nullptr || following->empty())
+        {
+            error = "missing file name after " + word;
+            return true;
+        }
+        target = *following;
+        usedFollowing = true;
+    }
+
+    Redirection redirection = {REDIRECT_OUTPUT, fd, target, -1};
+    if (op == "<" || op == "<>")
+    {
+        redirection.type = (op == "<") ? REDIRECT_INPUT : REDIRECT_READ_WRITE;
+        if (fd < 0)
+            redirection.fd = STDIN_FILENO;
+    }
+    else if (op == "<&" || op == ">&")
+    {
+        if (fd < 0)
+            redirection.fd = (op == "<&") ? STDIN_FILENO : STDOUT_FILENO;
+        if (target == "-")
+            redirection.type = REDIRECT_CLOSE;
+        else if (all_digits(target))
+        {
+            redirection.type = REDIRECT_DUPLICATE;
+            redirection.sourceFd = atoi(target.c_str());
+        }
+        else if (op == ">&" && fd < 0)
+            both = true; // ">&file" is the old way of writing "&>file"
+        else
+        {
+            error = target + ": ambiguous redirect";
+            return true;
+        }
+    }
+    else
+    {
+        redirection.type = (op == ">>") ? REDIRECT_APPEND : REDIRECT_OUTPUT;
+        if (fd < 0)
+            redirection.fd = STDOUT_FILENO;
+    }
+    if (redirection.type == REDIRECT_DUPLICATE || redirection.type == REDIRECT_CLOSE)
+        redirection.target.clear();
+
+    redirections.push_back(redirection);
+    if (both)
+        redirections.push_back({REDIRECT_DUPLICATE, STDERR_FILENO, "", STDOUT_FILENO}); // then 2>&1
+    return true;
+}
+
+void expand_redirections(vector<Redirection> &redirections)
+{
+    for (Redirection &redirection : redirections)
+    {
+        if (redirection.target.empty())
+            continue;
+        vector<string> words = expand_words({redirection.target});
+        redirection.target = words.empty() ? "" : words[0];
+    }
+}
+
+int open_redirection(const Redirection &redirection)
+{
+    int fd = -1;
+    switch (redirection.type)
+    {
+    case REDIRECT_INPUT:
+        fd = open(redirection.target.c_str(), O_RDONLY | O_CLOEXEC);
+        break;
+    case REDIRECT_OUTPUT:
+        fd = open(redirection.target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        break;
+    case REDIRECT_APPEND:
+        fd = open(redirection.target.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        break;
+    case REDIRECT_READ_WRITE:
+        fd = open(redirection.target.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        break;
+    case REDIRECT_HEREDOC:
+        fd = fcntl(redirection.sourceFd, F_DUPFD_CLOEXEC, 0);
+        break;
+    default:
+        errno = EINVAL;
+        break;
+    }
+    if (fd < 0)
+    {
+        const string &name = (redirection.type == REDIRECT_HEREDOC) ? "here-document" : redirection.target;
+        cerr << name << ": " << strerror(errno) << endl;
+    }
+    return fd;
+}
+
+// Remembers how 'fd' was before its first change, so restore_fds() can put it back
+static bool save_fd(int fd, int lowest, vector<SavedFd> &saved)
+{
+    for (const SavedFd &entry : saved)
+    {
+        if (entry.fd == fd)
+            return true; // "> a 2>&1 > b": the state before the first one counts
+    }
+    SavedFd entry = {fd, -1, fcntl(fd, F_GETFD)};
+    if (entry.flags >= 0)
+    {
+        entry.copy = fcntl(fd, F_DUPFD_CLOEXEC, lowest);
+        if (entry.copy < 0)
+        {
+            perror("cannot save file descriptor");
+            return false;
+        }
+    }
+    saved.push_back(entry);
+    return true;
+}
+
+bool apply_redirections(const vector<Redirection> &redirections, vector<SavedFd> *saved)
+{
+    // the saved copies must not land on an fd the command is about to use ("10>file")
+    int lowest = LOWEST_SAVED_FD;
+    for (const Redirection &redirection : redirections)
+        lowest = max(lowest, max(redirection.fd, redirection.sourceFd) + 1);
+    if (saved != nullptr)
+    {
+        // text the shell wrote but hasn't flushed yet belongs to the old fds
+        cout.flush();
+        cerr.flush();
+        fflush(stdout);
+    }
+
+    for (const Redirection &redirection : redirections)
+    {
+        if (saved != nullptr && !save_fd(redirection.fd, lowest, *saved))
+            return false;
+
+        if (redirection.type == REDIRECT_CLOSE)
+        {
+            close(redirection.fd);
+            continue;
+        }
+        if (redirection.type == REDIRECT_DUPLICATE)
+        {
+            if (fcntl(redirection.sourceFd, F_GETFD) < 0)
+            {
+                cerr << redirection.sourceFd << ": Bad file descriptor" << endl;
+                return false;
+            }
+            if (redirection.sourceFd == redirection.fd)
+                fcntl(redirection.fd, F_SETFD, 0); // "3>&3" passes the shell's fd 3 on
+            else
+                dup2(redirection.sourceFd, redirection.fd);
+            continue;
+        }
+
+        int fd = open_redirection(redirection);
+        if (fd < 0)
+            return false;
+        if (fd == redirection.fd)
+            fcntl(fd, F_SETFD, 0); // it was opened close-on-exec, but this one is for the command
+        else
+        {
+            dup2(fd, redirection.fd); // the copy made by dup2() is not close-on-exec
+            close(fd);
+        }
+    }
+    return true;
+}
+
+void restore_fds(vector<SavedFd> &saved)
+{
+    cout.flush();
+    cerr.flush();
+    fflush(stdout);
+    for (size_t i = saved.size(); i-- > 0;)
+    {
+        const SavedFd &entry = saved[i];
+        if (entry.copy < 0)
+        {
+            close(entry.fd); // it was not open before
+            continue;
+        }
+        dup3(entry.copy, entry.fd, (entry.flags & FD_CLOEXEC) ? O_CLOEXEC : 0);
+        close(entry.copy);
+    }
+    saved.clear();
+    // a write to a closed fd ("echo x >&-") leaves the stream failed, and it would
+    // ignore everything after it
+    cout.clear();
+    cerr.clear();
+    clearerr(stdout);
+}
+
+void close_redirections(vector<Redirection> &redirections)
+{
+    for (Redirection &redirection : redirections)
+    {
+        if (redirection.type == REDIRECT_HEREDOC && redirection.sourceFd != -1)
+        {
+            close(redirection.sourceFd);
+            redirection.sourceFd = -1;
+        }
+    }
+}
+
+bool redirects_only(const vector<Redirection> &redirections, int fd)
+{
+    for (const Redirection &redirection : redirections)
+    {
+        if (redirection.fd != fd || redirection.type == REDIRECT_DUPLICATE || redirection.type == REDIRECT_CLOSE)
+            return false;
+    }
+    return true;
+}
+
+bool opens_fifo(const vector<Redirection> &redirections)
+{
+    for (const Redirection &redirection : redirections)
+    {
+        struct stat st;
+        if (redirection.type != REDIRECT_DUPLICATE && redirection.type != REDIRECT_CLOSE &&
+            redirection.type != REDIRECT_HEREDOC && stat(redirection.target.c_str(), &st) == 0 && S_ISFIFO(st.st_mode))
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,79 @@
+/*
+   redirect.h
+   Header file for the redirections of a command: numbered fds, files, duplications
+   and closes, applied in the order they were written (so "> out 2>&1" and
+   "2>&1 > out" differ like in bash). A forked command applies them in the child;
+   builtins apply them to the shell's own fds, which are put back afterwards.
+*/
+
+#ifndef REDIRECT_H
+#define REDIRECT_H
+
+#include <string>
+#include <vector>
+
+enum RedirectionType
+{
+    REDIRECT_INPUT,      // N<file     (N is 0 if not given)
+    REDIRECT_OUTPUT,     // N>file     (N is 1 if not given), also N>|file
+    REDIRECT_APPEND,     // N>>file
+    REDIRECT_READ_WRITE, // N<>file    opened for reading and writing, not truncated
+    REDIRECT_DUPLICATE,  // N>&M, N<&M N becomes a copy of M
+    REDIRECT_CLOSE,      // N>&-, N<&-
+    REDIRECT_HEREDOC     // <<EOF, <<< text: reads a memfd holding the text
+};
+
+struct Redirection
+{
+    RedirectionType type;
+    int fd;             // the fd of the command which is changed
+    std::string target; // the file name (expanded just before the command runs)
+    int sourceFd;       // M for REDIRECT_DUPLICATE, the memfd for REDIRECT_HEREDOC, else -1
+};
+
+// One fd of the shell which was changed for a builtin, and how to put it back
+struct SavedFd
+{
+    int fd;
+    int copy;  // a close-on-exec copy of the old fd, -1 if 'fd' was not open
+    int flags; // its old fd flags (FD_CLOEXEC)
+};
+
+// Recognises a redirection at the start of 'word' ("2>", ">>out", "2>&1", "&>log",
+// "3<>file", "4<&-" ...) and appends it to 'redirections' ("&>f" gives two entries:
+// >f and 2>&1). If the operator stands alone ("2> err") the file name is 'following',
+// the next word (nullptr at the end of the command), and 'usedFollowing' is set.
+// Here-documents ("<<") and process substitutions ("<(cmd)") are not handled here.
+// Returns false for an ordinary word; 'error' is set for a bad redirection ("2>&x").
+bool parse_redirection(const std::string &word, const std::string *following, bool &usedFollowing,
+                       std::vector<Redirection> &redirections, std::string &error);
+
+// Expands the file names ($VAR, quotes, ~) once the command is really run
+void expand_redirections(std::vector<Redirection> &redirections);
+
+// Applies the redirections in order. With 'saved', every fd is first copied there so
+// restore_fds() can undo it (for commands which run inside the shell).
+// Prints the reason ("out.txt: Permission denied") and returns false if one fails;
+// the ones before it stay applied, so the caller still restores (or exits).
+bool apply_redirections(const std::vector<Redirection> &redirections, std::vector<SavedFd> *saved);
+
+// Puts back the fds saved by apply_redirections(), in reverse order
+void restore_fds(std::vector<SavedFd> &saved);
+
+// Closes the here-document memfds held by the redirections
+void close_redirections(std::vector<Redirection> &redirections);
+
+// Opens the file of a REDIRECT_INPUT / OUTPUT / APPEND / READ_WRITE entry close-on-exec
+// (or duplicates a here-document's memfd). Prints the reason and returns -1 on failure.
+int open_redirection(const Redirection &redirection);
+
+// true if every redirection only replaces 'fd' with a file or here-document, so a
+// command running in the shell can use open_redirection() on them instead of
+// changing the shell's own fds
+bool redirects_only(const std::vector<Redirection> &redirections, int fd);
+
+// true if one of the redirections names a FIFO. Opening it waits for the other end,
+// and Ctrl+C can't stop the shell itself there, so such a command runs in a child.
+bool opens_fifo(const std::vector<Redirection> &redirections);
+
+#endif
@@ -0,0 +1,659 @@
+/*
+script.cpp: parses command lines into a tree (if / while / until / for / && / || /
+functions) and runs the tree.
+*/
+
+#include "script.h"
+#include "parser.h"   // for lex_script() and the here-document bodies
+#include "io.h"       // for execute_command()
+#include "expand.h"   // for expand_words()
+#include "vars.h"     // for lastStatus, loop variables and $1, $2, ...
+#include "eventloop.h" // for take_interrupt()
+#include <iostream>
+#include <unordered_map>
+
+using namespace std;
+
+typedef shared_ptr<Node> NodePtr;
+
+static unordered_map<string, NodePtr> functions; // the defined shell functions by name
+
+// break / continue / return don't run anything themselves: they set these counters, and
+// every list and loop stops early while one of them is pending.
+static int breakLevels = 0;    // "break 2" leaves two loops
+static int continueLevels = 0; // "continue 2" continues the second loop outwards
+static bool returning = false;
+static bool exiting = false;   // "exit": everything stops, the caller ends the session
+static int exitStatus = 0;
+static int loopDepth = 0;      // loops running right now
+static int functionDepth = 0;  // function calls running right now
+
+static bool interrupted = false; // Ctrl+C: the rest of the command line is skipped
+static int runDepth = 0;         // nesting of run_node() calls
+
+static bool flow_pending()
+{
+    return breakLevels > 0 || continueLevels > 0 || returning || interrupted || exiting;
+}
+
+// Loops of builtins never give the terminal's Ctrl+C to a child, so they check for it themselves
+static bool check_interrupt()
+{
+    if (!interrupted && take_interrupt())
+    {
+        cout << endl;
+        interrupted = true;
+        lastStatus = 130;
+    }
+    return interrupted;
+}
+
+// ------------------- parser -------------------
+
+// Recursive descent over the tokens of lex_script():
+//   list     := and_or ((';' | newline) and_or)*
+//   and_or   := pipeline (('&&' | '||') pipeline)*
+//   pipeline := ['!'] (compound | simple ('|' simple)*)
+struct ScriptParser
+{
+    vector<string> toks;
+    size_t pos = 0;
+    bool incomplete = false; // ran out of tokens in the middle of a construct
+    string error;
+
+    bool at_end() const { return pos >= toks.size(); }
+    const string &peek() const { return toks[pos]; }
+
+    bool failed() const { return incomplete || !error.empty(); }
+
+    void fail(const string &message)
+    {
+        if (error.empty())
+            error = message;
+    }
+
+    void skip_newlines()
+    {
+        while (!at_end() && peek() == "\n")
+            pos++;
+    }
+
+    // Expects the reserved word 'word' (e.g. "then") as the next token
+    bool expect(const string &word)
+    {
+        skip_newlines();
+        if (at_end())
+        {
+            incomplete = true;
+            return false;
+        }
+        if (peek() != word)
+        {
+            fail("expected '" + word + "' but found '" + peek() + "'");
+            return false;
+        }
+        pos++;
+        return true;
+    }
+
+    static bool is_stop(const string &tok, const vector<string> &stops)
+    {
+        for (const string &s : stops)
+        {
+            if (tok == s)
+                return true;
+        }
+        return false;
+    }
+
+    // Commands up to one of the reserved words in 'stops' (which is not consumed).
+    // With no stops the list runs until the end of the text.
+    NodePtr parse_list(const vector<string> &stops)
+    {
+        NodePtr list = make_shared<Node>();
+        list->kind = NODE_LIST;
+        while (true)
+        {
+            while (!at_end() && (peek() == ";" || peek() == "\n"))
+                pos++;
+            if (at_end())
+            {
+                if (!stops.empty())
+                    incomplete = true; // e.g. "if true; then echo" without "fi"
+                break;
+            }
+            if (is_stop(peek(), stops))
+                break;
+
+            NodePtr cmd = parse_and_or();
+            if (failed())
+                return nullptr;
+            list->children.push_back(cmd);
+
+            if (!at_end() && peek() != ";" && peek() != "\n")
+            {
+                fail("unexpected '" + peek() + "'");
+                return nullptr;
+            }
+        }
+        if (failed())
+            return nullptr;
+        return list;
+    }
+
+    NodePtr parse_and_or()
+    {
+        NodePtr left = parse_pipeline();
+        while (!failed() && !at_end() && (peek() == "&&" || peek() == "||"))
+        {
+            NodePtr node = make_shared<Node>();
+            node->kind = (peek() == "&&") ? NODE_AND : NODE_OR;
+            pos++;
+            skip_newlines(); // "cmd &&" may continue on the next line
+            if (at_end())
+            {
+                incomplete = true;
+                return nullptr;
+            }
+            NodePtr right = parse_pipeline();
+            node->children = {left, right};
+            left = node;
+        }
+        return failed() ? nullptr : left;
+    }
+
+    NodePtr parse_pipeline()
+    {
+        bool negate = false;
+        if (!at_end() && peek() == "!")
+        {
+            negate = true;
+            pos++;
+        }
+        if (at_end())
+        {
+            incomplete = true;
+            return nullptr;
+        }
+        if (is_operator_token(peek()))
+        {
+            fail("unexpected '" + (peek() == "\n" ? string("newline") : peek()) + "'");
+            return nullptr;
+        }
+
+        NodePtr node = parse_compound();
+        if (failed())
+            return nullptr;
+        if (node)
+        {
+            if (!at_end() && peek() == "|")
+            {
+                fail("a compound command can't be used in a pipeline");
+                return nullptr;
+            }
+        }
+        else
+        {
+            node = parse_simple();
+            if (failed())
+                return nullptr;
+        }
+        node->negate = negate;
+        return node;
+    }
+
+    // A simple command or a pipeline of simple commands: the words up to the next operator
+    NodePtr parse_simple()
+    {
+        NodePtr node = make_shared<Node>();
+        node->kind = NODE_COMMAND;
+        node->stages.push_back({});
+        while (true)
+        {
+            if (at_end() || (is_operator_token(peek()) && peek() != "|"))
+                break;
+            if (peek() == "|")
+            {
+                pos++;
+                skip_newlines(); // "cmd |" may continue on the next line
+                if (at_end())
+                {
+                    incomplete = true;
+                    return nullptr;
+                }
+                node->stages.push_back({});
+                continue;
+            }
+            const string &word = peek();
+            // the bodies were read after their line, they belong to this command now
+            if (word.compare(0, 2, "<<") == 0 && word.compare(0, 3, "<<<") != 0)
+                node->heredocs.push_back(take_heredoc_body());
+            node->stages.back().push_back(word);
+            pos++;
+        }
+        for (const auto &stage : node->stages)
+        {
+            if (stage.empty())
+            {
+                fail("empty command in a pipeline");
+                return nullptr;
+            }
+        }
+        return node;
+    }
+
+    // if / while / until / for / { ... } / a function definition.
+    // Returns nullptr (without an error) if the command is a simple command.
+    NodePtr parse_compound()
+    {
+        string word = peek();
+
+        // "name(){" is lexed as one word: split off the brace
+        if (word.size() > 3 && word.compare(word.size() - 3, 3, "(){") == 0)
+        {
+            toks[pos] = word.substr(0, word.size() - 1);
+            toks.insert(toks.begin() + pos + 1, "{");
+            word = peek();
+        }
+
+        if (word == "if")
+            return parse_if();
+        if (word == "while" || word == "until")
+            return parse_while();
+        if (word == "for")
+            return parse_for();
+        if (word == "{")
+        {
+            pos++;
+            NodePtr body = parse_list({"}"});
+            if (failed() || !expect("}"))
+                return nullptr;
+            return body;
+        }
+        if (word == "function" && pos + 1 < toks.size())
+        {
+            pos++;
+            string name = peek();
+            if (name.size() > 2 && name.compare(name.size() - 2, 2, "()") == 0)
+                name.resize(name.size() - 2);
+            pos++;
+            if (!at_end() && peek() == "()")
+                pos++;
+            return parse_function_body(name);
+        }
+        // name() { ... }  or  name () { ... }
+        if (word.size() > 2 && word.compare(word.size() - 2, 2, "()") == 0 &&
+            is_valid_name(word.substr(0, word.size() - 2)))
+        {
+            pos++;
+            return parse_function_body(word.substr(0, word.size() - 2));
+        }
+        if (is_valid_name(word) && pos + 1 < toks.size() && toks[pos + 1] == "()")
+        {
+            pos += 2;
+            return parse_function_body(word);
+        }
+        if (word == "then" || word == "elif" || word == "else" || word == "fi" ||
+            word == "do" || word == "done" || word == "}")
+        {
+            fail("unexpected '" + word + "'");
+            return nullptr;
+        }
+        return nullptr;
+    }
+
+    NodePtr parse_function_body(const string &name)
+    {
+        if (!is_valid_name(name))
+        {
+            fail("'" + name + "' is not a valid function name");
+            return nullptr;
+        }
+        skip_newlines();
+        if (at_end())
+        {
+            incomplete = true;
+            return nullptr;
+        }
+        NodePtr body = parse_compound();
+        if (failed())
+            return nullptr;
+        if (!body)
+        {
+            fail("the body of function " + name + " must be a { ... } group or a compound command");
+            return nullptr;
+        }
+        NodePtr node = make_shared<Node>();
+        node->kind = NODE_FUNCTION;
+        node->name = name;
+        node->children.push_back(body);
+        return node;
+    }
+
+    NodePtr parse_if()
+    {
+        NodePtr node = make_shared<Node>();
+        node->kind = NODE_IF;
+        pos++; // "if"
+        while (true)
+        {
+            NodePtr cond = parse_list({"then"});
+            if (failed() || !expect("then"))
+                return nullptr;
+            NodePtr body = parse_list({"elif", "else", "fi"});
+            if (failed())
+                return nullptr;
+            node->children.push_back(cond);
+            node->children.push_back(body);
+
+            string word = peek();
+            pos++;
+            if (word == "fi")
+                return node;
+            if (word == "else")
+            {
+                NodePtr elseBody = parse_list({"fi"});
+                if (failed() || !expect("fi"))
+                    return nullptr;
+                node->children.push_back(elseBody);
+                return node;
+            }
+            // "elif": another condition and body
+        }
+    }
+
+    NodePtr parse_while()
+    {
+        NodePtr node = make_shared<Node>();
+        node->kind = (peek() == "while") ? NODE_WHILE : NODE_UNTIL;
+        pos++;
+        NodePtr cond = parse_list({"do"});
+        if (failed() || !expect("do"))
+            return nullptr;
+        NodePtr body = parse_list({"done"});
+        if (failed() || !expect("done"))
+            return nullptr;
+        node->children = {cond, body};
+        return node;
+    }
+
+    NodePtr parse_for()
+    {
+        NodePtr node = make_shared<Node>();
+        node->kind = NODE_FOR;
+        pos++; // "for"
+        if (at_end())
+        {
+            incomplete = true;
+            return nullptr;
+        }
+        node->name = peek();
+        if (!is_valid_name(node->name))
+        {
+            fail("'" + node->name + "' is not a valid loop variable");
+            return nullptr;
+        }
+        pos++;
+        skip_newlines();
+        if (!at_end() && peek() == "in")
+        {
+            node->hasIn = true;
+            pos++;
+            while (!at_end() && !is_operator_token(peek()))
+            {
+                node->words.push_back(peek());
+                pos++;
+            }
+        }
+        if (!at_end() && peek() == ";")
+            pos++;
+        if (!expect("do"))
+            return nullptr;
+        NodePtr body = parse_list({"done"});
+        if (failed() || !expect("done"))
+            return nullptr;
+        node->children.push_back(body);
+        return node;
+    }
+};
+
+ParseResult parse_script(const string &text, NodePtr &tree, string &error)
+{
+    ScriptParser parser;
+    parser.toks = lex_script(text);
+    tree = parser.parse_list({});
+    if (parser.incomplete)
+        return PARSE_INCOMPLETE;
+    if (!parser.error.empty())
+    {
+        error = parser.error;
+        return PARSE_ERROR;
+    }
+    return PARSE_OK;
+}
+
+// ------------------- execution -------------------
+
+// Called after each run of a loop body. Returns true if the loop has to stop.
+static bool leave_loop()
+{
+    if (breakLevels > 0)
+    {
+        breakLevels--;
+        return true;
+    }
+    if (continueLevels > 0)
+    {
+        continueLevels--;
+        return continueLevels > 0; // "continue 2" continues the loop around this one
+    }
+    return returning || exiting;
+}
+
+static void run_loop(const Node &node)
+{
+    int status = 0;
+    loopDepth++;
+    if (node.kind == NODE_FOR)
+    {
+        // the words are expanded once, when the loop starts
+        vector<string> items = node.hasIn ? expand_words(node.words) : positional_args();
+        close_procsubs();
+        for (const string &item : items)
+        {
+            if (check_interrupt())
+                break;
+            set_variable(node.name, item);
+            run_node(*node.children[0]);
+            status = lastStatus;
+            if (leave_loop())
+                break;
+        }
+    }
+    else
+    {
+        while (!check_interrupt())
+        {
+            run_node(*node.children[0]);
+            if (flow_pending())
+            {
+                leave_loop(); // "break" inside the condition
+                break;
+            }
+            bool success = (lastStatus == 0);
+            if (success != (node.kind == NODE_WHILE))
+                break;
+            run_node(*node.children[1]);
+            status = lastStatus;
+            if (leave_loop())
+                break;
+        }
+    }
+    loopDepth--;
+    lastStatus = interrupted ? 130 : status;
+}
+
+void run_node(const Node &node)
+{
+    runDepth++;
+    switch (node.kind)
+    {
+    case NODE_COMMAND:
+        set_heredoc_bodies(node.heredocs);
+        execute_command(node.stages);
+        break;
+
+    case NODE_LIST:
+        if (node.children.empty())
+            lastStatus = 0; // an empty list succeeds
+        for (const NodePtr &child : node.children)
+        {
+            run_node(*child);
+            if (flow_pending())
+                break;
+        }
+        break;
+
+    case NODE_AND:
+    case NODE_OR:
+        run_node(*node.children[0]);
+        if (!flow_pending() && (lastStatus == 0) == (node.kind == NODE_AND))
+            run_node(*node.children[1]);
+        break;
+
+    case NODE_IF:
+    {
+        size_t i = 0;
+        bool done = false;
+        for (; i + 1 < node.children.size() && !done; i += 2)
+        {
+            run_node(*node.children[i]);
+            if (flow_pending())
+                break;
+            if (lastStatus == 0)
+            {
+                run_node(*node.children[i + 1]);
+                done = true;
+            }
+        }
+        if (!done && !flow_pending())
+        {
+            if (i < node.children.size())
+                run_node(*node.children[i]); // else
+            else
+                lastStatus = 0; // no branch ran
+        }
+        break;
+    }
+
+    case NODE_WHILE:
+    case NODE_UNTIL:
+    case NODE_FOR:
+        run_loop(node);
+        break;
+
+    case NODE_FUNCTION:
+        functions[node.name] = node.children[0]; // the tree is shared, not copied
+        lastStatus = 0;
+        break;
+    }
+
+    if (node.negate)
+        lastStatus = (lastStatus == 0) ? 1 : 0;
+    if (--runDepth == 0)
+        interrupted = false; // the whole command line is done
+}
+
+bool is_shell_function(const string &name)
+{
+    return functions.count(name) > 0;
+}
+
+void call_function(const vector<string> &args)
+{
+    // keep a reference, the function may redefine itself while it runs
+    NodePtr body = functions[args[0]];
+
+    vector<string> savedArgs = positional_args();
+    set_positional_args(vector<string>(args.begin() + 1, args.end()));
+    int savedLoops = loopDepth;
+    loopDepth = 0; // "break" in a function doesn't leave the caller's loop
+    functionDepth++;
+
+    run_node(*body);
+
+    functionDepth--;
+    loopDepth = savedLoops;
+    returning = false;
+    breakLevels = continueLevels = 0;
+    set_positional_args(savedArgs);
+}
+
+void flow_command(const vector<string> &args)
+{
+    int n = 1;
+    if (args.size() > 1)
+    {
+        try
+        {
+            n = stoi(args[1]);
+        }
+        catch (...)
+        {
+            cerr << args[0] << ": " << args[1] << ": numeric argument required" << endl;
+            lastStatus = 2;
+            return;
+        }
+    }
+
+    if (args[0] == "return")
+    {
+        if (functionDepth == 0)
+        {
+            cerr << "return: can only be used in a function" << endl;
+            lastStatus = 1;
+            return;
+        }
+        if (args.size() > 1)
+            lastStatus = n & 0xff;
+        returning = true;
+        return;
+    }
+
+    // break / continue
+    if (loopDepth == 0)
+    {
+        cerr << args[0] << ": only meaningful in a loop" << endl;
+        lastStatus = 1;
+        return;
+    }
+    if (n < 1)
+    {
+        cerr << args[0] << ": " << n << ": loop count out of range" << endl;
+        lastStatus = 1;
+        return;
+    }
+    if (n > loopDepth)
+        n = loopDepth;
+    if (args[0] == "break")
+        breakLevels = n;
+    else
+        continueLevels = n;
+    lastStatus = 0;
+}
+
+void request_exit(int status)
+{
+    exiting = true;
+    exitStatus = status;
+    lastStatus = status;
+}
+
+bool take_exit_request(int &status)
+{
+    if (!exiting)
+        return false;
+    exiting = false;
+    status = exitStatus;
+    return true;
+}
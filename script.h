@@ -0,0 +1,79 @@
+/*
+   script.h
+   Header file for control flow: if / while / until / for, && and ||, { ... } groups
+   and shell functions. A command line is parsed once into a tree of Nodes, so loop
+   bodies and functions run again and again from the tree, without being lexed again.
+*/
+
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+enum NodeKind
+{
+    NODE_COMMAND,  // a simple command or a pipeline of simple commands
+    NODE_LIST,     // commands separated by ; or newlines, also { ... }
+    NODE_AND,      // left && right
+    NODE_OR,       // left || right
+    NODE_IF,       // if / elif / else / fi
+    NODE_WHILE,    // while cond; do body; done
+    NODE_UNTIL,    // until cond; do body; done
+    NODE_FOR,      // for name in words; do body; done
+    NODE_FUNCTION  // name() { body }, defines the function when it runs
+};
+
+struct Node
+{
+    NodeKind kind;
+    bool negate = false; // "! cmd" inverts the exit status
+
+    // NODE_COMMAND: the words of each pipeline stage as typed, and the bodies
+    // of its here-documents (read once, used by every run of the command)
+    std::vector<std::vector<std::string>> stages;
+    std::vector<std::string> heredocs;
+
+    // NODE_LIST: the commands; NODE_AND / NODE_OR: left, right;
+    // NODE_IF: cond, body, cond, body, ... and the else body last if there is one;
+    // NODE_WHILE / NODE_UNTIL: cond, body; NODE_FOR / NODE_FUNCTION: body
+    std::vector<std::shared_ptr<Node>> children;
+
+    std::string name;               // NODE_FOR: the loop variable, NODE_FUNCTION: the function name
+    std::vector<std::string> words; // NODE_FOR: the words after "in", expanded for every run
+    bool hasIn = false;             // NODE_FOR: false for "for x; do", which loops over $@
+};
+
+enum ParseResult
+{
+    PARSE_OK,
+    PARSE_INCOMPLETE, // the text ends inside a construct, e.g. after "while true; do"
+    PARSE_ERROR
+};
+
+// Parses a command line or a script. On PARSE_ERROR 'error' describes the problem.
+// Here-document bodies given to set_heredoc_bodies() are attached to their commands.
+ParseResult parse_script(const std::string &text, std::shared_ptr<Node> &tree, std::string &error);
+
+// Runs a parsed tree; the exit status is left in lastStatus (see vars.h)
+void run_node(const Node &node);
+
+// true if 'name' is a shell function
+bool is_shell_function(const std::string &name);
+
+// Calls a shell function: args[0] is its name, args[1...] become $1, $2, ...
+void call_function(const std::vector<std::string> &args);
+
+// Builtins: "break [n]", "continue [n]" and "return [status]"
+void flow_command(const std::vector<std::string> &args);
+
+// The "exit [status]" builtin: like "return", the rest of the command line is skipped
+// (also outside of loops and functions). The shell doesn't end the process itself:
+// whoever runs the command line checks take_exit_request() afterwards.
+void request_exit(int status);
+
+// true (once) if "exit" ran; 'status' is the status it asked for
+bool take_exit_request(int &status);
+
+#endif
@@ -0,0 +1,535 @@
+/*
+scriptcmds.cpp: in-process test / [, printf, true, false and ':' builtins.
+*/
+
+#include "scriptcmds.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>   // for AT_FDCWD, AT_EACCESS
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+
+using namespace std;
+
+// ------------------- test / [ -------------------
+
+// Thrown for a malformed expression; test then exits with status 2
+struct TestError
+{
+    string message;
+};
+
+static bool is_unary_op(const string &op)
+{
+    return op.size() == 2 && op[0] == '-' && strchr("efdsrwxLhpSbcugkOGtzn", op[1]) != nullptr;
+}
+
+static bool is_binary_op(const string &op)
+{
+    static const char *ops[] = {"=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt",
+                                "-ge", "-nt", "-ot", "-ef"};
+    for (const char *o : ops)
+    {
+        if (op == o)
+            return true;
+    }
+    return false;
+}
+
+static long long to_integer(const string &text)
+{
+    // optional blanks and sign, then only digits
+    size_t start = text.find_first_not_of(" \t");
+    size_t end = text.find_last_not_of(" \t");
+    if (start != string::npos)
+    {
+        string digits = text.substr(start, end - start + 1);
+        size_t first = (digits[0] == '-' || digits[0] == '+') ? 1 : 0;
+        if (first < digits.size() && digits.find_first_not_of("0123456789", first) == string::npos)
+        {
+            errno = 0;
+            long long value = strtoll(digits.c_str(), nullptr, 10);
+            if (errno == 0)
+                return value;
+        }
+    }
+    throw TestError{text + ": integer expression expected"};
+}
+
+// One file test. Everything except -L/-h and -r/-w/-x is answered from a single stat().
+static bool file_test(char op, const string &path)
+{
+    struct stat st;
+    if (op == 'L' || op == 'h')
+        return lstat(path.c_str(), &st) == 0 && S_ISLNK(st.st_mode);
+    if (op == 'r' || op == 'w' || op == 'x')
+    {
+        // access() with the effective ids knows about root, ACLs and read-only mounts
+        int mode = (op == 'r') ? R_OK : (op == 'w') ? W_OK : X_OK;
+        return faccessat(AT_FDCWD, path.c_str(), mode, AT_EACCESS) == 0;
+    }
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+    switch (op)
+    {
+    case 'e': return true;
+    case 'f': return S_ISREG(st.st_mode);
+    case 'd': return S_ISDIR(st.st_mode);
+    case 's': return st.st_size > 0;
+    case 'p': return S_ISFIFO(st.st_mode);
+    case 'S': return S_ISSOCK(st.st_mode);
+    case 'b': return S_ISBLK(st.st_mode);
+    case 'c': return S_ISCHR(st.st_mode);
+    case 'u': return (st.st_mode & S_ISUID) != 0;
+    case 'g': return (st.st_mode & S_ISGID) != 0;
+    case 'k': return (st.st_mode & S_ISVTX) != 0;
+    case 'O': return st.st_uid == geteuid();
+    case 'G': return st.st_gid == getegid();
+    }
+    return false;
+}
+
+static bool unary_test(const string &op, const string &arg)
+{
+    if (op == "-z")
+        return arg.empty();
+    if (op == "-n")
+        return !arg.empty();
+    if (op == "-t")
+        return isatty((int)to_integer(arg));
+    return file_test(op[1], arg);
+}
+
+static bool binary_test(const string &left, const string &op, const string &right)
+{
+    if (op == "=" || op == "==")
+        return left == right;
+    if (op == "!=")
+        return left != right;
+    if (op == "<")
+        return left < right;
+    if (op == ">")
+        return left > right;
+    if (op == "-nt" || op == "-ot" || op == "-ef")
+    {
+        struct stat a, b;
+        bool haveA = stat(left.c_str(), &a) == 0, haveB = stat(right.c_str(), &b) == 0;
+        if (op == "-ef")
+            return haveA && haveB && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+        if (!haveA || !haveB)
+            return (op == "-nt") ? haveA : haveB; // an existing file is newer than a missing one
+        bool newer = a.st_mtim.tv_sec != b.st_mtim.tv_sec ? a.st_mtim.tv_sec > b.st_mtim.tv_sec
+                                                          : a.st_mtim.tv_nsec > b.st_mtim.tv_nsec;
+        bool older = a.st_mtim.tv_sec != b.st_mtim.tv_sec ? a.st_mtim.tv_sec < b.st_mtim.tv_sec
+                                                          : a.st_mtim.tv_nsec < b.st_mtim.tv_nsec;
+        return (op == "-nt") ? newer : older;
+    }
+    long long l = to_integer(left), r = to_integer(right);
+    if (op == "-eq") return l == r;
+    if (op == "-ne") return l != r;
+    if (op == "-lt") return l < r;
+    if (op == "-le") return l <= r;
+    if (op == "-gt") return l > r;
+    return l >= r; // -ge
+}
+
+// Evaluates args[begin, end). Up to 4 arguments follow the POSIX rules, which decide
+// by the number of arguments (so "[ -f ]" and "[ = ]" test non-empty strings).
+// Longer expressions go through a small parser with ! ( ) -a -o.
+struct TestParser
+{
+    const vector<string> &args;
+    size_t pos;
+    size_t end;
+
+    bool eval_short(size_t b, size_t e)
+    {
+        size_t n = e - b;
+        const vector<string> &a = args;
+        if (n == 0)
+            return false;
+        if (n == 1)
+            return !a[b].empty();
+        if (n == 2)
+        {
+            if (a[b] == "!")
+                return a[b + 1].empty();
+            if (is_unary_op(a[b]))
+                return unary_test(a[b], a[b + 1]);
+            throw TestError{a[b] + ": unary operator expected"};
+        }
+        if (n == 3)
+        {
+            if (is_binary_op(a[b + 1]))
+                return binary_test(a[b], a[b + 1], a[b + 2]);
+            if (a[b] == "!")
+                return !eval_short(b + 1, e);
+            if (a[b] == "(" && a[b + 2] == ")")
+                return !a[b + 1].empty();
+            if (a[b + 1] == "-a" || a[b + 1] == "-o")
+                return parse_all(b, e);
+            throw TestError{a[b + 1] + ": binary operator expected"};
+        }
+        if (n > 4)
+            return parse_all(b, e);
+        // 4 arguments
+        if (a[b] == "!")
+            return !eval_short(b + 1, e);
+        if (a[b] == "(" && a[e - 1] == ")")
+            return eval_short(b + 1, e - 1);
+        return parse_all(b, e);
+    }
+
+    bool parse_all(size_t b, size_t e)
+    {
+        size_t savedPos = pos, savedEnd = end;
+        pos = b;
+        end = e;
+        bool result = parse_or();
+        if (pos != end)
+            throw TestError{args[pos] + ": unexpected argument"};
+        pos = savedPos;
+        end = savedEnd;
+        return result;
+    }
+
+    bool parse_or()
+    {
+        bool result = parse_and();
+        while (pos < end && args[pos] == "-o")
+        {
+            pos++;
+            bool right = parse_and(); // both sides are evaluated, like test(1) does
+            result = result || right;
+        }
+        return result;
+    }
+
+    bool parse_and()
+    {
+        bool result = parse_not();
+        while (pos < end && args[pos] == "-a")
+        {
+            pos++;
+            bool right = parse_not();
+            result = result && right;
+        }
+        return result;
+    }
+
+    bool parse_not()
+    {
+        if (pos < end && args[pos] == "!")
+        {
+            pos++;
+            return !parse_not();
+        }
+        return parse_primary();
+    }
+
+    bool parse_primary()
+    {
+        if (pos >= end)
+            throw TestError{"argument expected"};
+        const string &word = args[pos];
+        if (word == "(")
+        {
+            pos++;
+            bool result = parse_or();
+            if (pos >= end || args[pos] != ")")
+                throw TestError{"')' expected"};
+            pos++;
+            return result;
+        }
+        if (pos + 2 < end && is_binary_op(args[pos + 1]))
+        {
+            bool result = binary_test(word, args[pos + 1], args[pos + 2]);
+            pos += 3;
+            return result;
+        }
+        if (is_unary_op(word) && pos + 1 < end)
+        {
+            bool result = unary_test(word, args[pos + 1]);
+            pos += 2;
+            return result;
+        }
+        pos++;
+        return !word.empty();
+    }
+};
+
+int test_command(const vector<string> &input)
+{
+    vector<string> args(input.begin() + 1, input.end());
+    if (input[0] == "[")
+    {
+        if (args.empty() || args.back() != "]")
+        {
+            cerr << "[: missing ']'" << endl;
+            return 2;
+        }
+        args.pop_back();
+    }
+
+    TestParser parser{args, 0, args.size()};
+    try
+    {
+        return parser.eval_short(0, args.size()) ? 0 : 1;
+    }
+    catch (const TestError &e)
+    {
+        cerr << input[0] << ": " << e.message << endl;
+        return 2;
+    }
+}
+
+// ------------------- printf -------------------
+
+// Appends the character of the backslash escape at text[i] (text[i] == '\\') and moves i
+// to its last character. In %b arguments octal escapes are written \0NNN and \c stops
+// all output ('stop' becomes true).
+static void append_escape(const string &text, size_t &i, string &out, bool inArgument, bool &stop)
+{
+    if (i + 1 >= text.size())
+    {
+        out += '\\';
+        return;
+    }
+    char c = text[++i];
+    switch (c)
+    {
+    case 'a': out += '\a'; return;
+    case 'b': out += '\b'; return;
+    case 'f': out += '\f'; return;
+    case 'n': out += '\n'; return;
+    case 'r': out += '\r'; return;
+    case 't': out += '\t'; return;
+    case 'v': out += '\v'; return;
+    case '\\': out += '\\'; return;
+    case '"': out += '"'; return;
+    case '\'': out += '\''; return;
+    case 'c':
+        if (inArgument)
+        {
+            stop = true;
+            return;
+        }
+        break;
+    case 'x':
+    {
+        int value = 0, digits = 0;
+        while (digits < 2 && i + 1 < text.size() && isxdigit((unsigned char)text[i + 1]))
+        {
+            char h = text[++i];
+            value = value * 16 + (isdigit((unsigned char)h) ? h - '0' : tolower(h) - 'a' + 10);
+            digits++;
+        }
+        if (digits == 0)
+            break;
+        out += (char)value;
+        return;
+    }
+    default:
+        if (c >= '0' && c <= '7')
+        {
+            // \NNN in the format, \0NNN in a %b argument
+            size_t start = (inArgument && c == '0') ? i + 1 : i;
+            size_t k = start;
+            int value = 0;
+            while (k < text.size() && k < start + 3 && text[k] >= '0' && text[k] <= '7')
+                value = value * 8 + (text[k++] - '0');
+            i = k - 1;
+            out += (char)value;
+            return;
+        }
+        break;
+    }
+    out += '\\'; // unknown escape: printed as it is
+    out += c;
+}
+
+// snprintf() into a string
+template <typename T>
+static string format_one(const string &spec, T value)
+{
+    int n = snprintf(nullptr, 0, spec.c_str(), value);
+    if (n <= 0)
+        return "";
+    string buf(n + 1, '\0');
+    snprintf(&buf[0], buf.size(), spec.c_str(), value);
+    buf.resize(n);
+    return buf;
+}
+
+// Numeric argument of %d, %x, ...: a number in C notation (0x1F, 017) or 'c / "c for
+// the code of the character c. Sets 'ok' to false if the text is not a valid number.
+static long long numeric_arg(const string &text, bool &ok)
+{
+    if (text.empty())
+        return 0;
+    if (text[0] == '\'' || text[0] == '"')
+        return text.size() > 1 ? (unsigned char)text[1] : 0;
+    char *end = nullptr;
+    errno = 0;
+    long long value = strtoll(text.c_str(), &end, 0);
+    if (errno == ERANGE)
+        value = (long long)strtoull(text.c_str(), &end, 0);
+    if (*end != '\0')
+    {
+        cerr << "printf: " << text << ": invalid number" << endl;
+        ok = false;
+    }
+    return value;
+}
+
+static long double float_arg(const string &text, bool &ok)
+{
+    if (text.empty())
+        return 0;
+    if (text[0] == '\'' || text[0] == '"')
+        return text.size() > 1 ? (unsigned char)text[1] : 0;
+    char *end = nullptr;
+    long double value = strtold(text.c_str(), &end);
+    if (*end != '\0')
+    {
+        cerr << "printf: " << text << ": invalid number" << endl;
+        ok = false;
+    }
+    return value;
+}
+
+int printf_command(const vector<string> &args)
+{
+    if (args.size() < 2)
+    {
+        cerr << "Usage: printf format [arguments]" << endl;
+        return 2;
+    }
+    const string &format = args[1];
+    size_t next = 2; // index of the next unused argument
+    bool ok = true;
+    bool stop = false;
+    string out;
+
+    auto take_arg = [&]() -> string {
+        return (next < args.size()) ? args[next++] : "";
+    };
+
+    do
+    {
+        size_t usedBefore = next;
+        for (size_t i = 0; i < format.size() && !stop; i++)
+        {
+            char c = format[i];
+            if (c == '\\')
+            {
+                append_escape(format, i, out, false, stop);
+                continue;
+            }
+            if (c != '%')
+            {
+                out += c;
+                continue;
+            }
+            if (i + 1 < format.size() && format[i + 1] == '%')
+            {
+                out += '%';
+                i++;
+                continue;
+            }
+
+            // %[flags][width][.precision]conversion
+            string spec = "%";
+            size_t j = i + 1;
+            while (j < format.size() && strchr("-+ #0", format[j]))
+                spec += format[j++];
+            if (j < format.size() && format[j] == '*')
+            {
+                spec += to_string(numeric_arg(take_arg(), ok));
+                j++;
+            }
+            while (j < format.size() && isdigit((unsigned char)format[j]))
+                spec += format[j++];
+            if (j < format.size() && format[j] == '.')
+            {
+                spec += format[j++];
+                if (j < format.size() && format[j] == '*')
+                {
+                    spec += to_string(numeric_arg(take_arg(), ok));
+                    j++;
+                }
+                while (j < format.size() && isdigit((unsigned char)format[j]))
+                    spec += format[j++];
+            }
+            if (j >= format.size())
+            {
+                cerr << "printf: " << format.substr(i) << ": missing conversion" << endl;
+                ok = false;
+                out += format.substr(i);
+                break;
+            }
+
+            char conv = format[j];
+            i = j;
+            switch (conv)
+            {
+            case 's':
+                out += format_one(spec + "s", take_arg().c_str());
+                break;
+            case 'b':
+            {
+                string arg = take_arg(), text;
+                for (size_t k = 0; k < arg.size() && !stop; k++)
+                {
+                    if (arg[k] == '\\')
+                        append_escape(arg, k, text, true, stop);
+                    else
+                        text += arg[k];
+                }
+                out += format_one(spec + "s", text.c_str());
+                break;
+            }
+            case 'c':
+            {
+                string arg = take_arg();
+                out += format_one(spec + "c", arg.empty() ? 0 : (int)(unsigned char)arg[0]);
+                break;
+            }
+            case 'd':
+            case 'i':
+                out += format_one(spec + "lld", numeric_arg(take_arg(), ok));
+                break;
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                out += format_one(spec + "ll" + conv, (unsigned long long)numeric_arg(take_arg(), ok));
+                break;
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                out += format_one(spec + "L" + conv, float_arg(take_arg(), ok));
+                break;
+            default:
+                cerr << "printf: %" << conv << ": invalid directive" << endl;
+                ok = false;
+                break;
+            }
+        }
+        // the format is used again for the remaining arguments, but only if it took any
+        if (next == usedBefore)
+            break;
+    } while (next < args.size() && !stop);
+
+    cout << out;
+    cout.flush();
+    return ok ? 0 : 1;
+}
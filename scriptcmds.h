@@ -0,0 +1,28 @@
+/*
+   scriptcmds.h
+   Header file for the builtins which scripts call all the time: test / [, printf,
+   true, false and ':'. They run inside the shell, so a condition or a formatted
+   print in a loop costs no fork() and no exec().
+*/
+
+#ifndef SCRIPTCMDS_H
+#define SCRIPTCMDS_H
+
+#include <string>
+#include <vector>
+
+// "test expr" and "[ expr ]". Returns the exit status: 0 true, 1 false, 2 error.
+//   files:    -e -f -d -s -r -w -x -L -h -p -S -b -c -u -g -k -O -G FILE, -t FD,
+//             F1 -nt F2, F1 -ot F2, F1 -ef F2
+//   strings:  -z S, -n S, S, S1 = S2, S1 == S2, S1 != S2, S1 < S2, S1 > S2
+//             (typed as \< and \> or quoted, otherwise they are redirections)
+//   integers: N1 -eq -ne -lt -le -gt -ge N2
+//   combined: ! EXPR, ( EXPR ), EXPR -a EXPR, EXPR -o EXPR
+int test_command(const std::vector<std::string> &args);
+
+// "printf format [args...]": %s %b %c %d %i %u %o %x %X %e %f %g %% with flags,
+// width and precision (also '*'), and the escapes \n \t \\ \0NNN \xHH ... in the format.
+// The format is used again while arguments are left. Returns the exit status.
+int printf_command(const std::vector<std::string> &args);
+
+#endif
@@ -0,0 +1,282 @@
+/*
+suggest.cpp: the command index behind "command not found" and "did you mean".
+*/
+
+#include "suggest.h"
+#include "builtins.h" // for builtin_names(), is_builtin()
+#include "script.h"   // for is_shell_function()
+#include "vars.h"     // for PATH, split_assignment()
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <iostream>
+#include <unordered_set>
+
+using namespace std;
+
+#define MAX_NAME_LENGTH 64 // longer names are not indexed (nobody mistypes those)
+#define MAX_TYPOS 2        // the most typos a suggestion may be away
+#define PREFIX_LENGTH 8    // only the start of a name goes into the index
+
+// The index is a "symmetric delete" (SymSpell) table: every word is stored under all
+// the strings we get by deleting up to MAX_TYPOS of its letters ("git": git, it, gt, gi,
+// t, i, g). Two words within k typos always have a common string after deleting at
+// most k letters from each, so a query only has to look up its own deletions (a few
+// dozen hash lookups) instead of comparing itself with every name in PATH.
+// Only the hashes are kept, sorted, so the table is one flat array; a hash collision
+// only adds a candidate, and every candidate is checked with typo_distance() anyway.
+// Looking at just the first PREFIX_LENGTH letters keeps the table small for long
+// names and still finds every word within MAX_TYPOS.
+static vector<string> words;                          // the builtins and programs
+static vector<pair<unsigned long long, int>> deletes; // (hash of a deletion, index in 'words')
+static unordered_set<string> programs;                // the names of the programs in cachedPath
+static string cachedPath;                             // the PATH the index was built from
+static vector<struct timespec> dirTimes;              // the modification times of its directories
+static bool indexed = false;
+
+// The directories of a PATH value ("" means the current directory)
+static vector<string> path_dirs(const string &path)
+{
+    vector<string> dirs;
+    size_t start = 0;
+    while (start <= path.size())
+    {
+        size_t end = path.find(':', start);
+        if (end == string::npos)
+            end = path.size();
+        string dir = path.substr(start, end - start);
+        dirs.push_back(dir.empty() ? "." : dir);
+        start = end + 1;
+    }
+    return dirs;
+}
+
+// Edit distance with insertions, deletions, substitutions and two swapped
+// neighbours ("gti" for "git"), each counting as one typo
+static int typo_distance(const string &a, const string &b)
+{
+    vector<vector<int>> d(a.size() + 1, vector<int>(b.size() + 1));
+    for (size_t i = 0; i <= a.size(); i++)
+        d[i][0] = i;
+    for (size_t j = 0; j <= b.size(); j++)
+        d[0][j] = j;
+    for (size_t i = 1; i <= a.size(); i++)
+    {
+        for (size_t j = 1; j <= b.size(); j++)
+        {
+            d[i][j] = min({d[i - 1][j] + 1, d[i][j - 1] + 1, d[i - 1][j - 1] + (a[i - 1] != b[j - 1])});
+            if (i > 1 && j > 1 && a[i - 1] == b[j - 2] && a[i - 2] == b[j - 1])
+                d[i][j] = min(d[i][j], d[i - 2][j - 2] + 1);
+        }
+    }
+    return d[a.size()][b.size()];
+}
+
+// FNV-1a, which is plenty for a few short strings
+static unsigned long long hash_text(const string &text)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for (unsigned char c : text)
+        hash = (hash ^ c) * 1099511628211ULL;
+    return hash;
+}
+
+// Adds the hashes of 'text' and of everything we get by deleting up to 'depth' more
+// letters from it. Deleting only at positions >= 'from' makes each set of deleted
+// positions come up once (a doubled letter can still give the same string twice).
+static void add_deletions(const string &text, size_t from, int depth, vector<unsigned long long> &out)
+{
+    out.push_back(hash_text(text));
+    if (depth == 0)
+        return;
+    for (size_t i = from; i < text.size(); i++)
+    {
+        string shorter = text;
+        shorter.erase(i, 1);
+        add_deletions(shorter, i, depth - 1, out);
+    }
+}
+
+// true if PATH or one of its directories changed since the index was built
+static bool index_is_stale(const string &path)
+{
+    if (!indexed || path != cachedPath)
+        return true;
+    vector<string> dirs = path_dirs(path);
+    for (size_t i = 0; i < dirs.size(); i++)
+    {
+        struct stat st;
+        struct timespec mtime = {0, 0};
+        if (stat(dirs[i].c_str(), &st) == 0)
+            mtime = st.st_mtim;
+        if (mtime.tv_sec != dirTimes[i].tv_sec || mtime.tv_nsec != dirTimes[i].tv_nsec)
+            return true;
+    }
+    return false;
+}
+
+// Reads the directories of PATH and builds the index (only when something changed)
+static void refresh_index()
+{
+    string path = get_variable("PATH");
+    if (!index_is_stale(path))
+        return;
+
+    programs.clear();
+    dirTimes.clear();
+    for (const string &dir : path_dirs(path))
+    {
+        struct stat st;
+        dirTimes.push_back((stat(dir.c_str(), &st) == 0) ? st.st_mtim : timespec{0, 0});
+        DIR *d = opendir(dir.c_str());
+        if (d == nullptr)
+            continue;
+        struct dirent *entry;
+        while ((entry = readdir(d)) != nullptr)
+        {
+            if (entry->d_name[0] == '.' || entry->d_type == DT_DIR)
+                continue;
+            if (faccessat(dirfd(d), entry->d_name, X_OK, 0) == 0)
+                programs.insert(entry->d_name);
+        }
+        closedir(d);
+    }
+
+    words.assign(builtin_names().begin(), builtin_names().end());
+    for (const string &name : programs)
+    {
+        if (name.size() <= MAX_NAME_LENGTH && !is_builtin(name))
+            words.push_back(name);
+    }
+    deletes.clear();
+    vector<unsigned long long> hashes;
+    for (size_t i = 0; i < words.size(); i++)
+    {
+        hashes.clear();
+        add_deletions(words[i].substr(0, PREFIX_LENGTH), 0, MAX_TYPOS, hashes);
+        for (unsigned long long hash : hashes)
+            deletes.push_back({hash, (int)i});
+    }
+    sort(deletes.begin(), deletes.end());
+    deletes.erase(unique(deletes.begin(), deletes.end()), deletes.end());
+
+    cachedPath = path;
+    indexed = true;
+}
+
+bool command_exists(const string &name)
+{
+    if (name.empty() || name.find('/') != string::npos)
+        return true;
+    if (is_builtin(name) || is_shell_function(name))
+        return true;
+    string path = get_variable("PATH");
+    if (indexed && path == cachedPath && programs.count(name) > 0)
+        return true;
+
+    // not in the index (or no index yet): look for it the way exec_command() does
+    for (const string &dir : path_dirs(path))
+    {
+        string file = dir + "/" + name;
+        struct stat st;
+        if (access(file.c_str(), X_OK) == 0 && stat(file.c_str(), &st) == 0 && !S_ISDIR(st.st_mode))
+            return true;
+    }
+    return false;
+}
+
+vector<string> suggest_commands(const string &name, size_t limit)
+{
+    refresh_index();
+    if (name.empty() || name.size() > MAX_NAME_LENGTH)
+        return {};
+
+    // short names get one typo, longer ones two
+    int allowed = (name.size() <= 4) ? 1 : MAX_TYPOS;
+    vector<unsigned long long> hashes;
+    add_deletions(name.substr(0, PREFIX_LENGTH), 0, allowed, hashes);
+    vector<int> found;
+    for (unsigned long long hash : hashes)
+    {
+        auto range = equal_range(deletes.begin(), deletes.end(), make_pair(hash, 0),
+                                 [](const pair<unsigned long long, int> &a, const pair<unsigned long long, int> &b)
+                                 { return a.first < b.first; });
+        for (auto it = range.first; it != range.second; ++it)
+            found.push_back(it->second);
+    }
+    sort(found.begin(), found.end());
+    found.erase(unique(found.begin(), found.end()), found.end());
+
+    // closest first; among equally close ones, those starting like 'name' ("pwdd": pwd, pwdx, pldd)
+    struct Candidate
+    {
+        int distance;
+        int commonPrefix;
+        string word;
+    };
+    vector<Candidate> ranked;
+    for (int index : found)
+    {
+        const string &word = words[index];
+        if (abs((int)word.size() - (int)name.size()) > allowed)
+            continue;
+        int distance = typo_distance(name, word);
+        if (distance > allowed)
+            continue;
+        size_t prefix = 0;
+        while (prefix < name.size() && prefix < word.size() && name[prefix] == word[prefix])
+            prefix++;
+        ranked.push_back({distance, (int)prefix, word});
+    }
+    sort(ranked.begin(), ranked.end(), [](const Candidate &a, const Candidate &b)
+         {
+             if (a.distance != b.distance)
+                 return a.distance < b.distance;
+             if (a.commonPrefix != b.commonPrefix)
+                 return a.commonPrefix > b.commonPrefix;
+             return a.word < b.word; });
+    vector<string> suggestions;
+    for (size_t i = 0; i < ranked.size() && i < limit; i++)
+        suggestions.push_back(ranked[i].word);
+    return suggestions;
+}
+
+// The command name of an execvp-style argv (after NAME=value words), nullptr if there is
+// none or it is the "run" launch policy prefix, which the child removes
+static const char *command_name(char **argv)
+{
+    string name, value;
+    while (argv[0] != nullptr && split_assignment(argv[0], name, value))
+        argv++;
+    if (argv[0] == nullptr || strcmp(argv[0], "run") == 0)
+        return nullptr;
+    return argv[0];
+}
+
+bool command_missing(char **argv)
+{
+    const char *name = command_name(argv);
+    return name != nullptr && !command_exists(name);
+}
+
+bool report_missing_command(char **argv)
+{
+    if (!command_missing(argv))
+        return false;
+    const char *name = command_name(argv);
+
+    cerr << name << ": command not found" << endl;
+    vector<string> suggestions = suggest_commands(name);
+    if (!suggestions.empty())
+    {
+        cerr << "Did you mean: ";
+        for (size_t i = 0; i < suggestions.size(); i++)
+            cerr << (i ? ", " : "") << suggestions[i];
+        cerr << endl;
+    }
+    return true;
+}
@@ -0,0 +1,31 @@
+/*
+   suggest.h
+   Header file for finding commands before they are started: "command not found" is
+   detected in the shell itself (no fork() for a typo), with "did you mean"
+   suggestions from a "symmetric delete" index of the builtins and the programs in $PATH.
+*/
+
+#ifndef SUGGEST_H
+#define SUGGEST_H
+
+#include <string>
+#include <vector>
+
+// true if 'name' can be run: a builtin, a shell function or a program in $PATH.
+// A name with a '/' always counts as found (the child reports a bad path).
+bool command_exists(const std::string &name);
+
+// Up to 'limit' builtins / programs whose names are a small number of typos away from
+// 'name' (insertions, deletions, substitutions and swapped neighbours), closest first.
+// $PATH is read again only if it or one of its directories changed.
+std::vector<std::string> suggest_commands(const std::string &name, size_t limit = 3);
+
+// true if the command an execvp-style argv would start (after NAME=value words) doesn't exist
+bool command_missing(char **argv);
+
+// Checks the command an execvp-style argv would start (after NAME=value words).
+// If it doesn't exist, prints "name: command not found" and the suggestions, and
+// returns true: the caller sets $? to 127 instead of forking.
+bool report_missing_command(char **argv);
+
+#endif
@@ -0,0 +1,295 @@
+/*
+supervise.cpp: timeout, wait and kill, built on pidfds.
+*/
+
+#include "supervise.h"
+#include "jobs.h"      // for wait_jobs(), signal_child(), open_pidfd()
+#include "launch.h"    // for exec_command()
+#include "eventloop.h" // for wait_foreground()
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h> // for snprintf()
+#include <iostream>
+
+using namespace std;
+
+#define DEFAULT_KILL_AFTER_MS 5000
+
+// The signals which can be given by name, in the order "kill -l" lists them
+static const struct
+{
+    const char *name;
+    int number;
+} signalNames[] = {
+    {"HUP", SIGHUP}, {"INT", SIGINT}, {"QUIT", SIGQUIT}, {"ILL", SIGILL},
+    {"TRAP", SIGTRAP}, {"ABRT", SIGABRT}, {"BUS", SIGBUS}, {"FPE", SIGFPE},
+    {"KILL", SIGKILL}, {"USR1", SIGUSR1}, {"SEGV", SIGSEGV}, {"USR2", SIGUSR2},
+    {"PIPE", SIGPIPE}, {"ALRM", SIGALRM}, {"TERM", SIGTERM}, {"STKFLT", SIGSTKFLT},
+    {"CHLD", SIGCHLD}, {"CONT", SIGCONT}, {"STOP", SIGSTOP}, {"TSTP", SIGTSTP},
+    {"TTIN", SIGTTIN}, {"TTOU", SIGTTOU}, {"URG", SIGURG}, {"XCPU", SIGXCPU},
+    {"XFSZ", SIGXFSZ}, {"VTALRM", SIGVTALRM}, {"PROF", SIGPROF}, {"WINCH", SIGWINCH},
+    {"POLL", SIGPOLL}, {"PWR", SIGPWR}, {"SYS", SIGSYS},
+};
+
+// "TERM", "SIGTERM", "term" or "15" -> 15. Returns -1 if unknown.
+static int parse_signal(string text)
+{
+    if (!text.empty() && text.find_first_not_of("0123456789") == string::npos)
+    {
+        int number = atoi(text.c_str());
+        return (number >= 0 && number < NSIG) ? number : -1;
+    }
+    for (char &c : text)
+        c = toupper((unsigned char)c);
+    if (text.compare(0, 3, "SIG") == 0)
+        text = text.substr(3);
+    for (const auto &entry : signalNames)
+    {
+        if (text == entry.name)
+            return entry.number;
+    }
+    return -1;
+}
+
+long long parse_duration(const string &text)
+{
+    char *end = nullptr;
+    double value = strtod(text.c_str(), &end);
+    if (text.empty() || end == text.c_str() || value < 0)
+        return -1;
+    string unit(end);
+    double factor;
+    if (unit == "" || unit == "s")
+        factor = 1000;
+    else if (unit == "ms")
+        factor = 1;
+    else if (unit == "m")
+        factor = 60 * 1000;
+    else if (unit == "h")
+        factor = 3600 * 1000;
+    else if (unit == "d")
+        factor = 86400 * 1000;
+    else
+        return -1;
+    return (long long)(value * factor);
+}
+
+int timeout_command(const vector<string> &args)
+{
+    int sig = SIGTERM;
+    long long killAfter = DEFAULT_KILL_AFTER_MS;
+    size_t i = 1;
+    for (; i + 1 < args.size() && args[i][0] == '-'; i += 2)
+    {
+        if (args[i] == "-s")
+            sig = parse_signal(args[i + 1]);
+        else if (args[i] == "-k")
+            killAfter = parse_duration(args[i + 1]);
+        else
+            break;
+        if (sig < 0 || killAfter < 0) // "-k 0": never send SIGKILL
+        {
+            cerr << "timeout: invalid value '" << args[i + 1] << "'" << endl;
+            return 125;
+        }
+    }
+    long long duration = (i < args.size()) ? parse_duration(args[i]) : -1;
+    if (duration < 0 || i + 1 >= args.size())
+    {
+        cerr << "Usage: timeout [-s SIG] [-k DURATION] DURATION cmd [args...]" << endl;
+        return 125;
+    }
+
+    vector<char *> argv;
+    for (size_t k = i + 1; k < args.size(); k++)
+        argv.push_back(const_cast<char *>(args[k].c_str()));
+    argv.push_back(nullptr);
+    const string &name = args[i + 1];
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("timeout: fork");
+        return 125;
+    }
+    if (pid == 0)
+        exec_command(argv.data()); // never returns
+
+    // the pidfd is taken before the child can be reaped, so the signals below can only reach it
+    int pidfd = open_pidfd(pid);
+    bool timedOut;
+    int status = wait_foreground(pid, name, duration, &timedOut);
+    if (timedOut)
+    {
+        send_signal(pid, pidfd, sig);
+        wait_foreground(pid, name, (killAfter > 0) ? killAfter : -1, &timedOut);
+        status = (sig == SIGKILL) ? 128 + SIGKILL : 124;
+        if (timedOut)
+        {
+            // it ignored the first signal: this one can't be ignored
+            send_signal(pid, pidfd, SIGKILL);
+            wait_foreground(pid, name);
+            status = 128 + SIGKILL;
+        }
+    }
+    if (pidfd >= 0)
+        close(pidfd);
+    return status;
+}
+
+// "%2" -> the pid of job 2, "1234" -> 1234. Returns -1 (after a message) if invalid.
+static pid_t parse_target(const string &command, const string &text)
+{
+    if (text.size() > 1 && text[0] == '%')
+    {
+        pid_t pid = job_pid(atoi(text.c_str() + 1));
+        if (pid < 0)
+            cerr << command << ": " << text << ": no such job" << endl;
+        return pid;
+    }
+    if (text.empty() || text.find_first_not_of("0123456789") != string::npos)
+    {
+        cerr << command << ": " << text << ": not a pid or job" << endl;
+        return -1;
+    }
+    return atoi(text.c_str());
+}
+
+int wait_command(const vector<string> &args)
+{
+    bool any = false;
+    vector<pid_t> pids;
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        if (args[i] == "-n")
+        {
+            any = true;
+            continue;
+        }
+        pid_t pid = parse_target("wait", args[i]);
+        if (pid < 0)
+            return 127;
+        pids.push_back(pid);
+    }
+    return wait_jobs(pids, any); // written in jobs.cpp
+}
+
+// "kill -l": the names of all signals. "kill -L": a table with their numbers.
+// "kill -l 9 TERM 143": the name of a number (also of an exit status like 143 = 128 + 15),
+// the number of a name.
+static int list_signals(const vector<string> &args)
+{
+    size_t count = sizeof(signalNames) / sizeof(signalNames[0]);
+    if (args.size() == 2)
+    {
+        bool table = (args[1] == "-L");
+        size_t perLine = table ? 7 : 16;
+        string line;
+        for (size_t k = 0; k < count; k++)
+        {
+            char entry[32];
+            if (table)
+                snprintf(entry, sizeof(entry), "%2d %-8s", signalNames[k].number, signalNames[k].name);
+            else
+                snprintf(entry, sizeof(entry), "%s ", signalNames[k].name);
+            line += entry;
+            if (k % perLine == perLine - 1 || k + 1 == count)
+            {
+                line.erase(line.find_last_not_of(' ') + 1); // like /bin/kill, no spaces at the end
+                cout << line << endl;
+                line.clear();
+            }
+        }
+        return 0;
+    }
+
+    int status = 0;
+    for (size_t i = 2; i < args.size(); i++)
+    {
+        int number = parse_signal(args[i]);
+        bool isNumber = args[i].find_first_not_of("0123456789") == string::npos;
+        if (isNumber && number < 0 && atoi(args[i].c_str()) > 128 && atoi(args[i].c_str()) < 128 + NSIG)
+            number = atoi(args[i].c_str()) - 128; // an exit status of a killed process
+        const char *name = nullptr;
+        for (size_t k = 0; k < count && number > 0; k++)
+        {
+            if (signalNames[k].number == number)
+                name = signalNames[k].name;
+        }
+        if (name == nullptr)
+        {
+            cerr << "kill: unknown signal: " << args[i] << endl;
+            status = 1;
+        }
+        else if (isNumber)
+            cout << name << endl;
+        else
+            cout << number << endl;
+    }
+    return status;
+}
+
+int kill_command(const vector<string> &args)
+{
+    if (args.size() > 1 && (args[1] == "-l" || args[1] == "-L"))
+        return list_signals(args);
+
+    int sig = SIGTERM;
+    size_t i = 1;
+    if (i < args.size() && args[i] == "--")
+        i++; // "kill -- -1234": no signal given, the rest are targets
+    else if (i + 1 < args.size() && args[i] == "-s")
+    {
+        sig = parse_signal(args[i + 1]);
+        i += 2;
+    }
+    else if (i < args.size() && args[i].size() > 1 && args[i][0] == '-')
+    {
+        sig = parse_signal(args[i].substr(1));
+        i++;
+    }
+    if (sig < 0)
+    {
+        cerr << "kill: unknown signal" << endl;
+        return 2;
+    }
+    if (i < args.size() && args[i] == "--" && args[i - 1] != "--")
+        i++; // "kill -TERM -- -1234"
+    if (i >= args.size())
+    {
+        cerr << "Usage: kill [-s SIG | -SIG] [--] pid|-pgid|%job ... | kill -l [SIG] | kill -L" << endl;
+        return 2;
+    }
+
+    int status = 0;
+    for (; i < args.size(); i++)
+    {
+        // 0 and -pgid name a process group: kill(2) signals all of its processes
+        const string &text = args[i];
+        if (text == "0" || (text.size() > 1 && text[0] == '-' && text.find_first_not_of("0123456789", 1) == string::npos))
+        {
+            pid_t group = atoi(text.c_str());
+            if (kill(group, sig) != 0)
+            {
+                cerr << "kill: (" << group << ") - " << strerror(errno) << endl;
+                status = 1;
+            }
+            continue;
+        }
+        pid_t pid = parse_target("kill", text);
+        if (pid < 0)
+        {
+            status = 1;
+            continue;
+        }
+        if (signal_child(pid, sig) != 0)
+        {
+            cerr << "kill: (" << pid << ") - " << strerror(errno) << endl;
+            status = 1;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,32 @@
+/*
+   supervise.h
+   Header file for the builtins which supervise children through pidfds:
+   timeout (a deadline for a command), wait (also "wait -n") and kill.
+*/
+
+#ifndef SUPERVISE_H
+#define SUPERVISE_H
+
+#include <string>
+#include <vector>
+
+// "10", "1.5", "500ms", "30s", "2m", "1h", "1d" -> milliseconds. Returns -1 if invalid.
+// (also used for the interval of "watch -n")
+long long parse_duration(const std::string &text);
+
+// "timeout [-s SIG] [-k DURATION] DURATION cmd [args...]": runs cmd and sends it SIG
+// (SIGTERM by default) once DURATION is over, then SIGKILL if it is still there after
+// the -k time (5s by default, "-k 0" never sends it). Durations: 10, 1.5, 500ms, 30s, 2m, 1h.
+// Returns cmd's exit status, or 124 if it timed out (137 if it needed SIGKILL).
+int timeout_command(const std::vector<std::string> &args);
+
+// "wait [-n] [pid|%job ...]": waits for the given jobs, or all background jobs.
+// With -n it returns as soon as one of them has finished, with its exit status.
+int wait_command(const std::vector<std::string> &args);
+
+// "kill [-s SIG | -SIG] [--] pid|-pgid|%job ...": a signal by name (TERM, SIGTERM) or number.
+// Our own jobs are signalled through their pidfd; 0 and -pgid (process groups) go to kill(2).
+// "kill -l [SIG|status ...]" and "kill -L" list the signals like /bin/kill.
+int kill_command(const std::vector<std::string> &args);
+
+#endif
@@ -0,0 +1,736 @@
+/*
+textscan.cpp: grep for fixed strings and wc, inside the shell.
+The inner loops (count a byte, find a string, count words) have an AVX2, an SSE2 and
+a plain version; the best one this CPU supports is chosen the first time it is needed.
+*/
+
+#include "textscan.h"
+#include "eventloop.h" // for take_interrupt(), wait_for_input()
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+
+using namespace std;
+
+#define BLOCK_SIZE (1 << 20)        // bytes read at once from pipes (and files which can't be mapped)
+#define BINARY_CHECK_SIZE (32 << 10) // grep looks for a NUL byte in this much of the input
+#define OUTPUT_FLUSH_SIZE (64 << 10) // grep / wc write their output in chunks this big
+
+// The three inner loops, in one version for each instruction set
+struct ScanKernels
+{
+    const char *name;
+    // how often c occurs in p[0..n)
+    size_t (*count_byte)(const char *p, size_t n, char c);
+    // the first occurrence of pattern[0..m) in p[0..n), nullptr if there is none (m >= 1)
+    const char *(*find)(const char *p, size_t n, const char *pattern, size_t m);
+    // how many words start in p[0..n); *inWord says if the byte before p was part of a word
+    size_t (*count_words)(const char *p, size_t n, bool *inWord);
+};
+
+// ------------------- plain C++ -------------------
+
+static bool is_space_byte(unsigned char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r'); // like isspace() in the C locale
+}
+
+static size_t count_byte_scalar(const char *p, size_t n, char c)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++)
+        count += (p[i] == c);
+    return count;
+}
+
+static const char *find_scalar(const char *p, size_t n, const char *pattern, size_t m)
+{
+    return (const char *)memmem(p, n, pattern, m);
+}
+
+static size_t count_words_scalar(const char *p, size_t n, bool *inWord)
+{
+    size_t words = 0;
+    bool in = *inWord;
+    for (size_t i = 0; i < n; i++)
+    {
+        bool space = is_space_byte(p[i]);
+        if (!space && !in)
+            words++;
+        in = !space;
+    }
+    *inWord = in;
+    return words;
+}
+
+#ifdef HAVE_X86_KERNELS
+
+// ------------------- SSE2 (16 bytes at a time) -------------------
+
+__attribute__((target("sse2"))) static size_t count_byte_sse2(const char *p, size_t n, char c)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    size_t count = 0, i = 0;
+    while (n - i >= 16)
+    {
+        // every byte of 'counts' counts up to 255 matches, then they are added up with psadbw
+        __m128i counts = _mm_setzero_si128();
+        size_t stop = i + min((n - i) / 16, (size_t)255) * 16;
+        for (; i < stop; i += 16)
+        {
+            __m128i bytes = _mm_loadu_si128((const __m128i *)(p + i));
+            counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(bytes, needle)); // a match is -1
+        }
+        __m128i sums = _mm_sad_epu8(counts, _mm_setzero_si128());
+        count += _mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4);
+    }
+    return count + count_byte_scalar(p + i, n - i, c);
+}
+
+// Compares the first and the last byte of the pattern at 16 positions at once and
+// only calls memcmp() where both fit (Wojciech Mula's "SIMD-friendly" substring search)
+__attribute__((target("sse2"))) static const char *find_sse2(const char *p, size_t n, const char *pattern, size_t m)
+{
+    if (m > n)
+        return nullptr;
+    if (m == 1)
+        return (const char *)memchr(p, pattern[0], n);
+    const __m128i first = _mm_set1_epi8(pattern[0]);
+    const __m128i last = _mm_set1_epi8(pattern[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 16 <= n; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(p + i + m - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask != 0)
+        {
+            int bit = __builtin_ctz(mask);
+            if (memcmp(p + i + bit + 1, pattern + 1, m - 2) == 0)
+                return p + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return find_scalar(p + i, n - i, pattern, m);
+}
+
+// 1 bits for the bytes which are ' ' or '\t'..'\r'
+__attribute__((target("sse2"))) static inline unsigned space_mask_sse2(__m128i bytes)
+{
+    __m128i spaces = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '));
+    __m128i shifted = _mm_sub_epi8(bytes, _mm_set1_epi8('\t')); // '\t'..'\r' become 0..4
+    __m128i controls = _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(4)), shifted);
+    return _mm_movemask_epi8(_mm_or_si128(spaces, controls));
+}
+
+__attribute__((target("sse2"))) static size_t count_words_sse2(const char *p, size_t n, bool *inWord)
+{
+    unsigned carry = *inWord ? 1 : 0; // was the byte before this block part of a word?
+    size_t words = 0, i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        unsigned word = ~space_mask_sse2(_mm_loadu_si128((const __m128i *)(p + i))) & 0xFFFF;
+        unsigned starts = word & ~((word << 1) | carry); // a word byte after a space
+        words += __builtin_popcount(starts);
+        carry = word >> 15;
+    }
+    bool in = (carry != 0);
+    words += count_words_scalar(p + i, n - i, &in);
+    *inWord = in;
+    return words;
+}
+
+// ------------------- AVX2 (32 bytes at a time) -------------------
+
+__attribute__((target("avx2"))) static size_t count_byte_avx2(const char *p, size_t n, char c)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    size_t count = 0, i = 0;
+    while (n - i >= 32)
+    {
+        __m256i counts = _mm256_setzero_si256();
+        size_t stop = i + min((n - i) / 32, (size_t)255) * 32;
+        for (; i < stop; i += 32)
+        {
+            __m256i bytes = _mm256_loadu_si256((const __m256i *)(p + i));
+            counts = _mm256_sub_epi8(counts, _mm256_cmpeq_epi8(bytes, needle));
+        }
+        __m256i sums = _mm256_sad_epu8(counts, _mm256_setzero_si256());
+        __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+        count += _mm_cvtsi128_si32(half) + _mm_extract_epi16(half, 4);
+    }
+    return count + count_byte_scalar(p + i, n - i, c);
+}
+
+__attribute__((target("avx2"))) static const char *find_avx2(const char *p, size_t n, const char *pattern, size_t m)
+{
+    if (m > n)
+        return nullptr;
+    if (m == 1)
+        return (const char *)memchr(p, pattern[0], n);
+    const __m256i first = _mm256_set1_epi8(pattern[0]);
+    const __m256i last = _mm256_set1_epi8(pattern[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 32 <= n; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(p + i + m - 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        while (mask != 0)
+        {
+            int bit = __builtin_ctz(mask);
+            if (memcmp(p + i + bit + 1, pattern + 1, m - 2) == 0)
+                return p + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return find_scalar(p + i, n - i, pattern, m);
+}
+
+__attribute__((target("avx2"))) static inline unsigned space_mask_avx2(__m256i bytes)
+{
+    __m256i spaces = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' '));
+    __m256i shifted = _mm256_sub_epi8(bytes, _mm256_set1_epi8('\t'));
+    __m256i controls = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(4)), shifted);
+    return _mm256_movemask_epi8(_mm256_or_si256(spaces, controls));
+}
+
+__attribute__((target("avx2,popcnt"))) static size_t count_words_avx2(const char *p, size_t n, bool *inWord)
+{
+    unsigned carry = *inWord ? 1 : 0;
+    size_t words = 0, i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        unsigned word = ~space_mask_avx2(_mm256_loadu_si256((const __m256i *)(p + i)));
+        unsigned starts = word & ~((word << 1) | carry);
+        words += __builtin_popcount(starts);
+        carry = word >> 31;
+    }
+    bool in = (carry != 0);
+    words += count_words_scalar(p + i, n - i, &in);
+    *inWord = in;
+    return words;
+}
+
+#endif // HAVE_X86_KERNELS
+
+static ScanKernels pick_kernels()
+{
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+        return {"avx2", count_byte_avx2, find_avx2, count_words_avx2};
+    if (__builtin_cpu_supports("sse2"))
+        return {"sse2", count_byte_sse2, find_sse2, count_words_sse2};
+#endif
+    return {"scalar", count_byte_scalar, find_scalar, count_words_scalar};
+}
+
+static const ScanKernels &kernels()
+{
+    static const ScanKernels chosen = pick_kernels();
+    return chosen;
+}
+
+const char *scan_kernel_name()
+{
+    return kernels().name;
+}
+
+// ------------------- input and output -------------------
+
+// Calls process() with the rest of fd's data: a regular file is mmap()ed and passed in
+// one piece, anything else is read in blocks of BLOCK_SIZE. With wholeLines, a block
+// always ends with a '\n' (or the end of the input), so no line is split in two.
+// process() returns false to stop early. Returns 0, or the errno of a failed read()
+// (EINTR for Ctrl+C, which is checked before every block: the input may never end).
+static int for_each_block(int fd, bool wholeLines, const function<bool(const char *, size_t)> &process)
+{
+    struct stat st;
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    bool regular = (fstat(fd, &st) == 0 && S_ISREG(st.st_mode));
+    if (regular && offset >= 0 && st.st_size > offset)
+    {
+        // mmap() needs an offset which is a multiple of the page size
+        off_t start = offset - offset % sysconf(_SC_PAGESIZE);
+        size_t length = st.st_size - start;
+        void *map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, start);
+        if (map != MAP_FAILED)
+        {
+            madvise(map, length, MADV_SEQUENTIAL); // read ahead, and drop pages behind us
+            process((const char *)map + (offset - start), st.st_size - offset);
+            munmap(map, length);
+            lseek(fd, st.st_size, SEEK_SET); // like read() up to the end
+            return 0;
+        }
+    }
+
+    vector<char> buffer(BLOCK_SIZE);
+    size_t used = 0; // bytes in the buffer which have not been processed yet
+    while (true)
+    {
+        // a pipe or device may have nothing to read for a long time
+        if ((!regular && !wait_for_input(fd)) || take_interrupt())
+            return EINTR;
+        ssize_t n = read(fd, buffer.data() + used, buffer.size() - used);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return errno;
+        if (n == 0)
+            break;
+        used += n;
+        size_t ready = used; // how much can be processed now
+        if (wholeLines)
+        {
+            const char *newline = (const char *)memrchr(buffer.data(), '\n', used);
+            if (newline == nullptr)
+            {
+                if (used == buffer.size())
+                    buffer.resize(buffer.size() * 2); // a very long line
+                continue;
+            }
+            ready = newline + 1 - buffer.data();
+        }
+        if (!process(buffer.data(), ready))
+            return 0;
+        // keep the start of the unfinished line for the next block
+        memmove(buffer.data(), buffer.data() + ready, used - ready);
+        used -= ready;
+    }
+    if (used > 0)
+        process(buffer.data(), used);
+    return 0;
+}
+
+// Collects output and write()s it in big chunks
+struct Output
+{
+    int fd;
+    string buffer;
+    bool failed = false; // e.g. "grep x file | head -1": the reader is gone
+
+    void add(const char *text, size_t length)
+    {
+        buffer.append(text, length);
+        if (buffer.size() >= OUTPUT_FLUSH_SIZE)
+            flush();
+    }
+    void add(const string &text)
+    {
+        add(text.data(), text.size());
+    }
+    void flush()
+    {
+        size_t done = 0;
+        while (!failed && done < buffer.size())
+        {
+            ssize_t n = write(fd, buffer.data() + done, buffer.size() - done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                failed = true;
+            else
+                done += n;
+        }
+        buffer.clear();
+    }
+};
+
+// ------------------- the arguments -------------------
+
+struct ScanArgs
+{
+    bool grep = false;
+    bool count = false, invert = false, lineNumbers = false;    // grep -c -v -n
+    bool lines = false, words = false, bytes = false;           // wc -l -w -c
+    string pattern;
+    vector<string> files; // empty: read the input
+};
+
+// Parses the arguments. Returns false if they need the real grep / wc.
+static bool parse_scan_args(const vector<string> &args, ScanArgs &parsed)
+{
+    if (args.empty() || (args[0] != "grep" && args[0] != "wc"))
+        return false;
+    parsed.grep = (args[0] == "grep");
+    bool fixed = false;
+    size_t i = 1;
+    for (; i < args.size() && args[i].size() > 1 && args[i][0] == '-'; i++)
+    {
+        if (args[i] == "--")
+        {
+            i++;
+            break;
+        }
+        for (size_t k = 1; k < args[i].size(); k++)
+        {
+            char option = args[i][k];
+            if (parsed.grep && option == 'F')
+                fixed = true;
+            else if (parsed.grep && option == 'c')
+                parsed.count = true;
+            else if (parsed.grep && option == 'v')
+                parsed.invert = true;
+            else if (parsed.grep && option == 'n')
+                parsed.lineNumbers = true;
+            else if (!parsed.grep && option == 'l')
+                parsed.lines = true;
+            else if (!parsed.grep && option == 'w')
+                parsed.words = true;
+            else if (!parsed.grep && option == 'c')
+                parsed.bytes = true;
+            else
+                return false; // -i, -e, -r, wc -m, ...
+        }
+    }
+
+    if (parsed.grep)
+    {
+        if (i >= args.size())
+            return false;
+        parsed.pattern = args[i++];
+        // an empty pattern or several lines of patterns are left for grep, and so
+        // is a pattern which means something else as a regular expression
+        if (parsed.pattern.empty() || parsed.pattern.find('\n') != string::npos)
+            return false;
+        if (!fixed && parsed.pattern.find_first_of(".[*^$\\") != string::npos)
+            return false;
+    }
+    else if (!parsed.lines && !parsed.words && !parsed.bytes)
+        parsed.lines = parsed.words = parsed.bytes = true; // plain "wc"
+
+    for (; i < args.size(); i++)
+    {
+        if (args[i].size() > 1 && args[i][0] == '-')
+            return false; // an option after the file names, the real programs accept those
+        parsed.files.push_back(args[i]);
+    }
+    return true;
+}
+
+bool scan_supported(const vector<string> &args, int in_fd)
+{
+    if (args.empty() || args.back() == "&")
+        return false; // a background job needs its own process
+    ScanArgs parsed;
+    if (!parse_scan_args(args, parsed))
+        return false;
+    bool readsInput = parsed.files.empty() ||
+                      find(parsed.files.begin(), parsed.files.end(), "-") != parsed.files.end();
+    // reading the terminal inside the shell could not be stopped with Ctrl+C
+    return !(readsInput && isatty(in_fd));
+}
+
+// Opens a file argument ("-" is in_fd). Prints an error and returns -1 if that fails.
+static int open_input(const string &command, const string &file, int in_fd)
+{
+    if (file == "-")
+        return in_fd;
+    // O_NONBLOCK: opening a FIFO would wait for a writer, where Ctrl+C could not stop us
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0)
+        cerr << command << ": " << file << ": " << strerror(errno) << endl;
+    else
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    return fd;
+}
+
+// ------------------- grep -------------------
+
+// Greps one input. Returns the number of selected lines, -1 if it could not be read,
+// or -2 for Ctrl+C.
+static long long grep_fd(int fd, const string &name, bool showName, const ScanArgs &opt, Output &out)
+{
+    const ScanKernels &k = kernels();
+    const char *pattern = opt.pattern.data();
+    size_t patternLength = opt.pattern.size();
+    string prefix = showName ? name + ":" : "";
+    long long selected = 0;
+    long long lineNumber = 0; // of the last line looked at
+    bool checkedBinary = false, binary = false, binaryMatched = false;
+
+    // one selected line, [line, lineEnd) without the '\n'
+    auto select = [&](const char *line, const char *lineEnd)
+    {
+        selected++;
+        if (opt.count)
+            return true;
+        if (binary)
+        {
+            binaryMatched = true; // like grep, don't print lines of a binary file
+            return false;
+        }
+        out.add(prefix);
+        if (opt.lineNumbers)
+            out.add(to_string(lineNumber) + ":");
+        out.add(line, lineEnd - line);
+        out.add("\n", 1);
+        return !out.failed;
+    };
+
+    int err = for_each_block(fd, true, [&](const char *data, size_t length)
+    {
+        if (!checkedBinary)
+        {
+            binary = memchr(data, '\0', min(length, (size_t)BINARY_CHECK_SIZE)) != nullptr;
+            checkedBinary = true;
+        }
+        const char *p = data, *end = data + length;
+        while (p < end)
+        {
+            // the next line containing the pattern is [lineStart, lineEnd)
+            const char *match = k.find(p, end - p, pattern, patternLength);
+            const char *lineStart = end, *lineEnd = end;
+            if (match != nullptr)
+            {
+                const char *newline = (const char *)memrchr(p, '\n', match - p);
+                lineStart = (newline != nullptr) ? newline + 1 : p;
+                newline = (const char *)memchr(match, '\n', end - match);
+                lineEnd = (newline != nullptr) ? newline : end;
+            }
+
+            // none of the lines before it contain the pattern
+            if (p < lineStart)
+            {
+                size_t lines = k.count_byte(p, lineStart - p, '\n') + (lineStart[-1] != '\n');
+                if (!opt.invert || opt.count)
+                {
+                    lineNumber += lines;
+                    if (opt.invert)
+                        selected += lines;
+                }
+                else if (prefix.empty() && !opt.lineNumbers && !binary)
+                {
+                    // grep -v: all of them are printed as they are
+                    out.add(p, lineStart - p);
+                    if (lineStart[-1] != '\n')
+                        out.add("\n", 1);
+                    lineNumber += lines;
+                    selected += lines;
+                }
+                else
+                {
+                    for (const char *line = p; line < lineStart;)
+                    {
+                        const char *newline = (const char *)memchr(line, '\n', lineStart - line);
+                        const char *stop = (newline != nullptr) ? newline : lineStart;
+                        lineNumber++;
+                        if (!select(line, stop))
+                            return false;
+                        line = stop + 1;
+                    }
+                }
+            }
+            if (match == nullptr)
+                break;
+
+            lineNumber++;
+            if (!opt.invert && !select(lineStart, lineEnd))
+                return false;
+            p = (lineEnd < end) ? lineEnd + 1 : end;
+        }
+        return !out.failed;
+    });
+
+    if (err == EINTR)
+        return -2; // Ctrl+C
+    if (err != 0)
+    {
+        out.flush();
+        cerr << "grep: " << name << ": " << strerror(err) << endl;
+        return -1;
+    }
+    if (binaryMatched)
+    {
+        out.flush();
+        cerr << "grep: " << name << ": binary file matches" << endl;
+    }
+    if (opt.count)
+        out.add(prefix + to_string(selected) + "\n");
+    return selected;
+}
+
+static int run_grep(const ScanArgs &opt, int in_fd, int out_fd)
+{
+    Output out;
+    out.fd = out_fd;
+    vector<string> files = opt.files;
+    if (files.empty())
+        files.push_back("-");
+    long long selected = 0;
+    bool failed = false;
+    for (const string &file : files)
+    {
+        int fd = open_input("grep", file, in_fd);
+        if (fd < 0)
+        {
+            failed = true;
+            continue;
+        }
+        long long n = grep_fd(fd, (file == "-") ? "(standard input)" : file, files.size() > 1, opt, out);
+        if (fd != in_fd)
+            close(fd);
+        if (n == -2)
+        {
+            out.flush();
+            cerr << endl; // stdout may be a file or a pipe
+            return 130;
+        }
+        if (n < 0)
+            failed = true;
+        else
+            selected += n;
+        if (out.failed)
+            break;
+    }
+    out.flush();
+    if (failed)
+        return 2;
+    return (selected > 0) ? 0 : 1;
+}
+
+// ------------------- wc -------------------
+
+struct WcCounts
+{
+    long long lines = 0, words = 0, bytes = 0;
+};
+
+// Counts one input. Returns 0 or an errno value.
+static int wc_fd(int fd, const ScanArgs &opt, WcCounts &counts)
+{
+    struct stat st;
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    if (!opt.lines && !opt.words && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && offset >= 0 && st.st_size > 0)
+    {
+        // only the size is needed, and the file system knows it
+        counts.bytes = max((off_t)0, st.st_size - offset);
+        return 0;
+    }
+    const ScanKernels &k = kernels();
+    bool inWord = false;
+    return for_each_block(fd, false, [&](const char *data, size_t length)
+    {
+        counts.bytes += length;
+        if (opt.lines)
+            counts.lines += k.count_byte(data, length, '\n');
+        if (opt.words)
+            counts.words += k.count_words(data, length, &inWord);
+        return true;
+    });
+}
+
+static int run_wc(const ScanArgs &opt, int in_fd, int out_fd)
+{
+    vector<string> files = opt.files;
+    bool named = !files.empty(); // "wc < file" prints no name
+    if (!named)
+        files.push_back("-");
+
+    // like wc: the columns are as wide as the total size of the files, but at least 7
+    // for pipes (whose size is unknown), and not padded when there is only one number
+    long long totalSize = 0;
+    bool unknownSize = false;
+    for (const string &file : files)
+    {
+        struct stat st;
+        int result = (file == "-") ? fstat(in_fd, &st) : stat(file.c_str(), &st);
+        if (result == 0 && S_ISREG(st.st_mode))
+            totalSize += st.st_size;
+        else if (result == 0)
+            unknownSize = true;
+    }
+    int width = to_string(totalSize).size();
+    if (unknownSize)
+        width = max(width, 7);
+    if (files.size() == 1 && (opt.lines + opt.words + opt.bytes) == 1)
+        width = 1;
+
+    Output out;
+    out.fd = out_fd;
+    auto print = [&](const WcCounts &c, const string &name)
+    {
+        string line;
+        auto column = [&](long long value)
+        {
+            string text = to_string(value);
+            if (!line.empty())
+                line += " ";
+            line += string(max(0, width - (int)text.size()), ' ') + text;
+        };
+        if (opt.lines)
+            column(c.lines);
+        if (opt.words)
+            column(c.words);
+        if (opt.bytes)
+            column(c.bytes);
+        if (!name.empty())
+            line += " " + name;
+        out.add(line + "\n");
+    };
+
+    WcCounts total;
+    int status = 0;
+    for (const string &file : files)
+    {
+        int fd = open_input("wc", file, in_fd);
+        if (fd < 0)
+        {
+            status = 1;
+            continue;
+        }
+        WcCounts counts;
+        int err = wc_fd(fd, opt, counts);
+        if (fd != in_fd)
+            close(fd);
+        if (err == EINTR)
+        {
+            out.flush();
+            cerr << endl; // Ctrl+C, see grep
+            return 130;
+        }
+        if (err != 0)
+        {
+            out.flush();
+            cerr << "wc: " << file << ": " << strerror(err) << endl;
+            status = 1;
+            continue;
+        }
+        print(counts, named ? file : "");
+        total.lines += counts.lines;
+        total.words += counts.words;
+        total.bytes += counts.bytes;
+    }
+    if (files.size() > 1)
+        print(total, "total");
+    out.flush();
+    return status;
+}
+
+int run_scan(const vector<string> &args, int in_fd, int out_fd)
+{
+    ScanArgs parsed;
+    if (!parse_scan_args(args, parsed))
+        return 2;
+    cout.flush(); // anything printed before us comes first
+
+    // a reader which went away ("grep x big | head -1") must not kill the shell with SIGPIPE
+    void (*oldHandler)(int) = signal(SIGPIPE, SIG_IGN);
+    int status = parsed.grep ? run_grep(parsed, in_fd, out_fd) : run_wc(parsed, in_fd, out_fd);
+    signal(SIGPIPE, oldHandler);
+    return status;
+}
@@ -0,0 +1,29 @@
+/*
+   textscan.h
+   Header file for the in-shell grep (fixed strings) and wc builtins. Regular files
+   are mmap()ed, pipes are read in large blocks, and the bytes are searched with
+   SSE2 / AVX2 kernels picked at runtime for this CPU (plain C++ everywhere else).
+*/
+
+#ifndef TEXTSCAN_H
+#define TEXTSCAN_H
+
+#include <string>
+#include <vector>
+
+// Returns true if our grep / wc can handle these arguments, given that their input
+// would come from in_fd. Anything else (grep -i, a regular expression, wc -L, ...)
+// is left for the real program.
+//   grep [-F] [-c] [-v] [-n] PATTERN [files...]   PATTERN is a fixed string
+//   wc [-l] [-w] [-c] [files...]
+bool scan_supported(const std::vector<std::string> &args, int in_fd);
+
+// Runs grep or wc on the given files (or in_fd when no file / "-" is given), writing
+// to out_fd. Returns the exit status like the real programs:
+// grep 0 = lines selected, 1 = none, 2 = error; wc 0 = ok, 1 = a file failed.
+int run_scan(const std::vector<std::string> &args, int in_fd, int out_fd);
+
+// the kernel in use: "avx2", "sse2" or "scalar"
+const char *scan_kernel_name();
+
+#endif
@@ -0,0 +1,231 @@
+/*
+uring.cpp: batched statx()/openat() through io_uring, set up with raw syscalls.
+*/
+
+#include "uring.h"
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h> // for nanosleep()
+
+using namespace std;
+
+#define URING_DEPTH 256 // requests in flight at the same time
+
+// The rings shared with the kernel. We write submissions (SQ), the kernel writes completions (CQ).
+struct Ring
+{
+    int fd = -1;
+    unsigned *sqTail = nullptr;
+    unsigned *sqMask = nullptr;
+    unsigned *sqArray = nullptr;
+    unsigned sqEntries = 0;
+    struct io_uring_sqe *sqes = nullptr;
+    unsigned *cqHead = nullptr;
+    unsigned *cqTail = nullptr;
+    unsigned *cqMask = nullptr;
+    struct io_uring_cqe *cqes = nullptr;
+};
+
+static Ring ring;
+static int ringState = 0; // 0 = not tried yet, 1 = ready, -1 = unavailable
+
+// Sets the ring up the first time it is needed. It stays open for the whole session
+// (the kernel creates the fd close-on-exec, so children never see it).
+static bool setup_ring()
+{
+    if (ringState != 0)
+        return ringState > 0;
+    ringState = -1;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP;
+    int fd = (int)syscall(__NR_io_uring_setup, URING_DEPTH, &params);
+    if (fd < 0)
+        return false;
+
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0; // both rings in one mapping
+    if (single)
+        sqSize = cqSize = (sqSize > cqSize) ? sqSize : cqSize;
+
+    void *sq = mmap(nullptr, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    void *cq = single ? sq : mmap(nullptr, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    void *sqes = mmap(nullptr, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED)
+    {
+        close(fd);
+        return false;
+    }
+
+    char *sqBase = (char *)sq;
+    char *cqBase = (char *)cq;
+    ring.fd = fd;
+    ring.sqTail = (unsigned *)(sqBase + params.sq_off.tail);
+    ring.sqMask = (unsigned *)(sqBase + params.sq_off.ring_mask);
+    ring.sqArray = (unsigned *)(sqBase + params.sq_off.array);
+    ring.sqEntries = params.sq_entries;
+    ring.sqes = (struct io_uring_sqe *)sqes;
+    ring.cqHead = (unsigned *)(cqBase + params.cq_off.head);
+    ring.cqTail = (unsigned *)(cqBase + params.cq_off.tail);
+    ring.cqMask = (unsigned *)(cqBase + params.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe *)(cqBase + params.cq_off.cqes);
+    ringState = 1;
+    return true;
+}
+
+bool uring_available()
+{
+    return setup_ring();
+}
+
+// Takes the completions the kernel has posted so far and hands them to complete()
+template <typename Complete>
+static void take_completions(Complete &complete, vector<bool> &completed, size_t &done, unsigned &inFlight)
+{
+    unsigned head = *ring.cqHead;
+    unsigned cqTail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+    while (head != cqTail)
+    {
+        struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cqMask];
+        size_t i = (size_t)cqe->user_data;
+        if (i < completed.size() && !completed[i])
+        {
+            completed[i] = true;
+            complete(i, cqe->res);
+            done++;
+        }
+        head++;
+        inFlight--;
+    }
+    __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+}
+
+// Runs 'count' requests. prepare(sqe, i) fills in request i, complete(i, result) gets
+// its result. The submission queue is kept full: as soon as some requests complete,
+// new ones take their place, so up to URING_DEPTH are always in flight.
+// Every request is completed exactly once, and none is left with the kernel on return
+// (it would still write into the caller's buffers).
+template <typename Prepare, typename Complete>
+static void run_batch(size_t count, Prepare prepare, Complete complete)
+{
+    size_t next = 0;      // next request to queue
+    size_t done = 0;      // requests completed
+    unsigned queued = 0;  // in the SQ, not yet taken by the kernel
+    unsigned inFlight = 0; // taken by the kernel, not yet completed
+    vector<bool> completed(count, false); // completions come in any order
+
+    while (done < count)
+    {
+        // fill the free slots
+        unsigned tail = *ring.sqTail; // only we write the tail
+        while (next < count && queued + inFlight < ring.sqEntries)
+        {
+            unsigned index = tail & *ring.sqMask;
+            struct io_uring_sqe *sqe = &ring.sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            prepare(sqe, next);
+            sqe->user_data = next;
+            ring.sqArray[index] = index;
+            tail++;
+            next++;
+            queued++;
+        }
+        __atomic_store_n(ring.sqTail, tail, __ATOMIC_RELEASE);
+
+        // submit them and sleep until at least one has completed
+        int submitted = (int)syscall(__NR_io_uring_enter, ring.fd, queued, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (submitted < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                continue; // nothing lost: the requests are still queued
+            int err = errno; // complete() may change errno
+
+            // The ring is broken. Requests the kernel hasn't taken are taken back out of
+            // the SQ (nobody else submits on this ring), the ones it has are waited for:
+            // their completions are posted even without io_uring_enter().
+            __atomic_store_n(ring.sqTail, tail - queued, __ATOMIC_RELEASE);
+            while (inFlight > 0)
+            {
+                take_completions(complete, completed, done, inFlight);
+                if (inFlight > 0)
+                {
+                    struct timespec pause = {0, 1000000}; // 1 ms
+                    nanosleep(&pause, nullptr);
+                }
+            }
+            for (size_t i = 0; i < count; i++)
+            {
+                if (!completed[i])
+                    complete(i, -err);
+            }
+            ringState = -1; // the callers use the plain system calls from now on
+            return;
+        }
+        queued -= submitted;
+        inFlight += submitted;
+
+        // take the completions
+        take_completions(complete, completed, done, inFlight);
+    }
+}
+
+bool uring_statx_batch(const vector<string> &paths, int flags, vector<struct statx> &stats, vector<int> &results)
+{
+    if (!setup_ring())
+        return false;
+    stats.assign(paths.size(), {});
+    results.assign(paths.size(), 0);
+    run_batch(
+        paths.size(),
+        [&](struct io_uring_sqe *sqe, size_t i)
+        {
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (unsigned long)paths[i].c_str();
+            sqe->len = STATX_BASIC_STATS;
+            sqe->off = (unsigned long)&stats[i];
+            sqe->statx_flags = flags;
+        },
+        [&](size_t i, int result)
+        {
+            // -EINVAL: a kernel older than 5.6 knows io_uring but not this request
+            if (result == -EINVAL)
+                result = (statx(AT_FDCWD, paths[i].c_str(), flags, STATX_BASIC_STATS, &stats[i]) == 0) ? 0 : -errno;
+            results[i] = result;
+        });
+    return true;
+}
+
+bool uring_openat_batch(const vector<string> &paths, int flags, vector<int> &fds)
+{
+    if (!setup_ring())
+        return false;
+    fds.assign(paths.size(), -1);
+    run_batch(
+        paths.size(),
+        [&](struct io_uring_sqe *sqe, size_t i)
+        {
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (unsigned long)paths[i].c_str();
+            sqe->open_flags = flags;
+        },
+        [&](size_t i, int result)
+        {
+            if (result == -EINVAL) // see above
+            {
+                int fd = openat(AT_FDCWD, paths[i].c_str(), flags);
+                result = (fd >= 0) ? fd : -errno;
+            }
+            fds[i] = result;
+        });
+    return true;
+}
@@ -0,0 +1,28 @@
+/*
+   uring.h
+   Header file for a small io_uring backend (raw syscalls, no liburing). It runs many
+   statx() / openat() calls as one batch with hundreds of them in flight, which helps
+   most where every call waits for the network (NFS, SMB, sshfs).
+*/
+
+#ifndef URING_H
+#define URING_H
+
+#include <string>
+#include <vector>
+#include <sys/stat.h> // for struct statx
+
+// true if the kernel lets us set up an io_uring (it can be disabled by the
+// kernel.io_uring_disabled sysctl or a seccomp filter, e.g. in containers)
+bool uring_available();
+
+// statx(AT_FDCWD, paths[i], flags, STATX_BASIC_STATS) for every path.
+// results[i] is 0 or -errno. Returns false (and does nothing) if io_uring can't be used.
+bool uring_statx_batch(const std::vector<std::string> &paths, int flags,
+                       std::vector<struct statx> &stats, std::vector<int> &results);
+
+// openat(AT_FDCWD, paths[i], flags) for every path. fds[i] is the fd or -errno.
+// Returns false (and does nothing) if io_uring can't be used.
+bool uring_openat_batch(const std::vector<std::string> &paths, int flags, std::vector<int> &fds);
+
+#endif
@@ -0,0 +1,240 @@
+/*
+vars.cpp: shell variables, export/unset/env builtins and the cached environment block.
+*/
+
+#include "vars.h"
+#include <pthread.h> // for pthread_atfork()
+#include <unordered_map>
+#include <algorithm>
+#include <iostream>
+#include <string.h> // for strchr()
+
+using namespace std;
+
+extern char **environ;
+
+struct Variable
+{
+    string value;
+    bool exported;
+};
+
+static unordered_map<string, Variable> variables;
+static vector<string> positionalArgs; // $1, $2, ...
+
+int lastStatus = 0;
+
+// The envp array handed to execve(): 'envStrings' owns the "NAME=value" texts and
+// 'envPointers' points into them. Rebuilt lazily when 'envDirty' is set.
+static vector<string> envStrings;
+static vector<char *> envPointers;
+static bool envDirty = true;
+
+// Runs in the shell right before every fork(): the block is built (if something changed)
+// in the shell itself, so the cached copy is still there for the next command. Built in
+// the child, it would be thrown away with the child.
+static void prepare_environment()
+{
+    exec_environment();
+}
+
+void init_variables()
+{
+    static bool hooked = false;
+    if (!hooked)
+    {
+        pthread_atfork(prepare_environment, nullptr, nullptr);
+        hooked = true;
+    }
+    for (char **env = environ; env != nullptr && *env != nullptr; env++)
+    {
+        string name, value;
+        if (split_assignment(*env, name, value))
+            variables[name] = {value, true};
+    }
+    envDirty = true;
+}
+
+string get_variable(const string &name)
+{
+    auto it = variables.find(name);
+    return (it == variables.end()) ? "" : it->second.value;
+}
+
+const vector<string> &positional_args()
+{
+    return positionalArgs;
+}
+
+void set_positional_args(const vector<string> &args)
+{
+    positionalArgs = args;
+}
+
+bool variable_is_set(const string &name)
+{
+    return variables.count(name) > 0;
+}
+
+void set_variable(const string &name, const string &value)
+{
+    auto it = variables.find(name);
+    if (it == variables.end())
+    {
+        variables[name] = {value, false};
+        return;
+    }
+    if (it->second.value == value)
+        return;
+    it->second.value = value;
+    if (it->second.exported)
+        envDirty = true; // only exported variables are part of the environment block
+}
+
+void export_variable(const string &name)
+{
+    Variable &var = variables[name]; // creates an empty variable if needed
+    if (!var.exported)
+    {
+        var.exported = true;
+        envDirty = true;
+    }
+}
+
+void unset_variable(const string &name)
+{
+    auto it = variables.find(name);
+    if (it == variables.end())
+        return;
+    if (it->second.exported)
+        envDirty = true;
+    variables.erase(it);
+}
+
+bool is_valid_name(const string &name)
+{
+    if (name.empty() || isdigit((unsigned char)name[0]))
+        return false;
+    for (char c : name)
+    {
+        if (!isalnum((unsigned char)c) && c != '_')
+            return false;
+    }
+    return true;
+}
+
+bool split_assignment(const string &word, string &name, string &value)
+{
+    size_t eq = word.find('=');
+    if (eq == string::npos || !is_valid_name(word.substr(0, eq)))
+        return false;
+    name = word.substr(0, eq);
+    value = word.substr(eq + 1);
+    return true;
+}
+
+char **exec_environment()
+{
+    if (envDirty)
+    {
+        envStrings.clear();
+        for (auto &entry : variables)
+        {
+            if (entry.second.exported)
+                envStrings.push_back(entry.first + "=" + entry.second.value);
+        }
+        envPointers.clear();
+        for (string &s : envStrings)
+            envPointers.push_back(&s[0]);
+        envPointers.push_back(nullptr);
+        envDirty = false;
+    }
+    return envPointers.data();
+}
+
+char **command_environment(const vector<string> &assignments)
+{
+    char **base = exec_environment(); // already up to date after fork(), unless the child changed something
+    if (assignments.empty())
+        return base;
+
+    // a NAME=value of the command replaces the shell's NAME (and an earlier one of its own)
+    auto overridden = [&](const char *entry, size_t from)
+    {
+        size_t length = strchr(entry, '=') - entry + 1; // "NAME="
+        for (size_t i = from; i < assignments.size(); i++)
+        {
+            if (assignments[i].compare(0, length, entry, length) == 0)
+                return true;
+        }
+        return false;
+    };
+    static vector<char *> pointers; // only used in the child, right before execve()
+    pointers.clear();
+    for (char **env = base; *env != nullptr; env++)
+    {
+        if (!overridden(*env, 0))
+            pointers.push_back(*env);
+    }
+    for (size_t i = 0; i < assignments.size(); i++)
+    {
+        if (!overridden(assignments[i].c_str(), i + 1))
+            pointers.push_back(const_cast<char *>(assignments[i].c_str()));
+    }
+    pointers.push_back(nullptr);
+    return pointers.data();
+}
+
+// exported variables sorted by name, for printing
+static vector<string> sorted_exported_names()
+{
+    vector<string> names;
+    for (auto &entry : variables)
+    {
+        if (entry.second.exported)
+            names.push_back(entry.first);
+    }
+    sort(names.begin(), names.end());
+    return names;
+}
+
+void export_command(const vector<string> &args)
+{
+    if (args.size() == 1)
+    {
+        // no arguments: list the exported variables
+        for (const string &name : sorted_exported_names())
+            cout << "declare -x " << name << "=\"" << variables[name].value << "\"" << endl;
+        return;
+    }
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        string name, value;
+        if (split_assignment(args[i], name, value)) // export NAME=value
+        {
+            set_variable(name, value);
+            export_variable(name);
+        }
+        else if (is_valid_name(args[i])) // export NAME
+        {
+            export_variable(args[i]);
+        }
+        else
+        {
+            cerr << "export: '" << args[i] << "': not a valid identifier" << endl;
+            lastStatus = 1;
+        }
+    }
+}
+
+void unset_command(const vector<string> &args)
+{
+    for (size_t i = 1; i < args.size(); i++)
+        unset_variable(args[i]);
+}
+
+void env_command()
+{
+    for (const string &name : sorted_exported_names())
+        cout << name << "=" << variables[name].value << endl;
+}
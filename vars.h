@@ -0,0 +1,56 @@
+/*
+   vars.h
+   Header file for shell variables and the environment passed to commands.
+*/
+
+#ifndef VARS_H
+#define VARS_H
+
+#include <string>
+#include <vector>
+
+// Copies the process environment into the variable table (all of them exported)
+void init_variables();
+
+// Value of a variable, "" if it is not set
+std::string get_variable(const std::string &name);
+
+// true if the variable exists (it may still be empty)
+bool variable_is_set(const std::string &name);
+
+// Sets a variable; it stays exported if it already was
+void set_variable(const std::string &name, const std::string &value);
+
+// Marks a variable as exported, so commands started by the shell see it
+void export_variable(const std::string &name);
+
+// Removes a variable
+void unset_variable(const std::string &name);
+
+// true for valid variable names: a letter or '_' followed by letters, digits and '_'
+bool is_valid_name(const std::string &name);
+
+// Splits "NAME=value" into its parts. Returns false if 'word' is not an assignment.
+bool split_assignment(const std::string &word, std::string &name, std::string &value);
+
+// The exported variables as an envp array for execve(). It is cached and only
+// rebuilt after an exported variable has changed, not for every command.
+char **exec_environment();
+
+// exec_environment() with the command's own "NAME=value" words ("VAR=x cmd") put over it.
+// Used in the child right before execve(); the shell's variables are not changed.
+char **command_environment(const std::vector<std::string> &assignments);
+
+// Exit status of the last command, shown by $?. 0 means success.
+extern int lastStatus;
+
+// Positional parameters $1, $2, ... (the arguments of the running shell function)
+const std::vector<std::string> &positional_args();
+void set_positional_args(const std::vector<std::string> &args);
+
+// Builtins: export, unset, env
+void export_command(const std::vector<std::string> &args);
+void unset_command(const std::vector<std::string> &args);
+void env_command();
+
+#endif
@@ -0,0 +1,336 @@
+/*
+walk.cpp: directory traversal with a synchronous, an io_uring and a threaded backend.
+*/
+
+#include "walk.h"
+#include "uring.h" // for uring_statx_batch(), uring_openat_batch()
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/sysmacros.h> // for makedev()
+#include <iostream>
+#include <set>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+
+using namespace std;
+
+#define WALK_CHUNK 256 // directories open at the same time
+
+int take_backend_flag(vector<string> &args, WalkBackend &backend)
+{
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        if (args[i].compare(0, 10, "--backend=") != 0)
+            continue;
+        string name = args[i].substr(10);
+        if (name == "sync")
+            backend = WALK_SYNC;
+        else if (name == "uring" || name == "io_uring")
+            backend = WALK_URING;
+        else if (name == "threads")
+            backend = WALK_THREADS;
+        else
+        {
+            cerr << args[0] << ": unknown backend '" << name << "' (sync, uring or threads)" << endl;
+            return -1;
+        }
+        args.erase(args.begin() + i);
+        return 1;
+    }
+    return 0;
+}
+
+// The fields of a struct statx in a struct stat, for the code which prints them
+static void statx_to_stat(const struct statx &x, struct stat &st)
+{
+    memset(&st, 0, sizeof(st));
+    st.st_dev = makedev(x.stx_dev_major, x.stx_dev_minor);
+    st.st_ino = x.stx_ino;
+    st.st_mode = x.stx_mode;
+    st.st_nlink = x.stx_nlink;
+    st.st_uid = x.stx_uid;
+    st.st_gid = x.stx_gid;
+    st.st_rdev = makedev(x.stx_rdev_major, x.stx_rdev_minor);
+    st.st_size = x.stx_size;
+    st.st_blksize = x.stx_blksize;
+    st.st_blocks = x.stx_blocks;
+    st.st_atim.tv_sec = x.stx_atime.tv_sec;
+    st.st_atim.tv_nsec = x.stx_atime.tv_nsec;
+    st.st_mtim.tv_sec = x.stx_mtime.tv_sec;
+    st.st_mtim.tv_nsec = x.stx_mtime.tv_nsec;
+    st.st_ctim.tv_sec = x.stx_ctime.tv_sec;
+    st.st_ctim.tv_nsec = x.stx_ctime.tv_nsec;
+}
+
+void stat_many(const vector<string> &paths, vector<struct stat> &stats, vector<int> &results, WalkBackend backend)
+{
+    stats.assign(paths.size(), {});
+    results.assign(paths.size(), 0);
+
+    vector<struct statx> xstats;
+    if (backend == WALK_URING && uring_statx_batch(paths, 0, xstats, results))
+    {
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            if (results[i] == 0)
+                statx_to_stat(xstats[i], stats[i]);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < paths.size(); i++)
+        results[i] = (stat(paths[i].c_str(), &stats[i]) == 0) ? 0 : -errno;
+}
+
+// Opens every directory for reading. fds[i] is the fd or -errno.
+static void open_many(const vector<string> &paths, vector<int> &fds, WalkBackend backend)
+{
+    int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+    if (backend == WALK_URING && uring_openat_batch(paths, flags, fds))
+        return;
+
+    fds.assign(paths.size(), -1);
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        fds[i] = open(paths[i].c_str(), flags);
+        if (fds[i] < 0)
+            fds[i] = -errno;
+    }
+}
+
+bool walk_tree(const string &root, WalkBackend backend, const function<bool(const WalkEntry &)> &visit)
+{
+    if (backend == WALK_THREADS)
+    {
+        WalkOptions options;
+        options.needStat = false;
+        options.followLinks = true;
+        return walk_tree_parallel(root, options, [&](const WalkInfo &info)
+                                  {
+                                      WalkEntry entry = {info.path, info.name, S_ISDIR(info.st.st_mode)};
+                                      return visit(entry) ? WALK_CONTINUE : WALK_STOP;
+                                  });
+    }
+
+    set<pair<dev_t, ino_t>> linkedDirs; // directories reached through a symlink, against loops
+    vector<string> level = {root};
+
+    while (!level.empty())
+    {
+        vector<string> nextLevel;
+        for (size_t start = 0; start < level.size(); start += WALK_CHUNK)
+        {
+            vector<string> dirs(level.begin() + start, level.begin() + min(level.size(), start + WALK_CHUNK));
+            vector<int> fds;
+            open_many(dirs, fds, backend);
+
+            // read the entries of these directories
+            vector<WalkEntry> known;       // readdir() told us the type
+            vector<WalkEntry> unknown;     // these need a stat()
+            vector<string> unknownPaths;
+            for (size_t i = 0; i < dirs.size(); i++)
+            {
+                if (fds[i] < 0)
+                    continue;
+                DIR *dir = fdopendir(fds[i]);
+                if (dir == nullptr)
+                {
+                    close(fds[i]);
+                    continue;
+                }
+                struct dirent *entry;
+                while ((entry = readdir(dir)) != nullptr)
+                {
+                    string name = entry->d_name;
+                    if (name == "." || name == "..")
+                        continue;
+                    WalkEntry found = {dirs[i] + "/" + name, name, entry->d_type == DT_DIR};
+                    if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK)
+                    {
+                        unknownPaths.push_back(found.path);
+                        unknown.push_back(found);
+                    }
+                    else
+                        known.push_back(found);
+                }
+                closedir(dir);
+            }
+
+            for (const WalkEntry &entry : known)
+            {
+                if (!visit(entry))
+                    return true;
+                if (entry.isDir)
+                    nextLevel.push_back(entry.path);
+            }
+
+            vector<struct stat> stats;
+            vector<int> results;
+            stat_many(unknownPaths, stats, results, backend);
+            for (size_t i = 0; i < unknown.size(); i++)
+            {
+                WalkEntry &entry = unknown[i];
+                entry.isDir = (results[i] == 0 && S_ISDIR(stats[i].st_mode));
+                if (!visit(entry))
+                    return true;
+                // a symlink to a directory is followed only the first time
+                if (entry.isDir && linkedDirs.insert({stats[i].st_dev, stats[i].st_ino}).second)
+                    nextLevel.push_back(entry.path);
+            }
+        }
+        level.swap(nextLevel);
+    }
+    return false;
+}
+
+int default_walk_threads()
+{
+    // the threads mostly wait for the disk or the network, so more than the CPUs is fine
+    int cpus = (int)thread::hardware_concurrency();
+    return (cpus < 4) ? 4 : (cpus > 32 ? 32 : cpus);
+}
+
+// A directory waiting in the queue of walk_tree_parallel()
+struct DirTask
+{
+    string path;
+    int depth;
+};
+
+// The state the threads of one walk share
+struct ParallelWalk
+{
+    const WalkOptions *options;
+    const function<WalkAction(const WalkInfo &)> *visit;
+
+    mutex lock;                 // for queue and busy
+    condition_variable wake;    // work was added, or everything is done
+    deque<DirTask> queue;
+    int busy = 0;               // threads reading a directory right now
+    atomic<bool> stopped{false};
+
+    mutex linkLock;             // for linkedDirs
+    set<pair<dev_t, ino_t>> linkedDirs;
+};
+
+// Reads one directory. Its subdirectories are added to 'found'.
+static void read_directory(ParallelWalk &walk, const DirTask &task, int threadIndex, vector<DirTask> &found)
+{
+    DIR *dir = opendir(task.path.c_str());
+    if (dir == nullptr)
+    {
+        if (walk.options->onError)
+            walk.options->onError(task.path, errno);
+        return;
+    }
+    int dirFd = dirfd(dir);
+    string prefix = (task.path.size() > 0 && task.path.back() == '/') ? task.path : task.path + "/";
+
+    WalkInfo info;
+    info.depth = task.depth + 1;
+    info.thread = threadIndex;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr && !walk.stopped.load(memory_order_relaxed))
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        info.name = entry->d_name;
+        info.path = prefix + info.name;
+
+        bool linkedDir = false;
+        if (walk.options->needStat || entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK)
+        {
+            // fstatat() relative to the open directory: the kernel doesn't walk the whole path again
+            if (fstatat(dirFd, entry->d_name, &info.st, AT_SYMLINK_NOFOLLOW) != 0)
+                continue; // it went away in the meantime
+            info.hasStat = true;
+            struct stat target;
+            if (S_ISLNK(info.st.st_mode) && walk.options->followLinks &&
+                fstatat(dirFd, entry->d_name, &target, 0) == 0)
+            {
+                info.st = target;
+                linkedDir = S_ISDIR(target.st_mode);
+            }
+        }
+        else
+        {
+            memset(&info.st, 0, sizeof(info.st));
+            info.st.st_mode = DTTOIF(entry->d_type); // only the type is known
+            info.hasStat = false;
+        }
+
+        WalkAction action = (*walk.visit)(info);
+        if (action == WALK_STOP)
+        {
+            walk.stopped = true;
+            break;
+        }
+        if (action == WALK_SKIP || !S_ISDIR(info.st.st_mode))
+            continue;
+        if (linkedDir)
+        {
+            // a symlink to a directory is followed only the first time
+            lock_guard<mutex> guard(walk.linkLock);
+            if (!walk.linkedDirs.insert({info.st.st_dev, info.st.st_ino}).second)
+                continue;
+        }
+        found.push_back({info.path, info.depth});
+    }
+    closedir(dir);
+}
+
+// One thread: takes directories from the queue until the queue is empty and no other
+// thread is still reading (which could add more)
+static void walk_worker(ParallelWalk &walk, int threadIndex)
+{
+    vector<DirTask> found;
+    unique_lock<mutex> guard(walk.lock);
+    while (true)
+    {
+        walk.wake.wait(guard, [&]
+                       { return !walk.queue.empty() || walk.busy == 0 || walk.stopped; });
+        if (walk.stopped || walk.queue.empty())
+            break; // busy == 0 too: nobody can add work any more
+
+        // newest first: the walk goes deep, which keeps the queue short
+        DirTask task = move(walk.queue.back());
+        walk.queue.pop_back();
+        walk.busy++;
+        guard.unlock();
+
+        found.clear();
+        read_directory(walk, task, threadIndex, found);
+
+        guard.lock();
+        walk.busy--;
+        for (DirTask &dir : found)
+            walk.queue.push_back(move(dir));
+        if (!found.empty() || walk.busy == 0 || walk.stopped)
+            walk.wake.notify_all();
+    }
+    walk.wake.notify_all(); // let the others see that we are done
+}
+
+bool walk_tree_parallel(const string &root, const WalkOptions &options,
+                        const function<WalkAction(const WalkInfo &)> &visit)
+{
+    ParallelWalk walk;
+    walk.options = &options;
+    walk.visit = &visit;
+    walk.queue.push_back({root, 0});
+
+    int count = (options.threads > 0) ? options.threads : default_walk_threads();
+    vector<thread> threads;
+    for (int i = 1; i < count; i++)
+        threads.emplace_back(walk_worker, ref(walk), i);
+    walk_worker(walk, 0); // the shell's own thread works too
+    for (thread &t : threads)
+        t.join();
+    return walk.stopped;
+}
@@ -0,0 +1,86 @@
+/*
+   walk.h
+   Header file for directory traversal used by the search, ls and du builtins. The
+   metadata calls (openat, stat) can go one by one (sync), in batches through
+   io_uring, or be spread over several threads, chosen with a "--backend=" flag.
+*/
+
+#ifndef WALK_H
+#define WALK_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <sys/stat.h>
+
+enum WalkBackend
+{
+    WALK_SYNC,  // one system call at a time
+    WALK_URING,  // batches through io_uring; falls back to WALK_SYNC if the kernel says no
+    WALK_THREADS // several threads, each reading its own directories
+};
+
+// Takes a "--backend=sync|uring|threads" flag out of args. Returns 0 if there was none, 1 if it
+// was taken, -1 (after printing an error) if the backend name is unknown.
+int take_backend_flag(std::vector<std::string> &args, WalkBackend &backend);
+
+// stat() (following symlinks) of every path. results[i] is 0 or -errno.
+void stat_many(const std::vector<std::string> &paths, std::vector<struct stat> &stats,
+               std::vector<int> &results, WalkBackend backend);
+
+// One entry found by walk_tree()
+struct WalkEntry
+{
+    std::string path; // root + "/" + ... + name
+    std::string name;
+    bool isDir;
+};
+
+// Visits every entry below 'root' (not root itself), level by level. visit() returns
+// false to stop the walk. Symlinks to directories are followed, without going round in
+// a loop. Directories which can't be opened are skipped.
+// All directories of a level are opened together, and entries whose type readdir()
+// doesn't tell (symlinks, some network filesystems) are stat()ed together.
+// With WALK_THREADS the walk is done by walk_tree_parallel() (no fixed order) and
+// visit() is called from several threads at once.
+// Returns true if visit() stopped the walk.
+bool walk_tree(const std::string &root, WalkBackend backend, const std::function<bool(const WalkEntry &)> &visit);
+
+// What the visit function of walk_tree_parallel() wants next
+enum WalkAction
+{
+    WALK_CONTINUE, // go on (and into this entry, if it is a directory)
+    WALK_SKIP,     // don't go into this directory
+    WALK_STOP      // stop the whole walk
+};
+
+// One entry found by walk_tree_parallel()
+struct WalkInfo
+{
+    std::string path;
+    std::string name;
+    int depth;       // 1 for the entries of root, 2 below them, ...
+    bool hasStat;    // false: only the file type in st.st_mode is known (from readdir())
+    struct stat st;  // lstat() data, or stat() of the target for a followed symlink
+    int thread;      // which thread calls visit(), 0 .. threads-1 (for per-thread data)
+};
+
+struct WalkOptions
+{
+    int threads = 0;          // 0: a default from the number of CPUs
+    bool needStat = true;     // false: stat() only if readdir() doesn't tell the type
+    bool followLinks = false; // go into symlinks to directories (each directory once)
+    std::function<void(const std::string &path, int error)> onError; // a directory that can't be read
+};
+
+// The number of threads walk_tree_parallel() uses for options.threads == 0
+int default_walk_threads();
+
+// Visits every entry below 'root' (not root itself) with several threads, which take
+// directories from a shared queue. visit() is called from all of them, so it must be
+// thread-safe; info.thread helps to keep data per thread without locks.
+// Returns true if visit() stopped the walk with WALK_STOP.
+bool walk_tree_parallel(const std::string &root, const WalkOptions &options,
+                        const std::function<WalkAction(const WalkInfo &)> &visit);
+
+#endif
@@ -0,0 +1,396 @@
+/*
+watch.cpp: the watch builtin, a full-screen view of a command which is run at a fixed interval.
+
+The runs are timed by a timerfd armed with absolute deadlines: start + interval,
+start + 2 * interval ... The time the command itself takes doesn't push the next run
+back (like "while true; do cmd; sleep 2; done" would), so the runs stay on the same
+grid however long watch is left running. A run which takes longer than the interval
+just skips the ticks it missed.
+
+The output of every run (stdout and stderr) goes into a memfd: builtins run inside the
+shell, programs are started the normal way by execute_line(). The output is then cut
+into screen cells, and only the rows which differ from what is on the screen are
+written again, so the terminal doesn't flicker.
+*/
+
+#include "watch.h"
+#include "io.h"        // for execute_line()
+#include "redirect.h"  // to point stdout / stderr at the memfd
+#include "supervise.h" // for parse_duration()
+#include "eventloop.h" // for shell_signal_fd(), take_interrupt()
+#include "vars.h"      // for lastStatus
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/mman.h>  // for memfd_create()
+#include <sys/ioctl.h> // for TIOCGWINSZ
+#include <termios.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <stdio.h>
+#include <iostream>
+
+using namespace std;
+
+#define DEFAULT_INTERVAL_MS 2000
+#define MIN_INTERVAL_MS 100
+#define TAB_WIDTH 8
+
+// One row of the screen: one string per character cell (a UTF-8 character takes several bytes)
+typedef vector<string> Row;
+
+// Runs 'command' once and returns everything it wrote to stdout and stderr
+static string capture_run(const string &command)
+{
+    int file = memfd_create("watch-output", MFD_CLOEXEC);
+    if (file < 0)
+    {
+        perror("watch: memfd_create");
+        return "";
+    }
+    vector<SavedFd> saved;
+    vector<Redirection> toFile = {{REDIRECT_DUPLICATE, STDOUT_FILENO, "", file},
+                                  {REDIRECT_DUPLICATE, STDERR_FILENO, "", file}};
+    if (apply_redirections(toFile, &saved))
+        execute_line(command);
+    restore_fds(saved);
+
+    string output;
+    char buffer[65536];
+    off_t offset = 0;
+    ssize_t n;
+    while ((n = pread(file, buffer, sizeof(buffer), offset)) > 0)
+    {
+        output.append(buffer, n);
+        offset += n;
+    }
+    close(file);
+    return output;
+}
+
+static void screen_size(int &rows, int &columns)
+{
+    struct winsize size;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_row > 0 && size.ws_col > 0)
+    {
+        rows = size.ws_row;
+        columns = size.ws_col;
+    }
+    else
+    {
+        rows = 24;
+        columns = 80;
+    }
+}
+
+// Cuts text into at most 'maxRows' rows of at most 'columns' cells. Tabs are expanded,
+// escape sequences (colours) and other control characters are left out.
+static vector<Row> to_rows(const string &text, size_t columns, size_t maxRows)
+{
+    vector<Row> rows(1);
+    for (size_t i = 0; i < text.size() && rows.size() <= maxRows; i++)
+    {
+        unsigned char c = text[i];
+        Row &row = rows.back();
+        if (c == '\n')
+            rows.emplace_back();
+        else if (c == '\t')
+        {
+            do
+                row.push_back(" ");
+            while (row.size() % TAB_WIDTH != 0);
+        }
+        else if (c == 0x1b)
+        {
+            // ESC [ ... letter, or ESC and one more character
+            if (i + 1 < text.size() && text[i + 1] == '[')
+            {
+                i += 2;
+                while (i < text.size() && !(text[i] >= 0x40 && text[i] <= 0x7e))
+                    i++;
+            }
+            else
+                i++;
+        }
+        else if (c < 0x20 || c == 0x7f)
+            continue;
+        else if ((c & 0xc0) == 0x80 && !row.empty())
+            row.back() += (char)c; // the rest of a UTF-8 character
+        else
+            row.push_back(string(1, (char)c));
+    }
+    if (rows.size() > maxRows)
+        rows.resize(maxRows);
+    for (Row &row : rows)
+    {
+        if (row.size() > columns)
+            row.resize(columns); // long lines are cut, not wrapped
+    }
+    return rows;
+}
+
+// The text which draws 'row'. With 'before' (the same row in the last run) the cells
+// which differ from it are shown in reverse video.
+static string render_row(const Row &row, const Row *before)
+{
+    string out;
+    bool reversed = false;
+    for (size_t c = 0; c < row.size(); c++)
+    {
+        bool changed = before != nullptr && (c >= before->size() || (*before)[c] != row[c]);
+        if (changed != reversed)
+        {
+            out += changed ? "\033[7m" : "\033[27m";
+            reversed = changed;
+        }
+        out += row[c];
+    }
+    if (reversed)
+        out += "\033[27m";
+    return out;
+}
+
+// "Every 2.0s: date" on the left, "host: Sat Oct 18 10:00:00 2026" on the right
+static string make_title(long long intervalMs, const string &command, int columns)
+{
+    char left[64];
+    snprintf(left, sizeof(left), "Every %.1fs: ", intervalMs / 1000.0);
+    string title = left + command;
+
+    char host[256];
+    if (gethostname(host, sizeof(host)) != 0)
+        host[0] = '\0';
+    host[sizeof(host) - 1] = '\0';
+    char date[64];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%a %b %e %H:%M:%S %Y", localtime(&now));
+    string right = string(host) + ": " + date;
+
+    if ((int)(title.size() + right.size()) < columns)
+        title += string(columns - title.size() - right.size(), ' ') + right;
+    return title;
+}
+
+// Everything shown for one run, one string per screen row: the title, an empty line,
+// then the output. 'before' is the output of the last run when changes are highlighted.
+static vector<string> make_frame(const string &title, const string &output, const string *before,
+                                 int rows, int columns)
+{
+    vector<string> frame;
+    if (!title.empty())
+    {
+        frame.push_back(render_row(to_rows(title, columns, 1)[0], nullptr));
+        frame.push_back("");
+    }
+    size_t room = (rows > (int)frame.size()) ? rows - frame.size() : 0;
+    vector<Row> now = to_rows(output, columns, room);
+    vector<Row> old;
+    if (before != nullptr)
+        old = to_rows(*before, columns, room);
+    Row missing; // a row the last run didn't have: all of it is new
+    for (size_t r = 0; r < now.size(); r++)
+    {
+        const Row *last = nullptr;
+        if (before != nullptr)
+            last = (r < old.size()) ? &old[r] : &missing;
+        frame.push_back(render_row(now[r], last));
+    }
+    return frame;
+}
+
+// Writes the rows of 'frame' which differ from 'shown' (what is on the screen now)
+static void draw_frame(const vector<string> &frame, vector<string> &shown)
+{
+    string out;
+    for (size_t r = 0; r < max(frame.size(), shown.size()); r++)
+    {
+        string text = (r < frame.size()) ? frame[r] : "";
+        if (r < shown.size() && shown[r] == text)
+            continue;
+        out += "\033[" + to_string(r + 1) + ";1H" + text + "\033[K"; // go to the row, write it, clear the rest
+    }
+    shown = frame;
+    cout << out << flush;
+}
+
+int watch_command(const vector<string> &args)
+{
+    long long intervalMs = DEFAULT_INTERVAL_MS;
+    bool highlight = false;
+    bool showTitle = true;
+    size_t i = 1;
+    for (; i < args.size() && args[i].size() > 1 && args[i][0] == '-'; i++)
+    {
+        if (args[i] == "--")
+        {
+            i++;
+            break;
+        }
+        if (args[i].compare(0, 2, "-n") == 0)
+        {
+            // "-n 5" or "-n5"
+            string value = args[i].substr(2);
+            if (value.empty() && i + 1 < args.size())
+                value = args[++i];
+            intervalMs = parse_duration(value);
+            if (intervalMs < 0)
+            {
+                cerr << "watch: invalid interval '" << value << "'" << endl;
+                return 2;
+            }
+        }
+        else if (args[i] == "-d")
+            highlight = true;
+        else if (args[i] == "-t")
+            showTitle = false;
+        else
+        {
+            cerr << "watch: unknown option '" << args[i] << "'" << endl;
+            return 2;
+        }
+    }
+    if (i >= args.size())
+    {
+        cerr << "Usage: watch [-n INTERVAL] [-d] [-t] command [args...]" << endl;
+        return 2;
+    }
+    if (intervalMs < MIN_INTERVAL_MS)
+        intervalMs = MIN_INTERVAL_MS;
+    string command;
+    for (size_t k = i; k < args.size(); k++)
+        command += (k > i ? " " : "") + args[k];
+
+    // The first run is now; after that the timer fires at start + k * interval. With
+    // TFD_TIMER_ABSTIME and it_interval the kernel keeps that grid by itself.
+    int timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (timer < 0)
+    {
+        perror("watch: timerfd_create");
+        return 1;
+    }
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = intervalMs / 1000;
+    spec.it_interval.tv_nsec = (intervalMs % 1000) * 1000000;
+    clock_gettime(CLOCK_MONOTONIC, &spec.it_value);
+    spec.it_value.tv_sec += spec.it_interval.tv_sec;
+    spec.it_value.tv_nsec += spec.it_interval.tv_nsec;
+    if (spec.it_value.tv_nsec >= 1000000000)
+    {
+        spec.it_value.tv_sec++;
+        spec.it_value.tv_nsec -= 1000000000;
+    }
+    timerfd_settime(timer, TFD_TIMER_ABSTIME, &spec, nullptr);
+
+    // On a terminal: the alternate screen (the old contents come back afterwards), no
+    // cursor, and typed keys are read one by one without being shown (for 'q').
+    // Otherwise (e.g. "watch date > log") every run is just printed after the last one.
+    bool screen = isatty(STDOUT_FILENO);
+    bool keys = screen && isatty(STDIN_FILENO);
+    struct termios savedTerminal;
+    if (keys && tcgetattr(STDIN_FILENO, &savedTerminal) == 0)
+    {
+        struct termios raw = savedTerminal;
+        raw.c_lflag &= ~(ICANON | ECHO); // ISIG stays on: Ctrl+C still sends SIGINT
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    }
+    else
+        keys = false;
+    if (screen)
+        cout << "\033[?1049h\033[?25l\033[2J" << flush;
+
+    int rows, columns;
+    screen_size(rows, columns);
+    vector<string> shown;  // the rows on the screen now
+    string output, before; // the output of the last run and of the one before it
+    int runs = 0;
+    int status = 0;
+    int signalFd = shell_signal_fd();
+    while (true)
+    {
+        before.swap(output);
+        output = capture_run(command);
+        runs++;
+        if (lastStatus == 130 || take_interrupt())
+        {
+            status = 130; // Ctrl+C while the command ran
+            break;
+        }
+
+        string title = showTitle ? make_title(intervalMs, command, columns) : "";
+        if (screen)
+            draw_frame(make_frame(title, output, (highlight && runs > 1) ? &before : nullptr, rows, columns), shown);
+        else
+        {
+            string text = title.empty() ? output : title + "\n\n" + output;
+            if (!text.empty() && text.back() != '\n')
+                text += '\n';
+            cout << text << flush;
+        }
+
+        // sleep until the next tick, Ctrl+C, 'q' or a change of the window size
+        bool tick = false;
+        bool done = false;
+        while (!tick && !done)
+        {
+            struct pollfd fds[3];
+            int count = 0;
+            fds[count++] = {timer, POLLIN, 0};
+            if (signalFd >= 0)
+                fds[count++] = {signalFd, POLLIN, 0};
+            if (keys)
+                fds[count++] = {STDIN_FILENO, POLLIN, 0};
+            if (poll(fds, count, -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                done = true;
+                break;
+            }
+            uint64_t expirations; // more than 1 if the last run took longer than the interval
+            if ((fds[0].revents & POLLIN) && read(timer, &expirations, sizeof(expirations)) == sizeof(expirations))
+                tick = true;
+
+            struct signalfd_siginfo info;
+            bool resized = false;
+            while (signalFd >= 0 && read(signalFd, &info, sizeof(info)) == sizeof(info))
+            {
+                if (info.ssi_signo == SIGINT)
+                {
+                    status = 130;
+                    done = true;
+                }
+                else if (info.ssi_signo == SIGWINCH)
+                    resized = true;
+            }
+            if (keys && (fds[count - 1].revents & POLLIN))
+            {
+                char key;
+                if (read(STDIN_FILENO, &key, 1) == 1 && (key == 'q' || key == 'Q'))
+                    done = true;
+            }
+            if (resized && screen && !done)
+            {
+                // everything moves on a new size: draw it all again
+                screen_size(rows, columns);
+                cout << "\033[2J" << flush;
+                shown.clear();
+                title = showTitle ? make_title(intervalMs, command, columns) : "";
+                draw_frame(make_frame(title, output, (highlight && runs > 1) ? &before : nullptr, rows, columns), shown);
+            }
+        }
+        if (done)
+            break;
+    }
+
+    if (screen)
+        cout << "\033[?25h\033[?1049l" << flush;
+    if (keys)
+        tcsetattr(STDIN_FILENO, TCSANOW, &savedTerminal);
+    close(timer);
+    return status;
+}
@@ -0,0 +1,20 @@
+/*
+   watch.h
+   Header file for the watch builtin: runs a command again and again at a fixed
+   interval and shows its latest output on the whole screen.
+*/
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <string>
+#include <vector>
+
+// "watch [-n INTERVAL] [-d] [-t] command [args...]": runs the command every INTERVAL
+// (2s by default, at least 0.1s; 10, 1.5, 500ms, 1m ...) until Ctrl+C or 'q'.
+// The words of the command are joined with spaces and run as a command line, so
+// "watch 'ls | wc -l'" works. -d highlights the characters which changed since the
+// last run, -t leaves out the title line. Returns 130 after Ctrl+C, else 0.
+int watch_command(const std::vector<std::string> &args);
+
+#endif